@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2013-2018, The PurpleI2P Project
+* Copyright (c) 2013-2017 The Anoncoin Core developers
+*
+* This file is part of Purple i2pd project and licensed under BSD3
+*
+*/
+
+#include "Gost3411.h"
+
+#include <string.h>
+
+#include <smmintrin.h>
+
+namespace i2p
+{
+namespace crypto
+{
+namespace streebog
+{
+
+//! The 64 byte state lives in four registers, x0 holds words 0 and 1, x1 words 2 and 3, and so on.
+//! Output words 2w and 2w + 1 of the LPS transform need bytes 2w and 2w + 1 of every state word,
+//! which come out together from a single 16 bit extract, the table entries are xor'ed into xmm.
+
+#define LOADT(k, b) _mm_loadl_epi64((const __m128i *)&T[k][(b)])
+
+#define LPS_PAIR(x0, x1, x2, x3, w, y) \
+{ \
+	const unsigned int v0 = _mm_extract_epi16(x0, w), v1 = _mm_extract_epi16(x0, 4 + w); \
+	const unsigned int v2 = _mm_extract_epi16(x1, w), v3 = _mm_extract_epi16(x1, 4 + w); \
+	const unsigned int v4 = _mm_extract_epi16(x2, w), v5 = _mm_extract_epi16(x2, 4 + w); \
+	const unsigned int v6 = _mm_extract_epi16(x3, w), v7 = _mm_extract_epi16(x3, 4 + w); \
+	__m128i lo = _mm_xor_si128(_mm_xor_si128(LOADT(7, v0 & 0xFF), LOADT(6, v1 & 0xFF)), \
+	                           _mm_xor_si128(LOADT(5, v2 & 0xFF), LOADT(4, v3 & 0xFF))); \
+	__m128i hi = _mm_xor_si128(_mm_xor_si128(LOADT(7, v0 >> 8), LOADT(6, v1 >> 8)), \
+	                           _mm_xor_si128(LOADT(5, v2 >> 8), LOADT(4, v3 >> 8))); \
+	lo = _mm_xor_si128(lo, _mm_xor_si128(_mm_xor_si128(LOADT(3, v4 & 0xFF), LOADT(2, v5 & 0xFF)), \
+	                                     _mm_xor_si128(LOADT(1, v6 & 0xFF), LOADT(0, v7 & 0xFF)))); \
+	hi = _mm_xor_si128(hi, _mm_xor_si128(_mm_xor_si128(LOADT(3, v4 >> 8), LOADT(2, v5 >> 8)), \
+	                                     _mm_xor_si128(LOADT(1, v6 >> 8), LOADT(0, v7 >> 8)))); \
+	y = _mm_unpacklo_epi64(lo, hi); \
+}
+
+#define LPS(x0, x1, x2, x3) \
+{ \
+	__m128i y0, y1, y2, y3; \
+	LPS_PAIR(x0, x1, x2, x3, 0, y0) \
+	LPS_PAIR(x0, x1, x2, x3, 1, y1) \
+	LPS_PAIR(x0, x1, x2, x3, 2, y2) \
+	LPS_PAIR(x0, x1, x2, x3, 3, y3) \
+	x0 = y0; x1 = y1; x2 = y2; x3 = y3; \
+}
+
+#define LOAD(p, x0, x1, x2, x3) \
+	x0 = _mm_loadu_si128((const __m128i *)(p) + 0); \
+	x1 = _mm_loadu_si128((const __m128i *)(p) + 1); \
+	x2 = _mm_loadu_si128((const __m128i *)(p) + 2); \
+	x3 = _mm_loadu_si128((const __m128i *)(p) + 3);
+
+#define XOR(x0, x1, x2, x3, y0, y1, y2, y3) \
+	x0 = _mm_xor_si128(x0, y0); \
+	x1 = _mm_xor_si128(x1, y1); \
+	x2 = _mm_xor_si128(x2, y2); \
+	x3 = _mm_xor_si128(x3, y3);
+
+void Compress_sse41 (uint64_t * h, const uint64_t * N, const uint64_t * m, const uint64_t * pKeys)
+{
+	__m128i s0, s1, s2, s3;
+	__m128i k0, k1, k2, k3;
+	__m128i t0, t1, t2, t3;
+	__m128i m0, m1, m2, m3;
+	__m128i h0, h1, h2, h3;
+
+	LOAD(h, h0, h1, h2, h3);
+	LOAD(m, m0, m1, m2, m3);
+	s0 = m0; s1 = m1; s2 = m2; s3 = m3;
+
+	if (pKeys)
+	{
+		LOAD(pKeys, k0, k1, k2, k3);
+		XOR(s0, s1, s2, s3, k0, k1, k2, k3);
+		for (int i = 0; i < 12; i++)
+		{
+			LPS(s0, s1, s2, s3);
+			LOAD(&pKeys[(i + 1) * 8], k0, k1, k2, k3);
+			XOR(s0, s1, s2, s3, k0, k1, k2, k3);
+		}
+	}
+	else
+	{
+		LOAD(N, k0, k1, k2, k3);
+		XOR(k0, k1, k2, k3, h0, h1, h2, h3);
+		LPS(k0, k1, k2, k3);
+		XOR(s0, s1, s2, s3, k0, k1, k2, k3);
+		for (int i = 0; i < 12; i++)
+		{
+			LPS(s0, s1, s2, s3);
+			LOAD(C[i], t0, t1, t2, t3);
+			XOR(k0, k1, k2, k3, t0, t1, t2, t3);
+			LPS(k0, k1, k2, k3);
+			XOR(s0, s1, s2, s3, k0, k1, k2, k3);
+		}
+	}
+
+	XOR(s0, s1, s2, s3, h0, h1, h2, h3);
+	XOR(s0, s1, s2, s3, m0, m1, m2, m3);
+	_mm_storeu_si128((__m128i *)h + 0, s0);
+	_mm_storeu_si128((__m128i *)h + 1, s1);
+	_mm_storeu_si128((__m128i *)h + 2, s2);
+	_mm_storeu_si128((__m128i *)h + 3, s3);
+}
+
+}
+}
+}
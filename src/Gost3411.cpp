@@ -29,9 +29,7 @@
  * @author   Thomas Pornin <thomas.pornin@cryptolog.com>
  */
 
-//#include <stddef.h>
-//#include <string.h>
-
+// Anoncoin-config.h is loaded through the header, for the ENABLE_SSE41 setting
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
@@ -39,15 +37,25 @@
 
 #include "Gost3411.h"
 
-#ifdef __cplusplus
-extern "C"{
+#if defined(ENABLE_SSE41)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 #endif
-
 
 #ifdef _MSC_VER
 #pragma warning (disable: 4146)
 #endif
 
+namespace i2p
+{
+namespace crypto
+{
+namespace streebog
+{
+
 //--------------------------------------------------------------------------------------------
 //
 //	stribog implementation
@@ -56,7 +64,7 @@ extern "C"{
 
 
 // Tables for function F
-const unsigned long long T[8][256] = {
+const uint64_t T[8][256] = {
 		{
 				0xE6F87E5C5B711FD0,0x258377800924FA16,0xC849E07E852EA4A8,0x5B4686A18F06C16A,
 				0x0B32E9A2D77B416E,0xABDA37A467815C66,0xF61796A81A686676,0xF5DC0B706391954B,
@@ -663,394 +671,336 @@ const unsigned char C[12][64] = {
 		}
 };
 
-
-void AddModulo512(const void *a,const void *b,void *c)
+//! Every 64 byte block is handled as eight native 64 bit words, the numbers N and Sigma are
+//! stored big endian, so byte 63 is the least significant and the words are byte swapped to add.
+static inline uint64_t bswap64(uint64_t x)
 {
-	const unsigned char *A=(const uint8_t *)a, *B=(const uint8_t *)b;
-	unsigned char *C= (uint8_t *)c;
-	int t = 0;
-#ifdef FULL_UNROLL
-#define ADDBYTE_8(i) t = A[i] + B[i] + (t >> 8); C[i] = t & 0xFF;
-
-	ADDBYTE_8(63)
-	ADDBYTE_8(62)
-	ADDBYTE_8(61)
-	ADDBYTE_8(60)
-	ADDBYTE_8(59)
-	ADDBYTE_8(58)
-	ADDBYTE_8(57)
-	ADDBYTE_8(56)
-	ADDBYTE_8(55)
-	ADDBYTE_8(54)
-	ADDBYTE_8(53)
-	ADDBYTE_8(52)
-	ADDBYTE_8(51)
-	ADDBYTE_8(50)
-	ADDBYTE_8(49)
-	ADDBYTE_8(48)
-	ADDBYTE_8(47)
-	ADDBYTE_8(46)
-	ADDBYTE_8(45)
-	ADDBYTE_8(44)
-	ADDBYTE_8(43)
-	ADDBYTE_8(42)
-	ADDBYTE_8(41)
-	ADDBYTE_8(40)
-	ADDBYTE_8(39)
-	ADDBYTE_8(38)
-	ADDBYTE_8(37)
-	ADDBYTE_8(36)
-	ADDBYTE_8(35)
-	ADDBYTE_8(34)
-	ADDBYTE_8(33)
-	ADDBYTE_8(32)
-	ADDBYTE_8(31)
-	ADDBYTE_8(30)
-	ADDBYTE_8(29)
-	ADDBYTE_8(28)
-	ADDBYTE_8(27)
-	ADDBYTE_8(26)
-	ADDBYTE_8(25)
-	ADDBYTE_8(24)
-	ADDBYTE_8(23)
-	ADDBYTE_8(22)
-	ADDBYTE_8(21)
-	ADDBYTE_8(20)
-	ADDBYTE_8(19)
-	ADDBYTE_8(18)
-	ADDBYTE_8(17)
-	ADDBYTE_8(16)
-	ADDBYTE_8(15)
-	ADDBYTE_8(14)
-	ADDBYTE_8(13)
-	ADDBYTE_8(12)
-	ADDBYTE_8(11)
-	ADDBYTE_8(10)
-	ADDBYTE_8(9)
-	ADDBYTE_8(8)
-	ADDBYTE_8(7)
-	ADDBYTE_8(6)
-	ADDBYTE_8(5)
-	ADDBYTE_8(4)
-	ADDBYTE_8(3)
-	ADDBYTE_8(2)
-	ADDBYTE_8(1)
-	ADDBYTE_8(0)
-
+#if defined(__GNUC__)
+	return __builtin_bswap64(x);
 #else
-	int i = 0;
-
-	for(i=63;i>=0;i--)
-	{
-		t = A[i] + B[i] + (t >> 8);
-		C[i] = t & 0xFF;
-	}
+	x = ((x & 0x00FF00FF00FF00FFULL) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFULL);
+	x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+	return (x << 32) | (x >> 32);
 #endif
 }
 
-void AddXor512(const void *a,const void *b,void *c)
+static void AddModulo512(const uint64_t *a, const uint64_t *b, uint64_t *c)
 {
-	const unsigned long long *A= (const unsigned long long  *)a, *B=(const unsigned long long  *)b;
-	unsigned long long *C=(unsigned long long *)c;
-#ifdef FULL_UNROLL
-	C[0] = A[0] ^ B[0];
-	C[1] = A[1] ^ B[1];
-	C[2] = A[2] ^ B[2];
-	C[3] = A[3] ^ B[3];
-	C[4] = A[4] ^ B[4];
-	C[5] = A[5] ^ B[5];
-	C[6] = A[6] ^ B[6];
-	C[7] = A[7] ^ B[7];
-#else
-	int i = 0;
-
-	for(i=0;i<8;i++)
+	uint64_t carry = 0;
+	for (int i = 7; i >= 0; i--)
 	{
-		C[i] = A[i] ^ B[i];
+		const uint64_t A = bswap64(a[i]), B = bswap64(b[i]);
+		const uint64_t t = A + B;
+		const uint64_t r = t + carry;
+		carry = (t < A) | (r < t);
+		c[i] = bswap64(r);
 	}
-#endif
 }
 
-void F(unsigned char *state)
+static inline void AddXor512(const uint64_t *a, const uint64_t *b, uint64_t *c)
 {
-	unsigned long long return_state[8];
-	register unsigned long long r = 0;
-	r ^= T[0][state[56]];
-	r ^= T[1][state[48]];
-	r ^= T[2][state[40]];
-	r ^= T[3][state[32]];
-	r ^= T[4][state[24]];
-	r ^= T[5][state[16]];
-	r ^= T[6][state[8]];
-	r ^= T[7][state[0]];
-	return_state[0] = r;
-	r = 0;
-
-	r ^= T[0][state[57]];
-	r ^= T[1][state[49]];
-	r ^= T[2][state[41]];
-	r ^= T[3][state[33]];
-	r ^= T[4][state[25]];
-	r ^= T[5][state[17]];
-	r ^= T[6][state[9]];
-	r ^= T[7][state[1]];
-	return_state[1] = r;
-	r = 0;
-
-	r ^= T[0][state[58]];
-	r ^= T[1][state[50]];
-	r ^= T[2][state[42]];
-	r ^= T[3][state[34]];
-	r ^= T[4][state[26]];
-	r ^= T[5][state[18]];
-	r ^= T[6][state[10]];
-	r ^= T[7][state[2]];
-	return_state[2] = r;
-	r = 0;
-
-	r ^= T[0][state[59]];
-	r ^= T[1][state[51]];
-	r ^= T[2][state[43]];
-	r ^= T[3][state[35]];
-	r ^= T[4][state[27]];
-	r ^= T[5][state[19]];
-	r ^= T[6][state[11]];
-	r ^= T[7][state[3]];
-	return_state[3] = r;
-	r = 0;
-
-	r ^= T[0][state[60]];
-	r ^= T[1][state[52]];
-	r ^= T[2][state[44]];
-	r ^= T[3][state[36]];
-	r ^= T[4][state[28]];
-	r ^= T[5][state[20]];
-	r ^= T[6][state[12]];
-	r ^= T[7][state[4]];
-	return_state[4] = r;
-	r = 0;
-
-	r ^= T[0][state[61]];
-	r ^= T[1][state[53]];
-	r ^= T[2][state[45]];
-	r ^= T[3][state[37]];
-	r ^= T[4][state[29]];
-	r ^= T[5][state[21]];
-	r ^= T[6][state[13]];
-	r ^= T[7][state[5]];
-	return_state[5] = r;
-	r = 0;
-
-	r ^= T[0][state[62]];
-	r ^= T[1][state[54]];
-	r ^= T[2][state[46]];
-	r ^= T[3][state[38]];
-	r ^= T[4][state[30]];
-	r ^= T[5][state[22]];
-	r ^= T[6][state[14]];
-	r ^= T[7][state[6]];
-	return_state[6] = r;
-	r = 0;
-
-	r ^= T[0][state[63]];
-	r ^= T[1][state[55]];
-	r ^= T[2][state[47]];
-	r ^= T[3][state[39]];
-	r ^= T[4][state[31]];
-	r ^= T[5][state[23]];
-	r ^= T[6][state[15]];
-	r ^= T[7][state[7]];
-	return_state[7] = r;
-
-	memcpy(state,(unsigned char*)return_state,64);
+	c[0] = a[0] ^ b[0];
+	c[1] = a[1] ^ b[1];
+	c[2] = a[2] ^ b[2];
+	c[3] = a[3] ^ b[3];
+	c[4] = a[4] ^ b[4];
+	c[5] = a[5] ^ b[5];
+	c[6] = a[6] ^ b[6];
+	c[7] = a[7] ^ b[7];
 }
 
-#define KeySchedule(K,i) AddXor512(K,C[i],K); F(K);
+//! The LPS transform, byte i of every word selects one table entry for output word i
+#define LPS_WORD(s, i) \
+	(T[0][s[56 + i]] ^ T[1][s[48 + i]] ^ T[2][s[40 + i]] ^ T[3][s[32 + i]] ^ \
+	 T[4][s[24 + i]] ^ T[5][s[16 + i]] ^ T[6][s[ 8 + i]] ^ T[7][s[ 0 + i]])
 
-void E(unsigned char *K,const unsigned char *m, unsigned char *state)
+static inline void F(uint64_t *state)
 {
-#ifdef FULL_UNROLL
-	AddXor512(m,K,state);
-
-    F(state);
-    KeySchedule(K,0);
-    AddXor512(state,K,state);
-
-    F(state);
-    KeySchedule(K,1);
-    AddXor512(state,K,state);
-
-    F(state);
-    KeySchedule(K,2);
-    AddXor512(state,K,state);
-
-    F(state);
-    KeySchedule(K,3);
-    AddXor512(state,K,state);
-
-    F(state);
-    KeySchedule(K,4);
-    AddXor512(state,K,state);
-
-    F(state);
-    KeySchedule(K,5);
-    AddXor512(state,K,state);
+	const unsigned char *s = (const unsigned char *)state;
+	uint64_t r[8];
+	r[0] = LPS_WORD(s, 0);
+	r[1] = LPS_WORD(s, 1);
+	r[2] = LPS_WORD(s, 2);
+	r[3] = LPS_WORD(s, 3);
+	r[4] = LPS_WORD(s, 4);
+	r[5] = LPS_WORD(s, 5);
+	r[6] = LPS_WORD(s, 6);
+	r[7] = LPS_WORD(s, 7);
+	memcpy(state, r, 64);
+}
 
-    F(state);
-    KeySchedule(K,6);
-    AddXor512(state,K,state);
+static void Compress_generic(uint64_t *h, const uint64_t *N, const uint64_t *m, const uint64_t *pKeys)
+{
+	uint64_t K[8], state[8];
+	int i;
 
-    F(state);
-    KeySchedule(K,7);
-    AddXor512(state,K,state);
+	if (pKeys)
+	{
+		AddXor512(m, pKeys, state);
+		for (i = 0; i < 12; i++)
+		{
+			F(state);
+			AddXor512(state, &pKeys[(i + 1) * 8], state);
+		}
+	}
+	else
+	{
+		AddXor512(N, h, K);
+		F(K);
+		AddXor512(m, K, state);
+		for (i = 0; i < 12; i++)
+		{
+			F(state);
+			AddXor512(K, (const uint64_t *)C[i], K);
+			F(K);
+			AddXor512(state, K, state);
+		}
+	}
 
-    F(state);
-    KeySchedule(K,8);
-    AddXor512(state,K,state);
+	AddXor512(state, h, state);
+	AddXor512(state, m, h);
+}
 
-    F(state);
-    KeySchedule(K,9);
-    AddXor512(state,K,state);
+//! By default the portable implementation, GOSTR3411_2012_AutoDetect() can switch to a faster one.
+static CompressFn Compress = &Compress_generic;
 
-    F(state);
-    KeySchedule(K,10);
-    AddXor512(state,K,state);
+//! The two fixed IVs, for the 512 and 256 bit output hashes
+static const uint64_t IV512[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+static const uint64_t IV256[8] = {
+	0x0101010101010101ULL, 0x0101010101010101ULL, 0x0101010101010101ULL, 0x0101010101010101ULL,
+	0x0101010101010101ULL, 0x0101010101010101ULL, 0x0101010101010101ULL, 0x0101010101010101ULL
+};
 
-    F(state);
-    KeySchedule(K,11);
-    AddXor512(state,K,state);
-#else
-	int i = 0;
+//! The first block of every message is compressed with h = IV and N = 0, so its 13 round keys
+//! only depend on which IV is used.  They are expanded once, here, instead of for every hash.
+struct IVKeySchedule
+{
+	uint64_t k512[13 * 8];
+	uint64_t k256[13 * 8];
 
-	AddXor512(m,K,state);
+	static void Expand(const uint64_t *IV, uint64_t *pKeys)
+	{
+		memcpy(pKeys, IV, 64);
+		F(pKeys);
+		for (int i = 0; i < 12; i++)
+		{
+			AddXor512(&pKeys[i * 8], (const uint64_t *)C[i], &pKeys[(i + 1) * 8]);
+			F(&pKeys[(i + 1) * 8]);
+		}
+	}
 
-	for(i=0;i<12;i++)
+	IVKeySchedule()
 	{
-		F(state);
-		KeySchedule(K,i);
-		AddXor512(state,K,state);
+		Expand(IV512, k512);
+		Expand(IV256, k256);
 	}
-#endif
-}
+};
 
-static void g_N(const unsigned char *N,unsigned char *h,const unsigned char *m)
+//! Built on first use, the chain parameters hash their genesis blocks during static initialization
+static const IVKeySchedule& GetIVKeys()
 {
-	unsigned char t[64], K[64];
-
-	AddXor512(N,h,K);
-
-	F(K);
-
-	E(K,m,t);
-
-	AddXor512(t,h,t);
-	AddXor512(t,m,h);
+	static const IVKeySchedule ivKeys;
+	return ivKeys;
 }
 
-static void hash_X(unsigned char *IV,const unsigned char *message,unsigned long long length,unsigned char *out)
+//! Stage 2 works from the end of the message towards the start, the first len % 64 bytes of it
+//! end up in the padded stage 3 block.
+static void hash_X(const uint64_t *IV, const uint64_t *pIVKeys, const unsigned char *message, size_t len, unsigned char *out)
 {
-	unsigned char v512[64] = {
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x02,0x00
-	};
-	unsigned char v0[64] = {
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
-	};
-	unsigned char Sigma[64] = {
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
-	};
-	unsigned char N[64] = {
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-			0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
-	};
-	unsigned char m[64], *hash = IV;
-	unsigned long long len = length;
+	static const uint64_t v0[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	uint64_t v512[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	uint64_t Sigma[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	uint64_t N[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	uint64_t hash[8], m[8];
+	const uint64_t *pKeys = pIVKeys;
+
+	memcpy(hash, IV, 64);
+	((unsigned char *)v512)[62] = 0x02;
 
 	// Stage 2
-	while (len >= 512)
+	while (len >= 64)
 	{
-		memcpy(m, message + len/8 - 63 - ( (len & 0x7) == 0 ), 64);
+		memcpy(m, message + len - 64, 64);
 
-		g_N(N,hash,m);
-		AddModulo512(N,v512,N);
-		AddModulo512(Sigma,m,Sigma);
-		len -= 512;
+		Compress(hash, N, m, pKeys);
+		pKeys = NULL;
+		AddModulo512(N, v512, N);
+		AddModulo512(Sigma, m, Sigma);
+		len -= 64;
 	}
 
-	memset(m,0,64);
-	memcpy(m + 63 - len/8 + ( (len & 0x7) == 0 ), message, len/8 + 1 - ( (len & 0x7) == 0 ));
+	memset(m, 0, 64);
+	memcpy((unsigned char *)m + 64 - len, message, len);
 
 	// Stage 3
-	m[ 63 - len/8 ] |= (1 << (len & 0x7));
+	((unsigned char *)m)[63 - len] |= 1;
 
-	g_N(N,hash,m);
-	v512[63] = len & 0xFF;
-	v512[62] = len >> 8;
-	AddModulo512(N,v512,N);
+	Compress(hash, N, m, pKeys);
+	memset(v512, 0, 64);
+	((unsigned char *)v512)[63] = (len * 8) & 0xFF;
+	((unsigned char *)v512)[62] = (len * 8) >> 8;
+	AddModulo512(N, v512, N);
 
-	AddModulo512(Sigma,m,Sigma);
+	AddModulo512(Sigma, m, Sigma);
 
-	g_N(v0,hash,N);
-	g_N(v0,hash,Sigma);
+	Compress(hash, v0, N, NULL);
+	Compress(hash, v0, Sigma, NULL);
 
 	memcpy(out, hash, 64);
 }
 
-static void hash_512(const unsigned char *message,unsigned long long length,unsigned char *out)
+//! HashGOST() of an 80 byte header, m1 is its last 64 bytes with the nonce filled in and m2 the padded
+//! first 16 bytes, see CGOST3411HeaderHasher.  The same steps as hash_X with every length known up front.
+static void hash_header(const uint64_t *m1, const uint64_t *m2, unsigned char *out)
 {
-	unsigned char IV[64] =
-			{
-					0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-					0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-					0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-					0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
-			};
+	static const uint64_t v0[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	// N after one block and after a block plus the 16 byte remainder, and the stage 3 block of a
+	// message which is exactly one block long
+	uint64_t N512[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	uint64_t N640[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	uint64_t Pad0[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	const IVKeySchedule& ivKeys = GetIVKeys();
+	uint64_t hash[8], Sigma[8], hash1[8];
+
+	((unsigned char *)N512)[62] = 0x02;
+	((unsigned char *)N640)[62] = 0x02;
+	((unsigned char *)N640)[63] = 0x80;
+	((unsigned char *)Pad0)[63] = 0x01;
+
+	// GOST R 34.11-2012 512 bit of the header
+	memcpy(hash, IV512, 64);
+	Compress(hash, v0, m1, ivKeys.k512);
+	Compress(hash, N512, m2, NULL);
+	AddModulo512(m1, m2, Sigma);
+	Compress(hash, v0, N640, NULL);
+	Compress(hash, v0, Sigma, NULL);
+
+	// GOST R 34.11-2012 256 bit of that
+	memcpy(hash1, hash, 64);
+	memcpy(hash, IV256, 64);
+	Compress(hash, v0, hash1, ivKeys.k256);
+	Compress(hash, N512, Pad0, NULL);
+	AddModulo512(hash1, Pad0, Sigma);
+	Compress(hash, v0, N512, NULL);
+	Compress(hash, v0, Sigma, NULL);
+
+	memcpy(out, hash, 32);
+}
 
-	hash_X(IV,message,length,out);
+static void hash_512(const unsigned char *message, size_t len, unsigned char *out)
+{
+	hash_X(IV512, GetIVKeys().k512, message, len, out);
 }
 
-static void hash_256(const unsigned char *message,unsigned long long length,unsigned char *out)
+static void hash_256(const unsigned char *message, size_t len, unsigned char *out)
 {
-	unsigned char IV[64] =
-			{
-					0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,
-					0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,
-					0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,
-					0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01
-			};
 	unsigned char hash[64];
 
-	hash_X(IV,message,length,hash);
+	hash_X(IV256, GetIVKeys().k256, message, len, hash);
 
-	memcpy(out,hash,32);
+	memcpy(out, hash, 32);
 }
 
-#ifdef __cplusplus
 }
-#endif
 
-namespace i2p
-{
-namespace crypto
-{
 	void GOSTR3411_2012_256 (const uint8_t * buf, size_t len, uint8_t * digest)
 	{
-		hash_256 (buf, len*8, digest);
+		streebog::hash_256 (buf, len, digest);
 	}
 
 	void GOSTR3411_2012_512 (const uint8_t * buf, size_t len, uint8_t * digest)
 	{
-		hash_512 (buf, len*8, digest);
+		streebog::hash_512 (buf, len, digest);
+	}
+
+	std::string GOSTR3411_2012_AutoDetect (bool fAllowSIMD)
+	{
+		streebog::Compress = &streebog::Compress_generic;
+#if defined(ENABLE_SSE41)
+		unsigned int cpuid_ecx = 0;
+#if defined(_MSC_VER)
+		int x86cpuid[4];
+		__cpuid(x86cpuid, 1);
+		cpuid_ecx = (unsigned int)x86cpuid[2];
+#else
+		unsigned int eax, ebx, edx;
+		__get_cpuid(1, &eax, &ebx, &cpuid_ecx, &edx);
+#endif
+		if (fAllowSIMD && (cpuid_ecx & 1<<19))
+		{
+			streebog::Compress = &streebog::Compress_sse41;
+			return "sse4.1";
+		}
+#endif
+		return "generic";
 	}
 }
 }
+
+CGOST3411::CGOST3411(bool f256In) : f256(f256In), bytes(0)
+{
+}
+
+CGOST3411& CGOST3411::Write(const unsigned char* data, size_t len)
+{
+    if (bytes + len <= sizeof(inl)) {
+        memcpy(inl + bytes, data, len);
+    } else {
+        //! Spilled over the inline buffer, from here on everything lives in vBuf
+        if (vBuf.empty())
+            vBuf.assign(inl, inl + bytes);
+        vBuf.insert(vBuf.end(), data, data + len);
+    }
+    bytes += len;
+    return *this;
+}
+
+void CGOST3411::Finalize(unsigned char* hash)
+{
+    const unsigned char* message = bytes <= sizeof(inl) ? inl : &vBuf[0];
+    if (f256)
+        i2p::crypto::streebog::hash_256(message, bytes, hash);
+    else
+        i2p::crypto::streebog::hash_512(message, bytes, hash);
+}
+
+CGOST3411& CGOST3411::Reset()
+{
+    bytes = 0;
+    vBuf.clear();
+    return *this;
+}
+
+CGOST3411HeaderHasher::CGOST3411HeaderHasher()
+{
+    memset(m1, 0, sizeof(m1));
+    memset(m2, 0, sizeof(m2));
+}
+
+void CGOST3411HeaderHasher::SetHeader(const unsigned char* pHeader)
+{
+    //! Stage 2 takes the last 64 bytes, stage 3 the first 16 with the padding bit in front of them
+    memcpy(m1, pHeader + HEADER_SIZE - 64, 64);
+    memset(m2, 0, sizeof(m2));
+    memcpy((unsigned char*)m2 + 64 - (HEADER_SIZE - 64), pHeader, HEADER_SIZE - 64);
+    ((unsigned char*)m2)[63 - (HEADER_SIZE - 64)] |= 1;
+}
+
+void CGOST3411HeaderHasher::Hash(uint32_t nNonce, unsigned char* hash) const
+{
+    uint64_t m[8];
+    memcpy(m, m1, sizeof(m));
+    memcpy((unsigned char*)m + 60, &nNonce, 4);
+    i2p::crypto::streebog::hash_header(m, m2, hash);
+}
+
+void CGOST3411HeaderHasher::HashNonces(uint32_t nFirstNonce, uint32_t nCount, unsigned char* pHashes) const
+{
+    uint64_t m[8];
+    memcpy(m, m1, sizeof(m));
+    for (uint32_t i = 0; i < nCount; i++) {
+        const uint32_t nNonce = nFirstNonce + i;
+        memcpy((unsigned char*)m + 60, &nNonce, 4);
+        i2p::crypto::streebog::hash_header(m, m2, pHashes + i * OUTPUT_SIZE);
+    }
+}
@@ -8,9 +8,14 @@
 #ifndef GOST3411_H__
 #define GOST3411_H__
 
+#if defined(HAVE_CONFIG_H)
+#include "config/anoncoin-config.h"
+#endif
+
 #include <memory>
 #include <inttypes.h>
 #include <openssl/ec.h>
+#include <string>
 #include <vector>
 
 namespace i2p
@@ -22,8 +27,80 @@ namespace crypto
 	void GOSTR3411_2012_256 (const uint8_t * buf, size_t len, uint8_t * digest);
 	void GOSTR3411_2012_512 (const uint8_t * buf, size_t len, uint8_t * digest);
 
+	/** Select the fastest compression function the cpu supports, returns a description of it for the log.
+	 *  With fAllowSIMD false the portable table sliced implementation is used. */
+	std::string GOSTR3411_2012_AutoDetect (bool fAllowSIMD = true);
+
+namespace streebog
+{
+	//! Combined S-box, byte permutation and linear transform tables, and the key schedule constants
+	extern const uint64_t T[8][256];
+	extern const unsigned char C[12][64];
+
+	//! The g_N compression, h = E(LPS(h ^ N), m) ^ h ^ m.  pKeys, when not NULL, holds the 13 round keys
+	//! already expanded from h ^ N, as is the case for the first block hashed with one of the fixed IVs.
+	typedef void (*CompressFn)(uint64_t * h, const uint64_t * N, const uint64_t * m, const uint64_t * pKeys);
+#if defined(ENABLE_SSE41)
+	void Compress_sse41 (uint64_t * h, const uint64_t * N, const uint64_t * m, const uint64_t * pKeys);
+#endif
+}
 
 }
 }
 
+/**
+ * A hasher class for GOST R 34.11-2012 (Streebog), with 512 bit output or 256 bit output.
+ *
+ * In the big endian byte order used here Streebog chains its blocks from the end of the message
+ * back towards the start, so nothing can be compressed until the whole message is known.  Written
+ * data is collected, in an inline buffer large enough for a block header, and hashed by Finalize().
+ */
+class CGOST3411
+{
+private:
+    bool f256;
+    unsigned char inl[128];
+    std::vector<unsigned char> vBuf;
+    size_t bytes;
+
+public:
+    static const size_t OUTPUT_SIZE_512 = 64;
+    static const size_t OUTPUT_SIZE_256 = 32;
+
+    explicit CGOST3411(bool f256In = false);
+    CGOST3411& Write(const unsigned char* data, size_t len);
+    //! Writes OutputSize() bytes
+    void Finalize(unsigned char* hash);
+    CGOST3411& Reset();
+    size_t OutputSize() const { return f256 ? OUTPUT_SIZE_256 : OUTPUT_SIZE_512; }
+};
+
+/**
+ * The double GOST R 34.11-2012 hash of HashGOST(), 512 bits then 256 bits, for an 80 byte block header
+ * whose last 4 bytes are the nonce being scanned.
+ *
+ * Streebog compresses the header tail first, so the nonce is part of the very first block and every
+ * chaining value depends on it.  What SetHeader() does once per header is everything else: the first
+ * block without its nonce, the padded block holding the leading 16 header bytes, and the length and
+ * padding blocks of both passes, which are constant.  Each nonce then costs the eight compressions.
+ */
+class CGOST3411HeaderHasher
+{
+private:
+    uint64_t m1[8];
+    uint64_t m2[8];
+
+public:
+    static const size_t HEADER_SIZE = 80;
+    static const size_t OUTPUT_SIZE = 32;
+
+    CGOST3411HeaderHasher();
+    //! Reads HEADER_SIZE bytes, the nonce is ignored
+    void SetHeader(const unsigned char* pHeader);
+    //! Writes OUTPUT_SIZE bytes, in the byte order of GOSTR3411_2012_256()
+    void Hash(uint32_t nNonce, unsigned char* hash) const;
+    //! Hashes nCount consecutive nonces starting with nFirstNonce, writes nCount * OUTPUT_SIZE bytes
+    void HashNonces(uint32_t nFirstNonce, uint32_t nCount, unsigned char* pHashes) const;
+};
+
 #endif
@@ -125,6 +125,8 @@ Object CallRPC(const string& strMethod, const Array& params)
     string strUserPass64 = EncodeBase64(mapArgs["-rpcuser"] + ":" + mapArgs["-rpcpassword"]);
     map<string, string> mapRequestHeaders;
     mapRequestHeaders["Authorization"] = string("Basic ") + strUserPass64;
+    // Large replies may come in chunks, ReadHTTPMessage() puts them back together
+    mapRequestHeaders["TE"] = "chunked";
 
     // Send request
     string strRequest = JSONRPCRequest(strMethod, params, 1);
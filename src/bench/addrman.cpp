@@ -0,0 +1,28 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "addrman.h"
+#include "tinyformat.h"
+
+//! Addresses known, every fourth of them also tried
+static const unsigned int KNOWN_ADDRESSES = 10000;
+
+static void AddrManSelect(benchmark::State& state)
+{
+    CAddrMan addrman;
+    for (unsigned int i = 0; i < KNOWN_ADDRESSES; i++) {
+        // Spread over many /16 groups and many sources, as addresses relayed by peers would be
+        CAddress addr(CService(strprintf("5.%u.%u.%u", (i >> 8) & 0xff, i & 0xff, 1 + (i >> 16)), 9377));
+        CNetAddr source(strprintf("6.%u.%u.1", i % 64, (i / 64) % 256));
+        addrman.Add(addr, source);
+        if (i % 4 == 0)
+            addrman.Good(addr);
+    }
+    while (state.KeepRunning())
+        addrman.Select();
+}
+
+BENCHMARK(AddrManSelect);
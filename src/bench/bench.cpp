@@ -0,0 +1,118 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "univalue/univalue.h"
+
+#include <iostream>
+#include <sys/time.h>
+
+#include <boost/regex.hpp>
+
+using namespace benchmark;
+
+std::map<std::string, BenchFunction>& BenchRunner::benchmarks()
+{
+    static std::map<std::string, BenchFunction> benchmarks_;
+    return benchmarks_;
+}
+
+static double gettimedouble(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+BenchRunner::BenchRunner(std::string name, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void
+BenchRunner::RunAll(const std::string& strFilter, const std::string& strPrinter, double elapsedTimeForOne)
+{
+    const boost::regex reFilter(strFilter);
+    std::vector<Result> vResults;
+
+    for (std::map<std::string,BenchFunction>::iterator it = benchmarks().begin();
+         it != benchmarks().end(); ++it) {
+
+        if (!boost::regex_match(it->first, reFilter))
+            continue;
+        State state(it->first, elapsedTimeForOne);
+        BenchFunction& func = it->second;
+        func(state);
+        vResults.push_back(state.GetResult());
+    }
+
+    if (strPrinter == "json")
+        PrintJson(vResults);
+    else
+        PrintCsv(vResults);
+}
+
+void benchmark::PrintCsv(const std::vector<Result>& vResults)
+{
+    std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+    for (std::vector<Result>::const_iterator it = vResults.begin(); it != vResults.end(); ++it)
+        std::cout << it->name << "," << it->count << "," << it->minTime << "," << it->maxTime << "," << it->average << "\n";
+}
+
+void benchmark::PrintJson(const std::vector<Result>& vResults)
+{
+    UniValue results(UniValue::VARR);
+    for (std::vector<Result>::const_iterator it = vResults.begin(); it != vResults.end(); ++it) {
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("name", it->name);
+        result.pushKV("count", it->count);
+        result.pushKV("min", it->minTime);
+        result.pushKV("max", it->maxTime);
+        result.pushKV("average", it->average);
+        results.push_back(result);
+    }
+    std::cout << results.write(2) << "\n";
+}
+
+bool State::KeepRunning()
+{
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    }
+    else {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count+1)%timeCheckCount != 0) {
+            ++count;
+            return true; // keep going
+        }
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime)/timeCheckCount;
+        if (elapsedOne < minTime) minTime = elapsedOne;
+        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        if (elapsedOne*timeCheckCount < maxElapsed/16) timeCheckCount *= 2;
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+
+    return false;
+}
+
+Result State::GetResult() const
+{
+    Result result;
+    result.name = name;
+    result.count = count;
+    // A benchmark that never called KeepRunning() has nothing to report
+    result.minTime = count > 0 ? minTime : 0.0;
+    result.maxTime = count > 0 ? maxTime : 0.0;
+    result.average = count > 0 ? (lastTime - beginTime) / count : 0.0;
+    return result;
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ANONCOIN_BENCH_BENCH_H
+#define ANONCOIN_BENCH_BENCH_H
+
+#include <limits>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ * Results go to stdout, one line per benchmark as comma separated values, or as a single
+ * JSON array with -printer=json.  Times are in seconds per iteration.
+ */
+
+namespace benchmark {
+
+    //! What one benchmark measured, all times in seconds per iteration
+    struct Result {
+        std::string name;
+        int64_t count;
+        double minTime, maxTime, average;
+    };
+
+    class State {
+        std::string name;
+        double maxElapsed;
+        double beginTime;
+        double lastTime, minTime, maxTime;
+        int64_t count;
+        int64_t timeCheckCount;
+    public:
+        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0), timeCheckCount(1) {
+            minTime = std::numeric_limits<double>::max();
+            maxTime = 0.0;
+        }
+        bool KeepRunning();
+        Result GetResult() const;
+    };
+
+    typedef boost::function<void(State&)> BenchFunction;
+
+    class BenchRunner
+    {
+        //! A function local static, so benchmarks in files linked before this one can register themselves
+        static std::map<std::string, BenchFunction>& benchmarks();
+
+    public:
+        BenchRunner(std::string name, BenchFunction func);
+
+        //! Runs every benchmark whose name matches strFilter, a regular expression, and prints the results as strPrinter says
+        static void RunAll(const std::string& strFilter=".*", const std::string& strPrinter="csv", double elapsedTimeForOne=1.0);
+    };
+
+    //! Writes results as comma separated values, the header line starts with a '#'
+    void PrintCsv(const std::vector<Result>& vResults);
+    //! Writes results as a JSON array of objects, for tools that compare runs
+    void PrintJson(const std::vector<Result>& vResults);
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // ANONCOIN_BENCH_BENCH_H
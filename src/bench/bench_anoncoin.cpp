@@ -0,0 +1,56 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "Gost3411.h"
+#include "init.h"
+#include "scrypt.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <iostream>
+
+CClientUIInterface uiInterface; // Declared but not defined in ui_interface.h
+CWallet* pwalletMain;
+
+//! The benchmarks link against main.cpp, which needs these from init.cpp, see the warning in init.h
+void StartShutdown()
+{
+    exit(0);
+}
+
+bool ShutdownRequested()
+{
+    return false;
+}
+
+int
+main(int argc, char** argv)
+{
+    SetupEnvironment();
+    ParseParameters(argc, argv);
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+#if defined(USE_SSE2)
+    scrypt_detect_sse2();
+#endif
+    i2p::crypto::GOSTR3411_2012_AutoDetect();
+    SHA256AutoDetect();
+
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_anoncoin [options]\n\n"
+                  << "  -filter=<regex>    Only run the benchmarks whose names match (default: .*)\n"
+                  << "  -printer=<format>  Print the results as csv or json (default: csv)\n"
+                  << "  -elapsed=<n>       Milliseconds to spend running each benchmark (default: 1000)\n";
+        return 0;
+    }
+
+    // The retarget benchmark needs the proof-of-work limits of a network
+    SelectParams(CBaseChainParams::MAIN);
+
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ".*"), GetArg("-printer", "csv"), GetArg("-elapsed", 1000) / 1000.0);
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "block.h"
+#include "streams.h"
+#include "version.h"
+
+//! Transactions in the block, about 370KB of them
+static const unsigned int BLOCK_TXS = 1000;
+
+//! A block of pay to pubkey hash spends, each spending outputs of its own
+static CBlock MakeBlock()
+{
+    CBlock block;
+    block.nVersion = 3;
+    block.nTime = 1400000000;
+    block.nHeight = 1;
+    for (unsigned int n = 0; n < BLOCK_TXS; n++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            tx.vin[i].prevout = COutPoint(uint256(n * 2 + i + 1), i);
+            tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        }
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].nValue = (i + 1) * COIN;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(CTransaction(tx));
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void BuildMerkleTree(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        bool fMutated;
+        block.BuildMerkleTree(&fMutated);
+    }
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeBlock();
+    // Read the same bytes over and over, as the stream is emptied by each read
+    const std::vector<char> vData(stream.begin(), stream.end());
+    while (state.KeepRunning()) {
+        CDataStream ssBlock(vData, SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ssBlock >> block;
+    }
+}
+
+BENCHMARK(BuildMerkleTree);
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
@@ -0,0 +1,84 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+//! Checks per block, each iteration verifies one such block
+static const unsigned int BLOCK_CHECKS = 1000;
+//! Checks handed to the queue at once, as ConnectBlock() does with SCRIPT_CHECK_SUBMIT_BATCH
+static const unsigned int SUBMIT_BATCH = 256;
+
+//! Stands in for a CScriptCheck, roughly as long as a signature verification in hashing
+struct CFakeScriptCheck
+{
+    unsigned char nSeed;
+
+    CFakeScriptCheck() : nSeed(0) {}
+
+    bool operator()()
+    {
+        unsigned char hash[CSHA256::OUTPUT_SIZE] = {nSeed};
+        for (int i = 0; i < 100; i++)
+            CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+        return hash[0] != 0 || hash[1] != 0 || hash[2] != 0 || hash[3] != 0;
+    }
+
+    void swap(CFakeScriptCheck& check)
+    {
+        std::swap(nSeed, check.nSeed);
+    }
+};
+
+static void QueueThread(CCheckQueue<CFakeScriptCheck>* pqueue)
+{
+    pqueue->Thread();
+}
+
+//! One block's worth of checks per iteration, on nThreads threads counting the master
+static void CheckQueueBlock(benchmark::State& state, int nThreads)
+{
+    CCheckQueue<CFakeScriptCheck> queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads - 1; i++)
+        threadGroup.create_thread(boost::bind(&QueueThread, &queue));
+
+    unsigned char nSeed = 0;
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CFakeScriptCheck> control(&queue);
+        std::vector<CFakeScriptCheck> vChecks;
+        for (unsigned int i = 0; i < BLOCK_CHECKS; i++) {
+            vChecks.push_back(CFakeScriptCheck());
+            vChecks.back().nSeed = nSeed++;
+            if (vChecks.size() >= SUBMIT_BATCH) {
+                control.Add(vChecks);
+                vChecks.clear();
+            }
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+static void CheckQueueBlock1(benchmark::State& state) { CheckQueueBlock(state, 1); }
+static void CheckQueueBlock2(benchmark::State& state) { CheckQueueBlock(state, 2); }
+static void CheckQueueBlock4(benchmark::State& state) { CheckQueueBlock(state, 4); }
+static void CheckQueueBlock8(benchmark::State& state) { CheckQueueBlock(state, 8); }
+static void CheckQueueBlock16(benchmark::State& state) { CheckQueueBlock(state, 16); }
+
+BENCHMARK(CheckQueueBlock1);
+BENCHMARK(CheckQueueBlock2);
+BENCHMARK(CheckQueueBlock4);
+BENCHMARK(CheckQueueBlock8);
+BENCHMARK(CheckQueueBlock16);
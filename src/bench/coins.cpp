@@ -0,0 +1,70 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "hash.h"
+
+#include <vector>
+
+//! Transactions with unspent outputs in the tip cache
+static const unsigned int CACHED_TXS = 100000;
+//! Inputs in a block, each iteration looks up or spends this many
+static const unsigned int BLOCK_INPUTS = 2000;
+
+//! The tip cache, filled with coins over an empty base view, as pcoinsTip is after a while of running
+struct CCoinsTip
+{
+    CCoinsView base;
+    CCoinsViewCache cache;
+    std::vector<uint256> vTxids;
+
+    CCoinsTip() : cache(&base)
+    {
+        for (unsigned int i = 0; i < CACHED_TXS; i++) {
+            vTxids.push_back(Hash(BEGIN(i), END(i)));
+            CCoinsModifier coins = cache.ModifyCoins(vTxids.back());
+            coins->nVersion = 1;
+            coins->nHeight = i / 100;
+            coins->vout.resize(2);
+            for (unsigned int n = 0; n < coins->vout.size(); n++) {
+                coins->vout[n].nValue = COIN;
+                coins->vout[n].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+        }
+    }
+};
+
+//! A block's worth of input lookups through a fresh cache on top of the tip, as ConnectBlock() does
+static void CoinsCacheLookup(benchmark::State& state)
+{
+    CCoinsTip tip;
+    unsigned int nNext = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&tip.cache);
+        for (unsigned int i = 0; i < BLOCK_INPUTS; i++) {
+            view.AccessCoins(tip.vTxids[nNext]);
+            nNext = (nNext + 7919) % CACHED_TXS;
+        }
+    }
+}
+
+//! A block's worth of changed coins written back into the tip cache
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    CCoinsTip tip;
+    unsigned int nNext = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&tip.cache);
+        for (unsigned int i = 0; i < BLOCK_INPUTS; i++) {
+            view.ModifyCoins(tip.vTxids[nNext])->vout[0].nValue++;
+            nNext = (nNext + 7919) % CACHED_TXS;
+        }
+        view.Flush();
+    }
+}
+
+BENCHMARK(CoinsCacheLookup);
+BENCHMARK(CoinsCacheFlush);
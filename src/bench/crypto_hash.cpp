@@ -0,0 +1,87 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "scrypt.h"
+
+#include <vector>
+
+//! A serialized block header, the input every proof-of-work hash is run on
+static const unsigned int HEADER_SIZE = 80;
+//! Headers hashed per call of the batched scrypt API, one AVX2 engine's worth
+static const unsigned int SCRYPT_BATCH = 8;
+
+static void ScryptHeader(benchmark::State& state)
+{
+    std::vector<char> vHeader(HEADER_SIZE, 0);
+    char hash[32];
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256(&vHeader[0], hash);
+        vHeader[76]++;
+    }
+}
+
+//! A level of a merkle tree with 2048 transactions, the pairs of hashes batched as BuildMerkleTree() does
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<unsigned char> in(64 * 1024, 0);
+    while (state.KeepRunning())
+        SHA256D64(&in[0], &in[0], 1024);
+}
+
+static void ScryptHeaderBatch(benchmark::State& state)
+{
+    std::vector<char> vHeaders(HEADER_SIZE * SCRYPT_BATCH, 0);
+    std::vector<char> vHashes(32 * SCRYPT_BATCH);
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256_multi(&vHeaders[0], &vHashes[0], SCRYPT_BATCH);
+        vHeaders[76]++;
+    }
+}
+
+static void GostHeader(benchmark::State& state)
+{
+    std::vector<unsigned char> vHeader(HEADER_SIZE, 0);
+    while (state.KeepRunning()) {
+        HashGOST(vHeader.begin(), vHeader.end());
+        vHeader[76]++;
+    }
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<unsigned char> in(32, 0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            CSHA256().Write(&in[0], in.size()).Finalize(&in[0]);
+    }
+}
+
+static void SHA256_1M(benchmark::State& state)
+{
+    std::vector<unsigned char> in(1000 * 1000, 0);
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    while (state.KeepRunning())
+        CSHA256().Write(&in[0], in.size()).Finalize(hash);
+}
+
+static void SHA256D_Header(benchmark::State& state)
+{
+    std::vector<unsigned char> vHeader(HEADER_SIZE, 0);
+    while (state.KeepRunning()) {
+        Hash(vHeader.begin(), vHeader.end());
+        vHeader[76]++;
+    }
+}
+
+BENCHMARK(ScryptHeader);
+BENCHMARK(ScryptHeaderBatch);
+BENCHMARK(GostHeader);
+BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256_1M);
+BENCHMARK(SHA256D_Header);
+BENCHMARK(SHA256D64_1024);
@@ -0,0 +1,97 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "script.h"
+#include "transaction.h"
+
+#include <sstream>
+
+//! The writer CHashWriter used to be, which copied everything written into a stringstream for
+//! the GOST hash as well.  Kept here so the cost it added to every SerializeHash() stays visible.
+class CLegacyHashWriter
+{
+private:
+    CHash256 ctx;
+    std::stringstream gostCtx;
+
+public:
+    int nType;
+    int nVersion;
+
+    CLegacyHashWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {
+        gostCtx.str("");
+    }
+
+    CLegacyHashWriter& write(const char *pch, size_t size) {
+        ctx.Write((const unsigned char*)pch, size);
+        gostCtx.write(pch, size);
+        return (*this);
+    }
+
+    uint256 GetHash() {
+        uint256 result;
+        ctx.Finalize((unsigned char*)&result);
+        return result;
+    }
+
+    template<typename T>
+    CLegacyHashWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+//! A typical pay to pubkey hash spend, two inputs and two outputs
+static CTransaction MakeTransaction()
+{
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vout.resize(2);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout = COutPoint(uint256(i + 1), i);
+        tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+    }
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        tx.vout[i].nValue = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return CTransaction(tx);
+}
+
+static void HashWriterTx(benchmark::State& state)
+{
+    const CTransaction tx = MakeTransaction();
+    while (state.KeepRunning()) {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << tx;
+        ss.GetHash();
+    }
+}
+
+static void HashWriterTxLegacy(benchmark::State& state)
+{
+    const CTransaction tx = MakeTransaction();
+    while (state.KeepRunning()) {
+        CLegacyHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << tx;
+        ss.GetHash();
+    }
+}
+
+static void GostHashWriterTx(benchmark::State& state)
+{
+    const CTransaction tx = MakeTransaction();
+    while (state.KeepRunning()) {
+        CGostHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << tx;
+        ss.GetHash();
+    }
+}
+
+BENCHMARK(HashWriterTx);
+BENCHMARK(HashWriterTxLegacy);
+BENCHMARK(GostHashWriterTx);
@@ -0,0 +1,47 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "block.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "pow.h"
+
+#include <vector>
+
+//! Blocks in the chain, about a week at the target spacing, more than one integration period
+static const unsigned int CHAIN_BLOCKS = 3500;
+//! Tips the benchmark cycles through, within the depth CRetargetWindow can follow without a rebuild
+static const unsigned int TIP_BLOCKS = 50;
+
+//! A new work calculation for a new tip each iteration, as after every block connected to the chain
+static void RetargetPidUpdateOutput(benchmark::State& state)
+{
+    const uint32_t nBits = Params().ProofOfWorkLimit(CChainParams::ALGO_SCRYPT).GetCompact();
+    std::vector<CBlockIndex> vIndex(CHAIN_BLOCKS);
+    int64_t nTime = 1400000000;
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+        vIndex[i].nHeight = i;
+        nTime += nTargetSpacing - 60 + (i * 7919) % 121;
+        vIndex[i].nTime = nTime;
+        vIndex[i].nBits = nBits;
+        vIndex[i].BuildSkip();
+    }
+
+    // The gains the node runs with, see AppInit2()
+    CRetargetPidController pid(1.7, 172800, 5, 0);
+    unsigned int nTip = 0;
+    while (state.KeepRunning()) {
+        const CBlockIndex* pIndex = &vIndex[CHAIN_BLOCKS - TIP_BLOCKS + nTip];
+        CBlockHeader header;
+        header.nVersion = 3;
+        header.nTime = pIndex->nTime + nTargetSpacing;
+        pid.UpdateOutput(pIndex, &header);
+        nTip = (nTip + 1) % TIP_BLOCKS;
+    }
+}
+
+BENCHMARK(RetargetPidUpdateOutput);
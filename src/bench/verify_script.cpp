@@ -0,0 +1,65 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "script.h"
+#include "sigcache.h"
+#include "sign.h"
+#include "transaction.h"
+
+#include <assert.h>
+
+//! A signed spend of a pay to pubkey hash output, the script checked for nearly every input
+struct CSignedSpend
+{
+    CScript scriptPubKey;
+    CTransaction tx;
+
+    CSignedSpend()
+    {
+        CBasicKeyStore keystore;
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+        CMutableTransaction txSpend;
+        txSpend.vin.resize(1);
+        txSpend.vin[0].prevout = COutPoint(uint256(1), 0);
+        txSpend.vout.resize(1);
+        txSpend.vout[0].nValue = COIN;
+        txSpend.vout[0].scriptPubKey = scriptPubKey;
+        SignSignature(keystore, scriptPubKey, txSpend, 0);
+        tx = CTransaction(txSpend);
+    }
+};
+
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    const CSignedSpend spend;
+    while (state.KeepRunning()) {
+        ScriptError error;
+        bool fSuccess = VerifyScript(spend.tx.vin[0].scriptSig, spend.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&spend.tx, 0), &error);
+        assert(fSuccess);
+    }
+}
+
+//! The same spend checked again after it was accepted to the memory pool, as ConnectBlock() does
+static void VerifyScriptP2PKHCached(benchmark::State& state)
+{
+    const CSignedSpend spend;
+    InitSignatureCache();
+    VerifyScript(spend.tx.vin[0].scriptSig, spend.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingTransactionSignatureChecker(&spend.tx, 0, true));
+    while (state.KeepRunning()) {
+        ScriptError error;
+        bool fSuccess = VerifyScript(spend.tx.vin[0].scriptSig, spend.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingTransactionSignatureChecker(&spend.tx, 0, false), &error);
+        assert(fSuccess);
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
+BENCHMARK(VerifyScriptP2PKHCached);
@@ -7,6 +7,7 @@
 #include "block.h"
 
 #include "Gost3411.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "scrypt.h"
 #include "tinyformat.h"
@@ -38,12 +39,15 @@ uintFakeHash CBlockHeader::CalcSha256dHash() const
     return sha256dHash;
 }
 
+//! Both v3 and right height should trigger GOST3411
+static inline bool IsGost3411Header(const CBlockHeader& header)
+{
+    return signed(header.nHeight) >= CashIsKing::ANCConsensus::nDifficultySwitchHeight6 || header.nVersion >= 3;
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    // Both v3 and right height should trigger GOST3411
-    if (signed(nHeight) >= CashIsKing::ANCConsensus::nDifficultySwitchHeight6)
-        return GetGost3411Hash();
-    if (nVersion >= 3)
+    if (IsGost3411Header(*this))
         return GetGost3411Hash();
     return GetScryptHash();
 }
@@ -64,7 +68,54 @@ uint256 CBlockHeader::GetScryptHash() const
     return therealHash;
 }
 
-uint256 CBlock::BuildMerkleTree(bool* fMutated) const
+void CBlockHeader::GetScryptHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes)
+{
+    //! Every header is packed as its 80 byte nVersion...nNonce proof-of-work input, back to back
+    const uint32_t nCount = vHeaders.size();
+    std::vector<char> vInput( nCount * 80 );
+    for( uint32_t i = 0; i < nCount; i++ )
+        memcpy( &vInput[i * 80], BEGIN(vHeaders[i].nVersion), 80 );
+
+    vHashes.resize( nCount );
+    if( nCount )
+        scrypt_1024_1_1_256_multi( &vInput[0], BEGIN(vHashes[0]), nCount );
+    for( uint32_t i = 0; i < nCount; i++ )
+        vHeaders[i].therealHash = vHashes[i];
+}
+
+void CBlockHeader::GetHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes)
+{
+    //! Gost3411 headers are hashed one at a time, the scrypt ones are gathered up and hashed as a batch
+    std::vector<CBlockHeader> vScryptHeaders;
+    std::vector<size_t> vScryptIndex;
+    vHashes.resize( vHeaders.size() );
+    for( size_t i = 0; i < vHeaders.size(); i++ ) {
+        const CBlockHeader& header = vHeaders[i];
+        if( IsGost3411Header(header) )
+            vHashes[i] = header.GetGost3411Hash();
+        else {
+            vScryptHeaders.push_back( header );
+            vScryptIndex.push_back( i );
+        }
+    }
+    std::vector<uint256> vScryptHashes;
+    GetScryptHashes( vScryptHeaders, vScryptHashes );
+    for( size_t i = 0; i < vScryptIndex.size(); i++ )
+        vHashes[vScryptIndex[i]] = vScryptHashes[i];
+}
+
+/** Replace a level of a merkle tree with the next one up, in place.  Adjacent pairs of hashes are hashed together,
+ *  an odd one out at the end with itself, all of the pairs in one batch of 64 byte inputs. */
+static void HashMerkleLevel(std::vector<uint256>& vLevel)
+{
+    if (vLevel.size() & 1)
+        vLevel.push_back(vLevel.back());
+    SHA256D64((unsigned char*)&vLevel[0], (const unsigned char*)&vLevel[0], vLevel.size() / 2);
+    vLevel.resize(vLevel.size() / 2);
+}
+
+//! The root of the hashes, computed level by level in the vector itself, which is left holding only the root
+static uint256 MerkleRootInPlace(std::vector<uint256>& vHashes, bool* fMutated)
 {
     /* WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
@@ -101,48 +152,87 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
        known ways of changing the transactions without affecting the merkle
        root.
     */
-    vMerkleTree.clear();
-    vMerkleTree.reserve(vtx.size() * 2 + 16); // Safe upper bound for the number of total nodes.
-    for (std::vector<CTransaction>::const_iterator it(vtx.begin()); it != vtx.end(); ++it)
-        vMerkleTree.push_back(it->GetHash());
-    int j = 0;
     bool mutated = false;
-    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
-    {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+    while (vHashes.size() > 1) {
+        if ((vHashes.size() & 1) == 0 && vHashes[vHashes.size() - 2] == vHashes.back()) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
         }
-        j += nSize;
+        HashMerkleLevel(vHashes);
     }
     if (fMutated) {
         *fMutated = mutated;
     }
-    return (vMerkleTree.empty() ? 0 : vMerkleTree.back());
+    return (vHashes.empty() ? 0 : vHashes[0]);
 }
 
-std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
+uint256 ComputeMerkleRoot(std::vector<uint256> vLeaves, bool* fMutated)
+{
+    return MerkleRootInPlace(vLeaves, fMutated);
+}
+
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> vLeaves, unsigned int nIndex)
 {
-    if (vMerkleTree.empty())
-        BuildMerkleTree();
     std::vector<uint256> vMerkleBranch;
-    int j = 0;
-    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
-    {
-        int i = std::min(nIndex^1, nSize-1);
-        vMerkleBranch.push_back(vMerkleTree[j+i]);
+    if (nIndex >= vLeaves.size())
+        return vMerkleBranch;
+    while (vLeaves.size() > 1) {
+        // The sibling of the last hash on an odd sized level is that hash itself
+        vMerkleBranch.push_back(vLeaves[std::min<size_t>(nIndex ^ 1, vLeaves.size() - 1)]);
+        HashMerkleLevel(vLeaves);
         nIndex >>= 1;
-        j += nSize;
     }
     return vMerkleBranch;
 }
 
+std::vector<uint256> ComputeMerkleTree(const std::vector<uint256>& vLeaves)
+{
+    std::vector<uint256> vTree(vLeaves);
+    std::vector<uint256> vLevel(vLeaves);
+    while (vLevel.size() > 1) {
+        HashMerkleLevel(vLevel);
+        vTree.insert(vTree.end(), vLevel.begin(), vLevel.end());
+    }
+    return vTree;
+}
+
+std::vector<uint256> GetMerkleBranchFromTree(const std::vector<uint256>& vTree, unsigned int nLeaves, unsigned int nIndex)
+{
+    std::vector<uint256> vMerkleBranch;
+    if (nIndex >= nLeaves)
+        return vMerkleBranch;
+    size_t nLevelStart = 0;
+    for (unsigned int nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2) {
+        vMerkleBranch.push_back(vTree[nLevelStart + std::min(nIndex ^ 1, nSize - 1)]);
+        nLevelStart += nSize;
+        nIndex >>= 1;
+    }
+    return vMerkleBranch;
+}
+
+//! The transaction hashes of a block, the leaves of its merkle tree, with room for an odd one out to be duplicated
+static std::vector<uint256> GetMerkleLeaves(const std::vector<CTransaction>& vtx)
+{
+    std::vector<uint256> vLeaves;
+    vLeaves.reserve(vtx.size() + 1);
+    for (std::vector<CTransaction>::const_iterator it(vtx.begin()); it != vtx.end(); ++it)
+        vLeaves.push_back(it->GetHash());
+    return vLeaves;
+}
+
+uint256 CBlock::BuildMerkleTree(bool* fMutated) const
+{
+    std::vector<uint256> vLeaves = GetMerkleLeaves(vtx);
+    return MerkleRootInPlace(vLeaves, fMutated);
+}
+
+std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
+{
+    if (nIndex < 0)
+        return std::vector<uint256>();
+    return ComputeMerkleBranch(GetMerkleLeaves(vtx), nIndex);
+}
+
 uint256 CBlock::CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex)
 {
     if (nIndex == -1)
@@ -173,9 +263,5 @@ std::string CBlock::ToString() const
     {
         s << "  " << vtx[i].ToString() << "\n";
     }
-    s << "  vMerkleTree: ";
-    for (unsigned int i = 0; i < vMerkleTree.size(); i++)
-        s << " " << vMerkleTree[i].ToString();
-    s << "\n";
     return s.str();
 }
@@ -123,6 +123,10 @@ public:
     uint256 GetGost3411Hash() const; // Gives Gost hash
     uint256 GetScryptHash() const; // Gives Scrypt hash
 
+    //! Batched versions of the above, the scrypt hashes are run through the multi-lane scrypt engine
+    static void GetScryptHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes);
+    static void GetHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes);
+
     inline uintFakeHash GetFakeHash() const
     {
         return sha256dHash;
@@ -142,9 +146,6 @@ public:
     // network and disk
     std::vector<CTransaction> vtx;
 
-    // memory only
-    mutable std::vector<uint256> vMerkleTree;
-
     CBlock()
     {
         SetNull();
@@ -168,7 +169,6 @@ public:
     {
         CBlockHeader::SetNull();
         vtx.clear();
-        vMerkleTree.clear();
     }
 
     CBlockHeader GetBlockHeader() const
@@ -187,17 +187,33 @@ public:
         return block;
     }
 
-    // Build the in-memory merkle tree for this block and return the merkle root.
+    // Compute the merkle root of this block's transactions, without keeping the tree.
     // If non-NULL, *mutated is set to whether mutation was detected in the merkle
     // tree (a duplication of transactions in the block leading to an identical
     // merkle root).
     uint256 BuildMerkleTree(bool* mutated = NULL) const;
 
+    // The merkle branch of transaction nIndex, computed when asked for.  That hashes the whole tree, callers after
+    // the branches of many transactions keep a tree from ComputeMerkleTree() and use GetMerkleBranchFromTree().
     std::vector<uint256> GetMerkleBranch(int nIndex) const;
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
     std::string ToString() const;
 };
 
+/** The merkle root of a list of leaf hashes.  Computed a level at a time over the copy of the list, with the pairs of
+ *  each level hashed in one batch.  If non-NULL, *fMutated is set as by CBlock::BuildMerkleTree(). */
+uint256 ComputeMerkleRoot(std::vector<uint256> vLeaves, bool* fMutated = NULL);
+
+/** The hashes needed along with leaf nIndex to compute the merkle root, see CBlock::CheckMerkleBranch(). */
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> vLeaves, unsigned int nIndex);
+
+/** Every level of the merkle tree over the leaves, from the leaves up to the root, one after the other.
+ *  For partial merkle trees, that need hashes from anywhere in the tree, and for the branches of many leaves. */
+std::vector<uint256> ComputeMerkleTree(const std::vector<uint256>& vLeaves);
+
+/** The merkle branch of leaf nIndex picked out of a tree from ComputeMerkleTree() over nLeaves leaves, no hashing. */
+std::vector<uint256> GetMerkleBranchFromTree(const std::vector<uint256>& vTree, unsigned int nLeaves, unsigned int nIndex);
+
 
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
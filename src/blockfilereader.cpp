@@ -0,0 +1,147 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilereader.h"
+
+#include "util.h"
+
+#include <errno.h>
+
+#include <algorithm>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/** A file opened for reading only, closed when the last reader lets go of it */
+class CBlockFileReader::CReadableFile
+{
+private:
+#ifdef WIN32
+    //! Windows has no pread(), reads share the file position under a lock
+    FILE* file;
+    boost::mutex cs;
+#else
+    int fd;
+#endif
+
+public:
+    explicit CReadableFile(const boost::filesystem::path& path)
+    {
+#ifdef WIN32
+        file = fopen(path.string().c_str(), "rb");
+#else
+        fd = open(path.string().c_str(), O_RDONLY);
+#endif
+    }
+
+    ~CReadableFile()
+    {
+#ifdef WIN32
+        if (file)
+            fclose(file);
+#else
+        if (fd != -1)
+            close(fd);
+#endif
+    }
+
+    bool IsOpen() const
+    {
+#ifdef WIN32
+        return file != NULL;
+#else
+        return fd != -1;
+#endif
+    }
+
+    bool Read(uint64_t nPos, char* pch, size_t nSize)
+    {
+#ifdef WIN32
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (_fseeki64(file, nPos, SEEK_SET) != 0)
+            return false;
+        return fread(pch, 1, nSize, file) == nSize;
+#else
+        while (nSize > 0) {
+            ssize_t nRead = pread(fd, pch, nSize, nPos);
+            if (nRead < 0 && errno == EINTR)
+                continue;
+            if (nRead <= 0)
+                return false;
+            pch += nRead;
+            nPos += nRead;
+            nSize -= nRead;
+        }
+        return true;
+#endif
+    }
+};
+
+CBlockFileReader::CBlockFileReader(size_t nMaxOpenIn) : nMaxOpen(std::max(nMaxOpenIn, (size_t)1)), nUses(0)
+{
+}
+
+CBlockFileReader::~CBlockFileReader()
+{
+}
+
+boost::shared_ptr<CBlockFileReader::CReadableFile> CBlockFileReader::Get(const boost::filesystem::path& path)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<std::string, COpenFile>::iterator it = mapOpen.find(path.string());
+    if (it != mapOpen.end()) {
+        it->second.nLastUsed = ++nUses;
+        return it->second.file;
+    }
+
+    boost::shared_ptr<CReadableFile> file(new CReadableFile(path));
+    if (!file->IsOpen()) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return boost::shared_ptr<CReadableFile>();
+    }
+    if (mapOpen.size() >= nMaxOpen) {
+        std::map<std::string, COpenFile>::iterator itOldest = mapOpen.begin();
+        for (it = mapOpen.begin(); it != mapOpen.end(); ++it) {
+            if (it->second.nLastUsed < itOldest->second.nLastUsed)
+                itOldest = it;
+        }
+        mapOpen.erase(itOldest);
+    }
+    COpenFile& entry = mapOpen[path.string()];
+    entry.file = file;
+    entry.nLastUsed = ++nUses;
+    return file;
+}
+
+bool CBlockFileReader::Read(const boost::filesystem::path& path, uint64_t nPos, char* pch, size_t nSize)
+{
+    boost::shared_ptr<CReadableFile> file = Get(path);
+    if (!file)
+        return false;
+    // Without the lock, another thread may close the file meanwhile, this reference keeps it open until done
+    if (!file->Read(nPos, pch, nSize))
+        return error("%s : Reading %u bytes at position %u of %s failed", __func__, nSize, nPos, path.string());
+    return true;
+}
+
+void CBlockFileReader::CloseAll()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapOpen.clear();
+}
+
+size_t CBlockFileReader::GetOpenCount()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return mapOpen.size();
+}
+
+void AdviseSequentialRead(FILE* file)
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ANONCOIN_BLOCKFILEREADER_H
+#define ANONCOIN_BLOCKFILEREADER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+//! Block and undo files kept open for reading by default
+static const size_t DEFAULT_BLOCKFILE_READERS = 16;
+
+/**
+ * Reads from the blk?????.dat and rev?????.dat files, keeping the most recently used of them open.  A read goes
+ * straight to the position asked for with pread(), there is no file position to seek and no stdio buffer to fill,
+ * so reading a block costs one system call and threads read side by side.  As a file stays open, the kernel sees
+ * a rescan or a verification reading through it in order and reads ahead.  Files grow while they are open, reads
+ * see what was appended.
+ */
+class CBlockFileReader
+{
+private:
+    class CReadableFile;
+    struct COpenFile
+    {
+        boost::shared_ptr<CReadableFile> file;
+        uint64_t nLastUsed;
+    };
+
+    boost::mutex cs;
+    std::map<std::string, COpenFile> mapOpen;
+    size_t nMaxOpen;
+    uint64_t nUses;
+
+    //! The open file at path, opened in place of the least recently used one if it is not
+    boost::shared_ptr<CReadableFile> Get(const boost::filesystem::path& path);
+
+public:
+    explicit CBlockFileReader(size_t nMaxOpenIn = DEFAULT_BLOCKFILE_READERS);
+    ~CBlockFileReader();
+
+    //! Read nSize bytes at nPos of the file at path, false if it can not be opened or ends before
+    bool Read(const boost::filesystem::path& path, uint64_t nPos, char* pch, size_t nSize);
+
+    //! Close the files, those still being read from are closed once the reads are done
+    void CloseAll();
+
+    size_t GetOpenCount();
+};
+
+//! Tell the system the file is about to be read from start to end, as an import or a reindex does
+void AdviseSequentialRead(FILE* file);
+
+#endif // ANONCOIN_BLOCKFILEREADER_H
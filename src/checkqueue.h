@@ -7,8 +7,12 @@
 #define ANONCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <assert.h>
+#include <deque>
+#include <stdint.h>
 #include <vector>
 
+#include <boost/atomic.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -20,18 +24,40 @@ class CCheckQueueControl;
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
+  * operator(), returning a bool, and a swap().
   *
   * One thread (the master) is assumed to push batches of verifications
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Each worker has a deque of its own.  Add() spreads a batch over them, taking
+  * each deque's lock once, and a worker takes its batches from the back of its
+  * own deque, or when that is empty steals half of another's from the front.  So
+  * the threads rarely contend for a lock, and never for the same one while there
+  * is work left in their own deques.  Completion is an atomic count of the checks
+  * not yet done; the shared mutex is only taken to sleep and to wake up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Deques beyond the master's, worker threads past this many share them
+    static const unsigned int MAX_WORKERS = 64;
+
+    struct CWorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> queue;
+    };
+
+    //! Index 0 is the master's, which only holds work while no worker has started yet
+    CWorkerQueue workers[MAX_WORKERS + 1];
+
+    //! The number of worker deques in use
+    boost::atomic<unsigned int> nWorkers;
+
+    //! Mutex to sleep and wake up on, and protecting nGeneration, nIdle and nThreads
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -40,121 +66,166 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Incremented by every Add(), so a worker can tell whether work arrived while it looked for some
+    uint64_t nGeneration;
 
-    //! The number of workers (including the master) that are idle.
+    //! The number of workers that are idle.
     int nIdle;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads started
+    unsigned int nThreads;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    boost::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
+    boost::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Moves nCount checks from the back (fFront false) or front of a deque into vChecks, the deque must be locked
+    void Take(std::deque<T>& queue, unsigned int nCount, bool fFront, std::vector<T>& vChecks)
+    {
+        vChecks.resize(nCount);
+        for (unsigned int i = 0; i < nCount; i++) {
+            if (fFront) {
+                vChecks[i].swap(queue.front());
+                queue.pop_front();
+            } else {
+                vChecks[i].swap(queue.back());
+                queue.pop_back();
+            }
+        }
+    }
+
+    /**
+     * Fills vChecks with the next batch for worker nSelf, returns false if there was no work anywhere.
+     * Batches get smaller as a deque runs down, so all workers finish approximately simultaneously.
+     */
+    bool GetBatch(unsigned int nSelf, std::vector<T>& vChecks)
+    {
+        {
+            CWorkerQueue& own = workers[nSelf];
+            boost::unique_lock<boost::mutex> lock(own.mutex);
+            if (!own.queue.empty()) {
+                Take(own.queue, std::max(1U, std::min(nBatchSize, (unsigned int)own.queue.size() / 2)), false, vChecks);
+                return true;
+            }
+        }
+        unsigned int nQueues = nWorkers.load(boost::memory_order_acquire) + 1;
+        for (unsigned int i = 1; i < nQueues; i++) {
+            CWorkerQueue& victim = workers[(nSelf + i) % nQueues];
+            boost::unique_lock<boost::mutex> lock(victim.mutex);
+            if (!victim.queue.empty()) {
+                Take(victim.queue, std::max(1U, std::min(nBatchSize, (unsigned int)(victim.queue.size() + 1) / 2)), true, vChecks);
+                return true;
+            }
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSelf, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
+            uint64_t nGenerationSeen;
             {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+                nGenerationSeen = nGeneration;
+            }
+            while (GetBatch(nSelf, vChecks)) {
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk.load(boost::memory_order_relaxed);
+                BOOST_FOREACH (T& check, vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk.store(false, boost::memory_order_relaxed);
+                unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nNow, boost::memory_order_acq_rel) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // What is left is being worked on, only the master adds more
+                while (nTodo.load(boost::memory_order_acquire) != 0)
+                    condMaster.wait(lock);
+                // return the current status, and reset it for new work later
+                return fAllOk.exchange(true);
+            }
+            while (nGeneration == nGenerationSeen) {
+                nIdle++;
+                condWorker.wait(lock); // wait
+                nIdle--;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nGeneration(0), nIdle(0), nThreads(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nSelf;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSelf = 1 + nThreads % MAX_WORKERS;
+            nThreads++;
+            nWorkers.store(std::min(nThreads, (unsigned int)MAX_WORKERS), boost::memory_order_release);
+        }
+        Loop(nSelf);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        // Counted before any of them can be taken, so a worker never sees the count reach zero early
+        nTodo.fetch_add(vChecks.size(), boost::memory_order_acq_rel);
+
+        // Spread evenly over the workers, one lock per deque
+        unsigned int nCount = nWorkers.load(boost::memory_order_acquire);
+        unsigned int nFirst = nCount ? 1 : 0;
+        unsigned int nQueues = std::max(1U, nCount);
+        size_t nPos = 0;
+        for (unsigned int i = 0; i < nQueues && nPos < vChecks.size(); i++) {
+            size_t nEnd = vChecks.size() * (i + 1) / nQueues;
+            if (nEnd == nPos)
+                continue;
+            CWorkerQueue& worker = workers[nFirst + i];
+            boost::unique_lock<boost::mutex> lock(worker.mutex);
+            for (; nPos < nEnd; nPos++) {
+                worker.queue.push_back(T());
+                vChecks[nPos].swap(worker.queue.back());
+            }
         }
-        nTodo += vChecks.size();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nGeneration++;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -162,10 +233,10 @@ public:
     {
     }
 
+    //! Whether there is no work queued or in progress, and no failure waiting to be collected by Wait()
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo.load() == 0 && fAllOk.load();
     }
 
 };
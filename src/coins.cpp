@@ -210,6 +210,40 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+uint256 CCoinsViewCache::CopyDirtyCoins(CCoinsMap &mapDirty) {
+    assert(!hasModifier);
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
+            CCoinsMap::iterator itOld = it++;
+            cacheCoins.erase(itOld);
+            continue;
+        }
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapDirty[it->first];
+            entry.coins = it->second.coins;
+            entry.flags = it->second.flags;
+            // Once the copy is written the base has this entry, so it is no longer fresh either
+            it->second.flags = 0;
+        }
+        ++it;
+    }
+    return GetBestBlock();
+}
+
+size_t CCoinsViewCache::EvictClean(size_t nTarget) {
+    size_t nEvicted = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && cacheCoins.size() > nTarget;) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            ++it;
+            continue;
+        }
+        CCoinsMap::iterator itOld = it++;
+        cacheCoins.erase(itOld);
+        nEvicted++;
+    }
+    return nEvicted;
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
@@ -343,6 +343,7 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView* GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
 };
@@ -415,6 +416,21 @@ public:
      */
     bool Flush();
 
+    /**
+     * Copy the coins of every dirty entry into mapDirty, to be written to the base view later, and mark the entries
+     * clean so this cache keeps them as its working set.  Fresh entries that are spent by now are erased instead,
+     * the base never had them.  The copies keep their flags, so the base can tell which entries are new to it.
+     * Returns the best block the copies belong to.
+     */
+    uint256 CopyDirtyCoins(CCoinsMap &mapDirty);
+
+    /**
+     * Erase entries that are not dirty while more than nTarget are cached.  Only safe once the copies from
+     * CopyDirtyCoins() have been written, until then the base view may not have them, and with no cache on top of
+     * this one.  Returns the number erased.
+     */
+    size_t EvictClean(size_t nTarget);
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
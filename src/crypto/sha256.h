@@ -5,8 +5,13 @@
 #ifndef BITCOIN_CRYPTO_SHA256_H
 #define BITCOIN_CRYPTO_SHA256_H
 
+#if defined(HAVE_CONFIG_H)
+#include "config/anoncoin-config.h"
+#endif
+
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +30,36 @@ public:
     CSHA256& Reset();
 };
 
+/** Select the fastest SHA-256 implementations the cpu supports, returns a description of them for the log.
+ *  With fAllowSIMD false the portable implementation is used. */
+std::string SHA256AutoDetect(bool fAllowSIMD = true);
+
+/** Double SHA-256 of nBlocks consecutive 64 byte inputs, such as pairs of merkle tree nodes, into nBlocks
+ *  consecutive 32 byte outputs.  Runs as many inputs at once as the selected implementation can.  The output may be
+ *  the input itself, so that a level of a merkle tree can be replaced by the next one up. */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t nBlocks);
+
+//! The implementations built with other instruction sets, each lives in a file compiled for its own
+namespace sha256_shani
+{
+#if defined(ENABLE_SHANI)
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+void TransformD64(unsigned char* out, const unsigned char* in);
+#endif
+}
+
+namespace sha256d64_sse41
+{
+#if defined(ENABLE_SSE41)
+void Transform_4way(unsigned char* out, const unsigned char* in);
+#endif
+}
+
+namespace sha256d64_avx2
+{
+#if defined(ENABLE_AVX2)
+void Transform_8way(unsigned char* out, const unsigned char* in);
+#endif
+}
+
 #endif // BITCOIN_CRYPTO_SHA256_H
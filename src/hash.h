@@ -139,35 +139,18 @@ class CHashWriter
 {
 private:
     CHash256 ctx;
-    std::stringstream gostCtx;
 
 public:
     int nType;
     int nVersion;
 
-    CHashWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {
-        gostCtx.str("");
-    }
+    CHashWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {}
 
     CHashWriter& write(const char *pch, size_t size) {
         ctx.Write((const unsigned char*)pch, size);
-        gostCtx.write (pch, size);
         return (*this);
     }
 
-    uint256 GetGost3411Hash() {
-        // GOST 34.11-256 (GOST 34.11-512 (...))
-        uint8_t hash1[64];
-		i2p::crypto::GOSTR3411_2012_512 ((uint8_t *)gostCtx.str ().c_str (), gostCtx.str ().length (), hash1);
-		uint32_t digest[8];
-		i2p::crypto::GOSTR3411_2012_256 (hash1, 64, (unsigned char*)&digest);
-        // to little endian
-        uint256 hash2;
-        for (int i = 0; i < 8; i++)
-            hash2.pn[i] = ByteReverse (digest[7-i]);
-        return hash2;
-    }
-
     // invalidates the object
     uint256 GetHash() {
         uint256 result;
@@ -183,6 +166,45 @@ public:
     }
 };
 
+/** A writer stream (for serialization) that computes the GOST 3411 256-bit hash, as HashGOST() does. */
+class CGostHashWriter
+{
+private:
+    CGOST3411 ctx;
+
+public:
+    int nType;
+    int nVersion;
+
+    CGostHashWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CGostHashWriter& write(const char *pch, size_t size) {
+        ctx.Write((const unsigned char*)pch, size);
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash() {
+        // GOST 34.11-256 (GOST 34.11-512 (...))
+        uint8_t hash1[CGOST3411::OUTPUT_SIZE_512];
+        ctx.Finalize(hash1);
+        uint32_t digest[8];
+        i2p::crypto::GOSTR3411_2012_256 (hash1, sizeof(hash1), (uint8_t *)digest);
+        // to little endian
+        uint256 hash2;
+        for (int i = 0; i < 8; i++)
+            hash2.pn[i] = ByteReverse (digest[7-i]);
+        return hash2;
+    }
+
+    template<typename T>
+    CGostHashWriter& operator<<(const T& obj) {
+        // Serialize to this stream
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Compute the 256-bit hash of an object's serialization. */
 template<typename T>
 uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL_VERSION)
@@ -196,9 +218,9 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
 template<typename T>
 uint256 SerializeGost3411Hash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL_VERSION)
 {
-    CHashWriter ss(nType, nVersion);
+    CGostHashWriter ss(nType, nVersion);
     ss << obj;
-    return ss.GetGost3411Hash();
+    return ss.GetHash();
 }
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
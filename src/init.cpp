@@ -16,6 +16,7 @@
 #include "consensus.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/sha256.h"
 //#include "coins.h"
 #include "key.h"
 #include "main.h"
@@ -25,6 +26,7 @@
 //#include "random.h"
 #include "rpcserver.h"
 #include "scrypt.h"
+#include "sigcache.h"
 #include "txdb.h"
 #include "ui_interface.h"                                   // Include this if you want language translation capability in your source files
 #include "util.h"
@@ -60,6 +62,8 @@ using namespace std;
 CWallet* pwalletMain = NULL;
 #endif
 bool fFeeEstimatesInitialized = false;
+//! Set once the mempool was loaded from disk, so a shutdown during the load does not overwrite the file with part of it
+static bool fDumpMempoolLater = false;
 
 #ifdef WIN32
 // Win32 LevelDB doesn't use filedescriptors, and the ones used for
@@ -171,6 +175,9 @@ void Shutdown()
     StopNode();
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
+
     if (fFeeEstimatesInitialized)
     {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -199,6 +206,7 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        CloseBlockFiles();
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -286,13 +294,16 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache) + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + " " + _("on startup") + "\n";
+    strUsage += "  -maxmempool=<n>        " + strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE) + "\n";
     strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
     strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -persistmempool        " + strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL) + "\n";
 #ifndef WIN32
     strUsage += "  -pid=<file>            " + strprintf(_("Specify pid file (default: %s)"), "anoncoind.pid") + "\n";
 #endif
     strUsage += "  -reindex               " + _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup") + "\n";
     strUsage += "  -txindex               " + strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 1) + "\n";
+    strUsage += "  -utxoperoutput         " + strprintf(_("Store the coin database with one record per unspent output, upgrades it once and for good (default: %u)"), 0) + "\n";
 
     strUsage += "\n" + _("Connection options:") + "\n";
     strUsage += "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n";
@@ -314,6 +325,7 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -port=<port>           " + strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 9377, 19377) + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through SOCKS5 proxy") + "\n";
     strUsage += "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n";
+    strUsage += "  -socketevents=<mode>   " + strprintf(_("How the network thread waits for its sockets, epoll (where available) or select (default: %s)"), DEFAULT_SOCKETEVENTS) + "\n";
     strUsage += "  -timeout=<n>           " + strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT) + "\n";
 #ifdef USE_UPNP
 #if USE_UPNP
@@ -375,7 +387,7 @@ std::string HelpMessage(HelpMessageMode hmm)
     {
         strUsage += "  -limitfreerelay=<n>    " + strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15) + "\n";
         strUsage += "  -relaypriority         " + strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1) + "\n";
-        strUsage += "  -maxsigcachesize=<n>   " + strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000) + "\n";
+        strUsage += "  -sigcachemib=<n>       " + strprintf(_("Limit size of signature cache to <n> MiB (0 to %d, default: %u)"), MAX_SIG_CACHE_MIB, DEFAULT_SIG_CACHE_MIB) + "\n";
     }
     strUsage += "  -minrelaytxfee=<amt>   " + strprintf(_("Fees (in ANC/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())) + "\n";
     strUsage += "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n";
@@ -409,7 +421,9 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n";
     strUsage += "  -rpcport=<port>        " + strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 9376, 19376) + "\n";
     strUsage += "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times") + "\n";
-    strUsage += "  -rpcthreads=<n>        " + strprintf(_("Set the number of threads to service RPC calls (default: %d)"), 4) + "\n";
+    strUsage += "  -rpcthreads=<n>        " + strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_RPC_THREADS) + "\n";
+    strUsage += "  -rpcworkqueue=<n>      " + strprintf(_("Set the depth of the work queue to service RPC calls (default: %d)"), DEFAULT_RPC_WORKQUEUE) + "\n";
+    strUsage += "  -rpcservertimeout=<n>  " + strprintf(_("Timeout during HTTP requests and for idle keep-alive connections in seconds (default: %d)"), DEFAULT_RPC_SERVER_TIMEOUT) + "\n";
     strUsage += "  -rpckeepalive          " + strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1) + "\n";
 
     strUsage += "\n" + _("RPC SSL options: (see the Wiki for SSL setup instructions)") + "\n";
@@ -522,6 +536,15 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    // In the background like the imports above, so the node is up and relaying while the pool fills.  A dump that
+    // fails to load is kept for a look at it, rather than overwritten at shutdown.
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        if (LoadMempool())
+            fDumpMempoolLater = !ShutdownRequested();
+        else if (!ShutdownRequested())
+            LogPrintf("Not dumping the memory pool at shutdown, mempool.dat failed to load\n");
+    }
 }
 
 /** Sanity checks
@@ -670,8 +693,19 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEvents != "select" && strSocketEvents != "epoll")
+        return InitError(strprintf(_("Unknown -socketevents mode '%s'"), strSocketEvents));
+#ifndef HAVE_SYS_EPOLL_H
+    if (strSocketEvents == "epoll")
+        return InitError(_("-socketevents=epoll is not supported on this platform"));
+#endif
     nMaxConnections = GetArg("-maxconnections", 125);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // select() can not wait on more sockets than fit in an fd_set.  epoll, and poll() for the connects and proxy
+    // handshakes, are only limited by the file descriptors available
+    if (!UseSocketEventsEpoll())
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -754,6 +788,10 @@ bool AppInit2(boost::thread_group& threadGroup)
         tx_nMinRelayTxFee = n;       // Critical global value, allows many v9 routines to run properly until v10 upgrade is done (esp QT)
     }
 
+    // A pool smaller than a few blocks would evict what the next one could have taken
+    if (GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) < 5)
+        return InitError(strprintf(_("-maxmempool must be at least %d MB"), 5));
+
 #ifdef ENABLE_WALLET
     if (mapArgs.count("-mintxfee"))
     {
@@ -848,6 +886,12 @@ bool AppInit2(boost::thread_group& threadGroup)
 #if defined(USE_SSE2)
     scrypt_detect_sse2();
 #endif
+    LogPrintf("Using %s GOST R 34.11-2012 implementation\n", i2p::crypto::GOSTR3411_2012_AutoDetect());
+    LogPrintf("Using %s SHA-256 implementation\n", SHA256AutoDetect());
+#ifdef USE_SECP256K1
+    LogPrintf("Using libsecp256k1 for ECDSA signature verification\n");
+#endif
+    InitSignatureCache();
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
@@ -1385,6 +1429,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     nTotalCache -= nCoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
 
+    bool fCoinsPerOutput = GetBoolArg("-utxoperoutput", false);
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -1401,6 +1446,15 @@ bool AppInit2(boost::thread_group& threadGroup)
                 delete pcoinscatcher;
                 delete pblocktree;
 
+                // A reindex wipes the coin database, it is rebuilt with the layout it had
+                if (fReindex && !fCoinsPerOutput) {
+                    CCoinsViewDB coinsdbWiped(nCoinDBCache);
+                    if (coinsdbWiped.IsPerOutput() || coinsdbWiped.IsUpgrading()) {
+                        LogPrintf("Keeping one record per unspent output in the coin database rebuilt by -reindex\n");
+                        fCoinsPerOutput = true;
+                    }
+                }
+
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
@@ -1409,6 +1463,15 @@ bool AppInit2(boost::thread_group& threadGroup)
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
+                // An upgrade that was interrupted is finished whatever -utxoperoutput says, the database is unusable until then
+                if (pcoinsdbview->IsUpgrading() || (fCoinsPerOutput && !pcoinsdbview->IsPerOutput())) {
+                    uiInterface.InitMessage(_("Upgrading coin database..."));
+                    if (!pcoinsdbview->UpgradeToPerOutput()) {
+                        strLoadError = _("Error upgrading coin database");
+                        break;
+                    }
+                }
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1501,7 +1564,6 @@ bool AppInit2(boost::thread_group& threadGroup)
                 CBlockIndex* pindex = (*mi).second;
                 CBlock block;
                 ReadBlockFromDisk(block, pindex);
-                block.BuildMerkleTree();
                 LogPrintf("%s\n", block.ToString() );
                 nFound++;
             }
@@ -1666,6 +1728,7 @@ bool AppInit2(boost::thread_group& threadGroup)
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "coinsflush", &ThreadFlushCoins));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -13,6 +13,11 @@
 #include <openssl/obj_mac.h>
 #include <openssl/rand.h>
 
+#ifdef USE_SECP256K1
+#include <secp256k1.h>
+#include <secp256k1_recovery.h>
+#endif
+
 // anonymous namespace with local implementation code (OpenSSL interaction)
 namespace {
 
@@ -337,6 +342,159 @@ public:
     }
 };
 
+#ifdef USE_SECP256K1
+// The libsecp256k1 context used to verify signatures and recover keys, created on first use and never destroyed
+const secp256k1_context* GetVerifyContext()
+{
+    static const secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    return ctx;
+}
+
+// Parses a DER encoded signature as loosely as OpenSSL's d2i_ECDSA_SIG() does, which is what decided validity
+// for as long as OpenSSL verified signatures.  Stray length bytes, padding and excess zeroes are all tolerated,
+// only the tags and lengths have to be consistent.  Negative R or S values, or ones that do not fit in 32 bytes,
+// make a signature that parses but never verifies, as they would with OpenSSL.  Returns 0 where d2i_ECDSA_SIG() fails.
+int ecdsa_signature_parse_der_lax(const secp256k1_context* ctx, secp256k1_ecdsa_signature* sig, const unsigned char *input, size_t inputlen)
+{
+    size_t rpos, rlen, spos, slen;
+    size_t pos = 0;
+    size_t lenbyte;
+    unsigned char tmpsig[64] = {0};
+    int overflow = 0;
+
+    // Start from a correctly parsed, but invalid, signature
+    secp256k1_ecdsa_signature_parse_compact(ctx, sig, tmpsig);
+
+    // Sequence tag byte
+    if (pos == inputlen || input[pos] != 0x30)
+        return 0;
+    pos++;
+
+    // Sequence length bytes, the value is not checked
+    if (pos == inputlen)
+        return 0;
+    lenbyte = input[pos++];
+    if (lenbyte & 0x80) {
+        lenbyte -= 0x80;
+        if (lenbyte > inputlen - pos)
+            return 0;
+        pos += lenbyte;
+    }
+
+    // Integer tag byte and length of R
+    if (pos == inputlen || input[pos] != 0x02)
+        return 0;
+    pos++;
+    if (pos == inputlen)
+        return 0;
+    lenbyte = input[pos++];
+    if (lenbyte & 0x80) {
+        lenbyte -= 0x80;
+        if (lenbyte > inputlen - pos)
+            return 0;
+        while (lenbyte > 0 && input[pos] == 0) {
+            pos++;
+            lenbyte--;
+        }
+        if (lenbyte >= sizeof(size_t))
+            return 0;
+        rlen = 0;
+        while (lenbyte > 0) {
+            rlen = (rlen << 8) + input[pos];
+            pos++;
+            lenbyte--;
+        }
+    } else {
+        rlen = lenbyte;
+    }
+    if (rlen > inputlen - pos)
+        return 0;
+    rpos = pos;
+    pos += rlen;
+
+    // Integer tag byte and length of S
+    if (pos == inputlen || input[pos] != 0x02)
+        return 0;
+    pos++;
+    if (pos == inputlen)
+        return 0;
+    lenbyte = input[pos++];
+    if (lenbyte & 0x80) {
+        lenbyte -= 0x80;
+        if (lenbyte > inputlen - pos)
+            return 0;
+        while (lenbyte > 0 && input[pos] == 0) {
+            pos++;
+            lenbyte--;
+        }
+        if (lenbyte >= sizeof(size_t))
+            return 0;
+        slen = 0;
+        while (lenbyte > 0) {
+            slen = (slen << 8) + input[pos];
+            pos++;
+            lenbyte--;
+        }
+    } else {
+        slen = lenbyte;
+    }
+    if (slen > inputlen - pos)
+        return 0;
+    spos = pos;
+
+    // OpenSSL reads an integer with its top bit set as negative, which never verifies
+    if ((rlen > 0 && (input[rpos] & 0x80)) || (slen > 0 && (input[spos] & 0x80)))
+        overflow = 1;
+
+    // Leading zeroes of R and S are ignored
+    while (rlen > 0 && input[rpos] == 0) {
+        rlen--;
+        rpos++;
+    }
+    if (rlen > 32)
+        overflow = 1;
+    else
+        memcpy(tmpsig + 32 - rlen, input + rpos, rlen);
+
+    while (slen > 0 && input[spos] == 0) {
+        slen--;
+        spos++;
+    }
+    if (slen > 32)
+        overflow = 1;
+    else
+        memcpy(tmpsig + 64 - slen, input + spos, slen);
+
+    if (!overflow)
+        overflow = !secp256k1_ecdsa_signature_parse_compact(ctx, sig, tmpsig);
+    if (overflow) {
+        memset(tmpsig, 0, 64);
+        secp256k1_ecdsa_signature_parse_compact(ctx, sig, tmpsig);
+    }
+    return 1;
+}
+
+// Recovers the public key of a 65 byte compact signature, with the same checks of the header byte as CECKey::Recover()
+bool RecoverCompactSecp256k1(const uint256 &hash, const std::vector<unsigned char>& vchSig, bool fCompressed, CPubKey &pubkeyOut)
+{
+    int rec = (vchSig[0] - 27) & ~4;
+    if (rec < 0 || rec >= 3)
+        return false;
+    const secp256k1_context* ctx = GetVerifyContext();
+    secp256k1_ecdsa_recoverable_signature sig;
+    if (!secp256k1_ecdsa_recoverable_signature_parse_compact(ctx, &sig, &vchSig[1], rec))
+        return false;
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ecdsa_recover(ctx, &pubkey, &sig, hash.begin()))
+        return false;
+    unsigned char pub[65];
+    size_t publen = sizeof(pub);
+    secp256k1_ec_pubkey_serialize(ctx, pub, &publen, &pubkey, fCompressed ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED);
+    pubkeyOut.Set(pub, pub + publen);
+    return true;
+}
+#endif // USE_SECP256K1
+
 }; // end of anonymous namespace
 
 bool CKey::Check(const unsigned char *vch) {
@@ -447,7 +605,43 @@ bool CKey::Load(CPrivKey &privkey, CPubKey &vchPubKey, bool fSkipCheck=false) {
     return true;
 }
 
+#ifdef USE_SECP256K1
+bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!IsValid())
+        return false;
+    const secp256k1_context* ctx = GetVerifyContext();
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ec_pubkey_parse(ctx, &pubkey, begin(), size()))
+        return false;
+    secp256k1_ecdsa_signature sig;
+    if (!ecdsa_signature_parse_der_lax(ctx, &sig, vchSig.empty() ? NULL : &vchSig[0], vchSig.size()))
+        return false;
+    // OpenSSL accepts either S value, libsecp256k1 only the lower one, which is equivalent
+    secp256k1_ecdsa_signature_normalize(ctx, &sig, &sig);
+    return secp256k1_ecdsa_verify(ctx, &sig, hash.begin(), &pubkey);
+}
+
+bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+    if (vchSig.size() != 65)
+        return false;
+    return RecoverCompactSecp256k1(hash, vchSig, (vchSig[0] - 27) & 4, *this);
+}
+
+bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!IsValid())
+        return false;
+    if (vchSig.size() != 65)
+        return false;
+    CPubKey pubkeyRec;
+    if (!RecoverCompactSecp256k1(hash, vchSig, IsCompressed(), pubkeyRec))
+        return false;
+    return *this == pubkeyRec;
+}
+
+bool CPubKey::VerifyOpenSSL(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+#else
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+#endif
     if (!IsValid())
         return false;
     CECKey key;
@@ -458,7 +652,11 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     return true;
 }
 
+#ifdef USE_SECP256K1
+bool CPubKey::RecoverCompactOpenSSL(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+#else
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+#endif
     if (vchSig.size() != 65)
         return false;
     CECKey key;
@@ -468,6 +666,7 @@ bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned cha
     return true;
 }
 
+#ifndef USE_SECP256K1
 bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
     if (!IsValid())
         return false;
@@ -482,6 +681,7 @@ bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char
         return false;
     return true;
 }
+#endif
 
 bool CPubKey::IsFullyValid() const {
     if (!IsValid())
@@ -618,6 +818,10 @@ bool ECC_InitSanityCheck() {
     if(pkey == NULL)
         return false;
     EC_KEY_free(pkey);
+#ifdef USE_SECP256K1
+    if (GetVerifyContext() == NULL)
+        return false;
+#endif
 
     // TODO Is there more EC functionality that could be missing?
     return true;
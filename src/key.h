@@ -7,6 +7,10 @@
 #ifndef ANONCOIN_KEY_H
 #define ANONCOIN_KEY_H
 
+#if defined(HAVE_CONFIG_H)
+#include "config/anoncoin-config.h"
+#endif
+
 #include "allocators.h"
 #include "hash.h"
 #include "serialize.h"
@@ -156,6 +160,13 @@ public:
     // Recover a public key from a compact signature.
     bool RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig);
 
+#ifdef USE_SECP256K1
+    // Verify() and RecoverCompact() use libsecp256k1 in this build, these are the OpenSSL
+    // versions they replace, kept so the two can be checked against each other.
+    bool VerifyOpenSSL(const uint256 &hash, const std::vector<unsigned char>& vchSig) const;
+    bool RecoverCompactOpenSSL(const uint256 &hash, const std::vector<unsigned char>& vchSig);
+#endif
+
     // Turn this public key into an uncompressed public key.
     bool Decompress();
 
@@ -60,6 +60,12 @@ public:
 
         batch.Delete(slKey);
     }
+
+    //! Drop the changes queued so far, to reuse the batch once they are written
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
@@ -169,6 +175,12 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! An iterator for lookups, which unlike NewIterator() keeps the blocks it reads in the cache
+    leveldb::Iterator* NewLookupIterator() const
+    {
+        return pdb->NewIterator(readoptions);
+    }
 };
 
 #endif // ANONCOIN_LEVELDBWRAPPER_H
@@ -8,10 +8,12 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilereader.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus.h"
+#include "crypto/common.h"
 #include "init.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -72,6 +74,10 @@ const uint32_t MAX_P2SH_SIGOPS = 15;
 const uint32_t MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 const uint32_t DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of memory the transaction memory pool uses */
+const uint32_t DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -persistmempool, whether the memory pool is saved at shutdown and loaded at startup */
+const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 const uint32_t MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -100,6 +106,8 @@ const uint32_t MAX_HEADERS_RESULTS = 2000;
 const uint32_t BLOCK_DOWNLOAD_WINDOW = 4096;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 const uint32_t DATABASE_WRITE_INTERVAL = 3600;
+/** Percentage of -dbcache's coin entries kept in memory after a background flush, as the working set. */
+const uint32_t COINS_CACHE_KEEP_PERCENT = 50;
 /** Maximum length of reject messages. */
 const uint32_t MAX_REJECT_MESSAGE_LENGTH = 111;
 
@@ -1042,8 +1050,8 @@ int64_t GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectInsaneFee)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectInsaneFee)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1145,7 +1153,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         int64_t nFees = nValueIn - nValueOut;
         double dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height());
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1183,6 +1191,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             dFreeCount += nSize;
         }
 
+        // A full pool asks for more than the relay fee, until blocks make room again
+        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+            return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                                      hash.ToString(), nFees, mempoolRejectFee),
+                             REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
         if (fRejectInsaneFee && nFees > ::minRelayTxFee.GetFee(nSize) * 10000)
             return error("AcceptToMemoryPool: : insane fees %s, %d > %d",
                          hash.ToString(),
@@ -1211,6 +1226,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // Make room for it, which may turn out to be the transaction itself
+        pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -1218,6 +1238,122 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return true;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fRejectInsaneFee)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fRejectInsaneFee);
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Transactions LoadMempool() accepts per hold of cs_main, so blocks and peers are not kept waiting
+static const unsigned int MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+bool LoadMempool()
+{
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    // Allowed to be missing, on the first startup and after one with -persistmempool=0
+    if (filein.IsNull())
+        return true;
+
+    int64_t nStart = GetTimeMillis();
+    unsigned int nAccepted = 0;
+    unsigned int nFailed = 0;
+    unsigned int nAlreadyThere = 0;
+    try {
+        uint64_t nVersion;
+        filein >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s : unknown version %d of %s", __func__, nVersion, path.string());
+        uint64_t nCount;
+        filein >> nCount;
+
+        while (nCount > 0) {
+            {
+                LOCK(cs_main);
+                for (unsigned int i = 0; i < MEMPOOL_LOAD_BATCH_SIZE && nCount > 0; i++, nCount--) {
+                    CTransaction tx;
+                    int64_t nTime;
+                    double dPriorityDelta;
+                    CAmount nFeeDelta;
+                    filein >> tx >> nTime >> dPriorityDelta >> nFeeDelta;
+
+                    uint256 hash = tx.GetHash();
+                    if (dPriorityDelta != 0 || nFeeDelta != 0)
+                        mempool.PrioritiseTransaction(hash, hash.ToString(), dPriorityDelta, nFeeDelta);
+                    CValidationState state;
+                    if (AcceptToMemoryPoolWithTime(mempool, state, tx, false, NULL, nTime))
+                        nAccepted++;
+                    else if (mempool.exists(hash))
+                        nAlreadyThere++;
+                    else
+                        nFailed++;
+                }
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+
+        // Deltas given to transactions that were not in the pool yet
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        filein >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); ++it)
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+    } catch (const std::exception& e) {
+        return error("%s : failed to deserialize %s: %s", __func__, path.string(), e.what());
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %u accepted, %u failed, %u already there  %dms\n", nAccepted, nFailed, nAlreadyThere, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    boost::filesystem::path pathNew = GetDataDir() / "mempool.dat.new";
+    try {
+        CAutoFile fileout(fopen(pathNew.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s : failed to open %s", __func__, pathNew.string());
+
+        unsigned int nCount;
+        {
+            LOCK(mempool.cs);
+            std::map<uint256, std::pair<double, CAmount> > mapDeltas = mempool.mapDeltas;
+            std::vector<CTxMemPool::txiter> vEntries;
+            vEntries.reserve(mempool.mapTx.size());
+            for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+                vEntries.push_back(it);
+            // Parents before children, or LoadMempool() would find the inputs of the children missing
+            std::sort(vEntries.begin(), vEntries.end(), CTxMemPool::CompareByAncestorCount());
+            nCount = vEntries.size();
+
+            fileout << MEMPOOL_DUMP_VERSION;
+            fileout << (uint64_t)vEntries.size();
+            BOOST_FOREACH(const CTxMemPool::txiter& it, vEntries) {
+                std::pair<double, CAmount> deltas(0.0, 0);
+                std::map<uint256, std::pair<double, CAmount> >::iterator pos = mapDeltas.find(it->first);
+                if (pos != mapDeltas.end()) {
+                    deltas = pos->second;
+                    mapDeltas.erase(pos);
+                }
+                fileout << it->second.GetTx() << it->second.GetTime() << deltas.first << deltas.second;
+            }
+            fileout << mapDeltas;
+        }
+
+        FileCommit(fileout.Get());
+        fileout.fclose();
+        if (!RenameOver(pathNew, path))
+            return error("%s : failed to rename %s", __func__, pathNew.string());
+        LogPrintf("Dumped %u mempool transactions to disk  %dms\n", nCount, GetTimeMillis() - nStart);
+    } catch (const std::exception& e) {
+        return error("%s : failed to dump %s: %s", __func__, path.string(), e.what());
+    }
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, uintFakeHash &hashBlock, bool fAllowSlow)
 {
@@ -1313,18 +1449,50 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
+//! The blk and rev files blocks and undo data are read from, kept open between reads
+static CBlockFileReader blockFileReader;
+
+/**
+ * Read the block or undo data WriteBlockToDisk() or CBlockUndo::WriteToDisk() stored at pos into vData, along with
+ * the nExtra bytes that follow it.  Both put the network magic and the size in front of what they write, a size
+ * over nMaxSize is refused before anything is allocated for it.
+ */
+template <typename T>
+static bool ReadDiskRecord(T& vData, const CDiskBlockPos& pos, const char* prefix, unsigned int nMaxSize, unsigned int nExtra)
+{
+    static const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return error("%s : No room for a header at position %u of %s%05u.dat", __func__, pos.nPos, prefix, pos.nFile);
+
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    unsigned char header[nHeaderSize];
+    if (!blockFileReader.Read(path, pos.nPos - nHeaderSize, (char*)header, nHeaderSize))
+        return false;
+    if (memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return error("%s : No header at position %u of %s%05u.dat", __func__, pos.nPos, prefix, pos.nFile);
+    unsigned int nSize = ReadLE32(header + MESSAGE_START_SIZE);
+    if (nSize > nMaxSize)
+        return error("%s : Size %u out of range at position %u of %s%05u.dat", __func__, nSize, pos.nPos, prefix, pos.nFile);
+
+    vData.resize(nSize + nExtra);
+    return vData.empty() || blockFileReader.Read(path, pos.nPos, (char*)&vData[0], vData.size());
+}
+
+void CloseBlockFiles()
+{
+    blockFileReader.CloseAll();
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    if (!ReadDiskRecord(ssBlock, pos, "blk", MAX_BLOCK_SIZE, 0))
+        return error("ReadBlockFromDisk : Reading the block failed");
 
-    // Read block
     try {
-        filein >> block;
+        ssBlock >> block;
     }
     catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -1333,12 +1501,23 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, bool fCheckPoW)
 {
 
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
 
+    // The proof-of-work was checked when the block was accepted, what is left to find out is whether the block read
+    // is the one the index refers to.  For that the sha256d hash the index keeps of every header will do, and serving
+    // old blocks to peers stays bound by the disk, not by scrypt.
+    if (pindex->GetBlockSha256dHash() != 0 && !fCheckPoW) {
+        uintFakeHash hashSha256d = block.CalcSha256dHash();
+        if (hashSha256d != pindex->GetBlockSha256dHash())
+            return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : header hash doesn't match index, (%s vs %s)",
+                            hashSha256d.ToString(), pindex->GetBlockSha256dHash().ToString());
+        return true;
+    }
+
     uint256 hash = block.GetHash();
 
     // Check the header POW
@@ -1353,6 +1532,30 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<char>& vBlock, const CBlockIndex* pindex)
+{
+    if (!ReadDiskRecord(vBlock, pindex->GetBlockPos(), "blk", MAX_BLOCK_SIZE, 0))
+        return error("ReadRawBlockFromDisk : Reading the block failed");
+    if (vBlock.size() < 80)
+        return error("ReadRawBlockFromDisk : Block of %u bytes is too short", vBlock.size());
+
+    //! The 80 bytes from nVersion to nNonce are what both the sha256d and the proof-of-work hash are taken of
+    if (pindex->GetBlockSha256dHash() != 0) {
+        uint256 hashSha256d = Hash(vBlock.begin(), vBlock.begin() + 80);
+        if (hashSha256d != pindex->GetBlockSha256dHash())
+            return error("ReadRawBlockFromDisk : header hash doesn't match index, (%s vs %s)",
+                            hashSha256d.ToString(), pindex->GetBlockSha256dHash().ToString());
+    } else {
+        CBlockHeader header;
+        CDataStream ssHeader(&vBlock[0], &vBlock[0] + vBlock.size(), SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+        if (header.GetHash() != pindex->GetBlockPowHash())
+            return error("ReadRawBlockFromDisk : GetHash() doesn't match index, (%s vs %s)",
+                            header.GetHash().ToString(), pindex->GetBlockPowHash().ToString());
+    }
+    return true;
+}
+
 bool IsInitialBlockDownload()
 {
     LOCK(cs_main);
@@ -1771,6 +1974,8 @@ void static FlushBlockFile(bool fFinalize = false)
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+//! ConnectBlock() hands script checks to the queue once it has collected this many, rather than a transaction at a time
+static const unsigned int SCRIPT_CHECK_SUBMIT_BATCH = 256;
 
 void ThreadScriptCheck() {
     RenameThread("anoncoin-scriptch");
@@ -1854,6 +2059,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    std::vector<CScriptCheck> vChecks;
+    vChecks.reserve(2 * SCRIPT_CHECK_SUBMIT_BATCH);
 
     int64_t nTimeStart = GetTimeMicros();
     int64_t nFees = 0;
@@ -1892,10 +2099,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             nFees += view.GetValueIn(tx)-tx.GetValueOut();
 
-            std::vector<CScriptCheck> vChecks;
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
-            control.Add(vChecks);
+            if (vChecks.size() >= SCRIPT_CHECK_SUBMIT_BATCH) {
+                control.Add(vChecks);
+                vChecks.clear();
+            }
         }
 
         CTxUndo undoDummy;
@@ -1907,6 +2116,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
+    control.Add(vChecks);
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
 
@@ -1973,6 +2183,198 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+/**
+ * Writes copies of the dirty coins in pcoinsTip to the coins database on a thread of its own, so that connecting
+ * blocks does not wait for the disk.  One write is in flight at a time, each as a single database batch so that
+ * the best block on disk always matches the coins there.  pcoinsTip keeps the written entries as clean ones, and is
+ * trimmed back to a working set of them only after the write has landed.
+ */
+class CCoinsFlusher
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    //! The copies waiting for the flusher thread, and the view they are to be written to
+    CCoinsMap mapPending;
+    uint256 hashPending;
+    CCoinsView* pviewPending;
+    bool fPending;
+    bool fWriting;
+    //! A write completed since pcoinsTip was last trimmed
+    bool fWritten;
+    bool fFailed;
+    bool fRunning;
+    CCoinsFlushStats stats;
+
+    //! Write a copy to the view, without holding cs
+    bool Write(CCoinsView* pview, CCoinsMap& mapDirty, const uint256& hashBlock)
+    {
+        int64_t nStart = GetTimeMicros();
+        size_t nEntries = mapDirty.size();
+        uint64_t nBytes = 0;
+        for (CCoinsMap::const_iterator it = mapDirty.begin(); it != mapDirty.end(); ++it) {
+            nBytes += 1 + sizeof(uint256);
+            if (!it->second.coins.IsPruned())
+                nBytes += ::GetSerializeSize(it->second.coins, SER_DISK, CLIENT_VERSION);
+        }
+        bool fOk = false;
+        try {
+            fOk = pview->BatchWrite(mapDirty, hashBlock);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+        int64_t nTime = GetTimeMicros() - nStart;
+        LogPrint("coindb", "Wrote %u coins (%u bytes) to the coin database in %.2fms\n", (unsigned int)nEntries, nBytes, nTime * 0.001);
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nFlushes++;
+        stats.nEntriesWritten += nEntries;
+        stats.nLastBytes = nBytes;
+        stats.nBytesWritten += nBytes;
+        stats.nLastFlushMicros = nTime;
+        stats.nMaxFlushMicros = std::max(stats.nMaxFlushMicros, nTime);
+        if (!fOk)
+            fFailed = true;
+        fWritten = true;
+        return fOk;
+    }
+
+public:
+    CCoinsFlusher() : pviewPending(NULL), fPending(false), fWriting(false), fWritten(false), fFailed(false), fRunning(false) {}
+
+    //! Whether a copy is waiting or being written
+    bool IsBusy()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return fPending || fWriting;
+    }
+
+    bool HasFailed()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return fFailed;
+    }
+
+    /**
+     * Copy the dirty coins of the cache for the flusher thread to write, or write them right away if it is not
+     * running.  The flusher must not be busy, cs_main must be held.
+     */
+    bool Start(CCoinsViewCache* pcoins)
+    {
+        AssertLockHeld(cs_main);
+        int64_t nStart = GetTimeMicros();
+        CCoinsMap mapDirty;
+        uint256 hashBlock = pcoins->CopyDirtyCoins(mapDirty);
+        CCoinsView* pview = pcoins->GetBackend();
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            assert(!fPending && !fWriting);
+            stats.nLastCopyMicros = GetTimeMicros() - nStart;
+            if (fRunning) {
+                mapPending.swap(mapDirty);
+                hashPending = hashBlock;
+                pviewPending = pview;
+                fPending = true;
+                cond.notify_all();
+                return true;
+            }
+        }
+        return Write(pview, mapDirty, hashBlock);
+    }
+
+    /**
+     * Wait for the write in flight, and write a copy the flusher thread did not pick up yet in the calling thread,
+     * so that nothing is left to land on disk after what the caller writes next.  Returns false if a write failed.
+     */
+    bool Wait()
+    {
+        CCoinsMap mapDirty;
+        uint256 hashBlock;
+        CCoinsView* pview = NULL;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (fWriting)
+                cond.wait(lock);
+            if (!fPending)
+                return !fFailed;
+            mapDirty.swap(mapPending);
+            hashBlock = hashPending;
+            pview = pviewPending;
+            fPending = false;
+        }
+        return Write(pview, mapDirty, hashBlock);
+    }
+
+    /** Trim the cache to nTarget entries if a write landed since the last time.  cs_main must be held. */
+    void Trim(CCoinsViewCache* pcoins, size_t nTarget)
+    {
+        AssertLockHeld(cs_main);
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (!fWritten || fPending || fWriting)
+                return;
+            fWritten = false;
+        }
+        size_t nEvicted = pcoins->EvictClean(nTarget);
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nEvicted += nEvicted;
+    }
+
+    void GetStats(CCoinsFlushStats& statsOut)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        statsOut = stats;
+        statsOut.fInFlight = fPending || fWriting;
+    }
+
+    void Thread()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fRunning = true;
+        }
+        try {
+            while (true) {
+                CCoinsMap mapDirty;
+                uint256 hashBlock;
+                CCoinsView* pview;
+                {
+                    boost::unique_lock<boost::mutex> lock(cs);
+                    while (!fPending)
+                        cond.wait(lock);
+                    mapDirty.swap(mapPending);
+                    hashBlock = hashPending;
+                    pview = pviewPending;
+                    fPending = false;
+                    fWriting = true;
+                }
+                Write(pview, mapDirty, hashBlock);
+                boost::unique_lock<boost::mutex> lock(cs);
+                fWriting = false;
+                cond.notify_all();
+            }
+        } catch (const boost::thread_interrupted&) {
+            // Whatever is still pending is written by the final FlushStateToDisk() at shutdown
+            boost::unique_lock<boost::mutex> lock(cs);
+            fRunning = false;
+            throw;
+        }
+    }
+};
+
+static CCoinsFlusher coinsFlusher;
+
+void ThreadFlushCoins()
+{
+    RenameThread("anoncoin-coinsflush");
+    coinsFlusher.Thread();
+}
+
+void GetCoinsFlushStats(CCoinsFlushStats& stats)
+{
+    coinsFlusher.GetStats(stats);
+}
+
 enum FlushStateMode {
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
@@ -1982,15 +2384,31 @@ enum FlushStateMode {
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
- * fast is not set and it's been a while since the last write.
+ * fast is not set and it's been a while since the last write.  Only a forced write waits for
+ * the coins, otherwise their dirty entries are handed to the coins flusher thread and the
+ * cache keeps a working set of clean ones.
  */
 bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
     try {
+    if (coinsFlusher.HasFailed())
+        return state.Abort("Failed to write to coin database");
+    // Once a write has landed, the entries it wrote can be dropped to bring the cache back down
+    coinsFlusher.Trim(pcoinsTip, nCoinCacheSize * COINS_CACHE_KEEP_PERCENT / 100);
+    bool fCacheFull = pcoinsTip->GetCacheSize() > nCoinCacheSize;
     if ((mode == FLUSH_STATE_ALWAYS) ||
-        ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+        ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && fCacheFull) ||
         (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
+        if (mode != FLUSH_STATE_ALWAYS && coinsFlusher.IsBusy()) {
+            // Only wait for the write in flight once the cache has outgrown its limit by far
+            if (pcoinsTip->GetCacheSize() <= 2 * nCoinCacheSize)
+                return true;
+            LogPrint("coindb", "%s : waiting for the coin database write in flight\n", __func__);
+        }
+        if (!coinsFlusher.Wait())
+            return state.Abort("Failed to write to coin database");
+        coinsFlusher.Trim(pcoinsTip, nCoinCacheSize * COINS_CACHE_KEEP_PERCENT / 100);
         // Typical CCoins structures on disk are around 100 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
@@ -2020,8 +2438,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         }
         pblocktree->Sync();
         // Finally flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        if (mode == FLUSH_STATE_ALWAYS) {
+            if (!pcoinsTip->Flush())
+                return state.Abort("Failed to write to coin database");
+        } else if (!coinsFlusher.Start(pcoinsTip)) {
             return state.Abort("Failed to write to coin database");
+        }
         // Update best block in wallet (so we can detect restored wallets).
         if (mode != FLUSH_STATE_IF_NEEDED) {
             g_signals.SetBestChain(chainActive.GetLocator());
@@ -2984,8 +3406,44 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 #endif
+//! Fewest block index entries worth a hashing thread of their own when loading the index
+static const uint32_t nMinBlockIndexShard = 10000;
+
+//! Rebuilds the header of a block tree entry, as loaded its fakeBIhash field holds the sha256d hash of the previous block
+static void GetLoadedBlockHeader(const BlockTreeEntry& entry, CBlockHeader& header)
+{
+    const CBlockIndex* pindex = entry.pBlockIndex;
+    //! ONLY the Genesis block should not have a previous hash
+    assert( pindex->fakeBIhash != 0 || pindex->nHeight == 0 );
+    header.nVersion        = pindex->nVersion;
+    header.hashPrevBlock   = pindex->fakeBIhash;
+    header.hashMerkleRoot  = pindex->hashMerkleRoot;
+    header.nTime           = pindex->nTime;
+    header.nBits           = pindex->nBits;
+    header.nNonce          = pindex->nNonce;
+    header.nHeight         = pindex->nHeight;
+}
+
+//! Sets up the sha256d hashes of the block tree entries [nBegin, nEnd), each thread loading the index works on its own shard.
+//! Only entries stored without their hash need it calculated.  A shard is left unfinished if shutdown is requested.
+static void CalcLoadedBlockHashes(const vector<BlockTreeEntry>& vEntries, uint32_t nBegin, uint32_t nEnd, vector<uintFakeHash>& vFakeHashes)
+{
+    CBlockHeader aHeader;
+    for( uint32_t i = nBegin; i < nEnd; i++ ) {
+        if( (i - nBegin) % 4096 == 0 && ShutdownRequested() )
+            return;
+        if( vEntries[i].sha256dHash != 0 ) {
+            vFakeHashes[i] = vEntries[i].sha256dHash;
+            continue;
+        }
+        GetLoadedBlockHeader( vEntries[i], aHeader );
+        vFakeHashes[i] = aHeader.CalcSha256dHash();
+    }
+}
+
 bool static LoadBlockIndexDB()
 {
+    int64_t nLoadStartTime = GetTimeMillis();
     //! Load the blockindex guts & build a vector of blockindex pointers sorted by height...
     vector<BlockTreeEntry> vSortedByHeight;
     if( !pblocktree->LoadBlockIndexGuts( vSortedByHeight ) )
@@ -3011,80 +3469,78 @@ bool static LoadBlockIndexDB()
     //! Now with minimal time complexity we can finally build the cross reference index,
     //! initialize the mapBlockIndex and CBlockIndex structure pointers and values.
     //! We already have the previous block sha256d hashes stored in childern object(s) temporarily
-    //! First we must calculate the sha256d hash and scrypt hash of every block to build our
-    //! crossreference map, then we can lookup the fake sha256d hashes for every block, to set
-    //! its previous block pointer to correctly, in the 2nd pass
+    //! First we must calculate the sha256d hash of every block to build our crossreference map,
+    //! then we can lookup the fake sha256d hashes for every block, to set its previous block
+    //! pointer to correctly, in the 2nd pass.  The sha256d hashes are calculated in shards, one
+    //! per core, while another thread double checks the proof-of-work for the 1st 100 blocks and
+    //! the last 1000, in batches so the multi-lane scrypt engine can be used on the older headers.
+    //! Block tree entries written by this version store the sha256d hash as well, then nothing needs calculating
+    //! here and the hashes are verified as the previous block pointers are set up, each one has to match the
+    //! previous block hash of the following block.
+    uiInterface.InitMessage(_("Building cross reference..."));
     uint32_t nHeight = 0;
-    CBlockHeader aHeader;                                           //! Setup a temp header here to work in the loop with
-    //! Best to dynamically allocate some temporary arrays (vectors) to finish things up quick on the 2nd pass...
-    vector<uintFakeHash> vFakeHashes;
-    vFakeHashes.reserve( nBIsize );
-    mapBlockHashCrossReference.reserve( nBIsize );                  //! Pre-allocate the number of entries
-    bool fDoubleCheckingHash = true;
-    //! Better tell the user, this takes awhile
-    uint64_t nStartTime = GetTime() - 16;
-    uint8_t msgcnt = 0;
-    BOOST_FOREACH(const BlockTreeEntry& entry, vSortedByHeight) {
-        CBlockIndex* pindex = entry.pBlockIndex;
-        //! ONLY the Genesis block should not have a previous hash
-        assert( pindex->fakeBIhash != 0 || pindex->nHeight == 0 );
-        aHeader.nVersion        = pindex->nVersion;
-        aHeader.hashPrevBlock   = pindex->fakeBIhash; //! Temporarily stored the prev block sha256d hash here
-        aHeader.hashMerkleRoot  = pindex->hashMerkleRoot;
-        aHeader.nTime           = pindex->nTime;
-        aHeader.nBits           = pindex->nBits;
-        aHeader.nNonce          = pindex->nNonce;
-        aHeader.nHeight         = pindex->nHeight;
-
-
-        
-        //! Calling GetHash & CalcSha256dHash with true, invalidates any previously calculated hashes for this block, as they have changed
-        uintFakeHash aFakeHash  = aHeader.CalcSha256dHash();    //! Calculate the sha256d hash, even for the genesis block
-
-        uint256 aRealHash;
-
-        if( fDoubleCheckingHash ) {
-            aRealHash = aHeader.GetHash();              //! Calc the real scrypt hash of this block.
-            if( nHeight > 100 )                             //! Stop checking if things have been ok after the 1st 100 blocks
-                fDoubleCheckingHash = false;
-        } else if( nHeight > nBIsize - 1000 ) {   
-                                                                  //! Turn it back on for the last 1000 blocks
-            aRealHash = aHeader.GetHash();              //! Calc the real scrypt hash of this block.
-        } else {
-            aRealHash = entry.uintRealHash;  
-        }
-            
-        if( aRealHash != entry.uintRealHash ) {
-            LogPrintf( "%s : ERROR - at Block %d, the Real Hash is not the same as being reported by the BlockTreeDB key, recommend a reindex.\n", __func__, nHeight );
-                StartShutdown();
-        }
-
-        vFakeHashes[nHeight++] = aFakeHash; //! Save it for later on the 2nd pass
-        aFakeHash.SetRealHash( aRealHash ); //! Update our cross reference unordered fast hash lookup map
-//      if( GetTime() - nStartTime  > 15 ) {
-        if( GetTime() - nStartTime > 1 ) {
-            switch( msgcnt++ ) {
-                case 0 : uiInterface.InitMessage(_("Building cross reference...")); break;
-                case 1 : uiInterface.InitMessage(_("Checking proof-of-work too...")); msgcnt = 0; break;
-/*                case 1 : uiInterface.InitMessage(_("Please be patient...")); break;
-                case 2 : uiInterface.InitMessage(_("Checking proof-of-work too...")); break;
-                case 3 : uiInterface.InitMessage(_("Anoncoin for the 1st time...")); break;
-                case 4 : uiInterface.InitMessage(_("Will use real block hashes...")); break;
-                case 5 : uiInterface.InitMessage(_("Each block has 2 identities...")); break;
-                case 6 : uiInterface.InitMessage(_("A mined hash & sha256d hash...")); msgcnt = 0; break; */
-            }
-            nStartTime = GetTime();
-            boost::this_thread::interruption_point();//! If there is other stuff to do, now would be a good time
-       }
-        if(ShutdownRequested()) {                   //! Watch out for and respond to any shutdown signal
-            vSortedByHeight.clear();                //! Although not really needed, cleaning up the vectors in use
-                                                    //! is good programming practice & helps to understand what
-            vFakeHashes.clear();                    //! variables the code has been working on.
-            //! Don't really need to worry about the thread priority, as this is all about to be over anyway
-            return false;
+    uint32_t nStoredHashes = 0;
+    vector<uintFakeHash> vFakeHashes( nBIsize );
+    vector<uint32_t> vCheckEntries;
+    vector<CBlockHeader> vCheckHeaders;
+    vector<uint256> vCheckCalcHashes;
+    for( nHeight = 0; nHeight < nBIsize; nHeight++ ) {
+        if( vSortedByHeight[nHeight].sha256dHash != 0 )
+            nStoredHashes++;
+        if( nHeight <= 101 || nHeight + 1000 > nBIsize ) {
+            vCheckEntries.push_back( nHeight );
+            vCheckHeaders.push_back( CBlockHeader() );
+            GetLoadedBlockHeader( vSortedByHeight[nHeight], vCheckHeaders.back() );
+        }
+    }
+
+    uint32_t nHashThreads = std::max( (int)boost::thread::hardware_concurrency(), 1 );
+    nHashThreads = std::min( nHashThreads, (uint32_t)MAX_SCRIPTCHECK_THREADS );
+    nHashThreads = std::max( std::min( nHashThreads, nBIsize / nMinBlockIndexShard ), (uint32_t)1 );
+    {
+        boost::thread_group threadGroup;
+        threadGroup.create_thread( boost::bind( &CBlockHeader::GetHashes, boost::cref(vCheckHeaders), boost::ref(vCheckCalcHashes) ) );
+        //! This thread takes the last shard itself
+        const uint32_t nShardSize = nBIsize / nHashThreads;
+        for( uint32_t i = 0; i + 1 < nHashThreads; i++ )
+            threadGroup.create_thread( boost::bind( &CalcLoadedBlockHashes, boost::cref(vSortedByHeight), i * nShardSize, (i + 1) * nShardSize, boost::ref(vFakeHashes) ) );
+        CalcLoadedBlockHashes( vSortedByHeight, (nHashThreads - 1) * nShardSize, nBIsize, vFakeHashes );
+        uiInterface.InitMessage(_("Checking proof-of-work too..."));
+        threadGroup.join_all();
+    }
+    if(ShutdownRequested()) {                       //! The shards may be unfinished, nothing below can be checked
+        vSortedByHeight.clear();
+        vFakeHashes.clear();
+        return false;
+    }
+    for( size_t i = 0; i < vCheckHeaders.size(); i++ ) {
+        if( vCheckCalcHashes[i] != vSortedByHeight[vCheckEntries[i]].uintRealHash ) {
+            LogPrintf( "%s : ERROR - at Block %d, the Real Hash is not the same as being reported by the BlockTreeDB key, recommend a reindex.\n", __func__, vCheckHeaders[i].nHeight );
+            StartShutdown();
+        }
+        if( vCheckHeaders[i].CalcSha256dHash() != vFakeHashes[vCheckEntries[i]] ) {
+            LogPrintf( "%s : ERROR - at Block %d, the sha256d hash stored in the BlockTreeDB is wrong, recommend a reindex.\n", __func__, vCheckHeaders[i].nHeight );
+            StartShutdown();
         }
     }
-    LogPrintf( "%s : Cross referenced %s block sha256d hashes, using real proof-of-work for the index.\n", __func__, mapBlockHashCrossReference.size() );
+    //! Entries from before the sha256d hash was stored get written again, with it, on the next flush
+    if( nStoredHashes < nBIsize ) {
+        for( nHeight = 0; nHeight < nBIsize; nHeight++ )
+            if( vSortedByHeight[nHeight].sha256dHash == 0 )
+                setDirtyBlockIndex.insert( vSortedByHeight[nHeight].pBlockIndex );
+    }
+    if(ShutdownRequested()) {                       //! Watch out for and respond to any shutdown signal
+        vSortedByHeight.clear();
+        vFakeHashes.clear();
+        return false;
+    }
+    boost::this_thread::interruption_point();       //! If there is other stuff to do, now would be a good time
+
+    //! With every hash known the cross reference map is filled in one go, it was pre-sized for all of them
+    mapBlockHashCrossReference.reserve( nBIsize );
+    for( nHeight = 0; nHeight < nBIsize; nHeight++ )
+        mapBlockHashCrossReference.insert( make_pair( vFakeHashes[nHeight], vSortedByHeight[nHeight].uintRealHash ) );
+    LogPrintf( "%s : Cross referenced %s block sha256d hashes (%u read from disk), using real proof-of-work for the index.\n", __func__, mapBlockHashCrossReference.size(), nStoredHashes );
     uiInterface.InitMessage(_("Finishing block index setup..."));
 
     //! Now that is finally done, we can build the main softwares mapBlockIndex and fix the BlockIndex
@@ -3105,7 +3561,9 @@ bool static LoadBlockIndexDB()
             uint256 aRealHash = pindex->fakeBIhash.GetRealHash();
             BlockMap::iterator mi2 = ( aRealHash != 0 ) ? mapBlockIndex.find( aRealHash ) : mapBlockIndex.end();
             //LogPrintf( "fakeBIhash: %s aRealHash: %s  mi2 at end? %s Height=%d\n", pindex->fakeBIhash.ToString(), aRealHash.ToString(), (mi2 == mapBlockIndex.end()) ? "yes" : "no", pindex->nHeight );
-            assert(mi2 != mapBlockIndex.end());
+            //! With the sha256d hashes read from disk, this is where a bad one shows up
+            if( mi2 == mapBlockIndex.end() )
+                return error( "%s : The previous block of %s at height %d is not in the index, recommend a reindex.", __func__, entry.uintRealHash.ToString(), entry.nHeight );
             pindex->pprev = (*mi2).second;
         }
         //! Finally we can wipe out the previous blocks fake hash that was stored here temporarily
@@ -3116,6 +3574,8 @@ bool static LoadBlockIndexDB()
     vFakeHashes.clear();
     SetThreadPriority(THREAD_PRIORITY_NORMAL);      //! Return to normal processing priority, the hard work has been finished
     LogPrintf( "%s : Completed building the BlockIndex map with %d real proof-of-work hashes.\n", __func__, mapBlockIndex.size() );
+    double dLoadSeconds = (GetTimeMillis() - nLoadStartTime) * 0.001;
+    LogPrintf( "%s : Loaded %u headers in %.3fs, %.3fs per million headers, using %u sha256d hashing threads.\n", __func__, nBIsize, dLoadSeconds, dLoadSeconds * 1000000.0 / nBIsize, nHashThreads );
 
     //! Another day, another pass...returning to the standard coding...
     //! Calculate nChainWork
@@ -3251,8 +3711,8 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth)
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
         CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
+        // check level 0: read from disk, with the proof-of-work hash
+        if (!ReadBlockFromDisk(block, pindex, true))
             return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
 
         if( block.nVersion < 2 ) {
@@ -3309,7 +3769,7 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth)
             uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))));
             pindex = chainActive.Next(pindex);
             CBlock block;
-            if (!ReadBlockFromDisk(block, pindex))
+            if (!ReadBlockFromDisk(block, pindex, true))
                 return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             if (!ConnectBlock(block, state, pindex, coins))
                 return error("VerifyDB() : *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -3413,6 +3873,7 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
+    AdviseSequentialRead(fileIn);
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
@@ -3813,12 +4274,14 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 if (send)
                 {
-                    // Send block from disk
+                    // Send block from disk, a whole block goes out as the bytes it is stored as
+                    std::vector<char> vBlock;
                     CBlock block;
-                    ReadBlockFromDisk(block, (*mi).second);
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_BLOCK) {
+                        if (ReadRawBlockFromDisk(vBlock, (*mi).second))
+                            pfrom->PushMessage("block", CFlatData(vBlock));
+                    }
+                    else if (ReadBlockFromDisk(block, (*mi).second)) // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
@@ -5525,16 +5988,15 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos &pos, const uint256 &hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+    // Read the undo data and the checksum behind it
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    if (!ReadDiskRecord(ssUndo, pos, "rev", MAX_SIZE, sizeof(uint256)))
+        return error("CBlockUndo::ReadFromDisk : Reading the undo data failed");
 
-    // Read block
     uint256 hashChecksum;
     try {
-        filein >> *this;
-        filein >> hashChecksum;
+        ssUndo >> *this;
+        ssUndo >> hashChecksum;
     }
     catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -63,6 +63,10 @@ extern const uint32_t MAX_P2SH_SIGOPS;
 extern const uint32_t MAX_TX_SIGOPS;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 extern const uint32_t DEFAULT_MAX_ORPHAN_TRANSACTIONS;
+/** Default for -maxmempool, maximum megabytes of memory the transaction memory pool uses */
+extern const uint32_t DEFAULT_MAX_MEMPOOL_SIZE;
+/** Default for -persistmempool, whether the memory pool is saved at shutdown and loaded at startup */
+extern const bool DEFAULT_PERSIST_MEMPOOL;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 extern const uint32_t MAX_BLOCKFILE_SIZE;
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -91,6 +95,8 @@ extern const uint32_t MAX_HEADERS_RESULTS;
 extern const uint32_t BLOCK_DOWNLOAD_WINDOW;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 extern const uint32_t DATABASE_WRITE_INTERVAL;
+/** Percentage of the coins cache limit kept in memory after a background flush. */
+extern const uint32_t COINS_CACHE_KEEP_PERCENT;
 /** Maximum length of reject messages. */
 extern const uint32_t MAX_REJECT_MESSAGE_LENGTH;
 /** Minimum disk space required - used in CheckDiskSpace() */
@@ -215,11 +221,40 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Write the dirty coins handed over by FlushStateToDisk() to the coin database, in the background */
+void ThreadFlushCoins();
+
+/** Counters of the background coins flushes */
+struct CCoinsFlushStats
+{
+    uint64_t nFlushes;
+    uint64_t nEntriesWritten;
+    uint64_t nBytesWritten;
+    uint64_t nLastBytes;
+    int64_t nLastFlushMicros;
+    int64_t nMaxFlushMicros;
+    //! Time cs_main was held to copy the dirty entries for the last flush
+    int64_t nLastCopyMicros;
+    uint64_t nEvicted;
+    bool fInFlight;
+
+    CCoinsFlushStats() : nFlushes(0), nEntriesWritten(0), nBytesWritten(0), nLastBytes(0), nLastFlushMicros(0),
+                         nMaxFlushMicros(0), nLastCopyMicros(0), nEvicted(0), fInFlight(false) {}
+};
+void GetCoinsFlushStats(CCoinsFlushStats& stats);
 
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectInsaneFee=false);
+/** (try to) add transaction to memory pool, as if it arrived at nAcceptTime **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectInsaneFee=false);
+
+/** Load the memory pool from disk, handing it to AcceptToMemoryPool in batches.  False if the dump could not be read. */
+bool LoadMempool();
+/** Dump the memory pool to disk, with the entry times and PrioritiseTransaction() deltas */
+bool DumpMempool();
 
 
 struct CNodeStateStats {
@@ -371,7 +406,14 @@ public:
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the block of pindex, and check it is the one the index refers to by the sha256d hash of its header.  With
+ *  fCheckPoW its proof-of-work hash is calculated and checked as well, which costs a scrypt or GOST hash. */
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, bool fCheckPoW = false);
+/** Read the block of pindex as it is serialized on disk, which is also how the network and the rest interface send
+ *  it, without deserializing it.  The header is checked against the index as ReadBlockFromDisk() does. */
+bool ReadRawBlockFromDisk(std::vector<char>& vBlock, const CBlockIndex* pindex);
+/** Close the blk and rev files kept open for reading blocks and undo data */
+void CloseBlockFiles();
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -32,7 +32,6 @@
 #include <boost/foreach.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 #include <boost/unordered_map.hpp>
 
 //! Used to initialize the scrypt mining hash buffers
@@ -50,58 +49,184 @@ uint64_t nLastBlockSize = 0;
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// transactions in the memory pool.  The mempool keeps each entry's in-mempool
+// ancestors, and orders entries by the fee rate of the package they form with
+// these, so CreateNewBlock() takes whole packages, parents first, from the top
+// of that order.  Once part of a package is in the block, what is left of it is
+// tracked in a CModifiedPackages, which only ever holds descendants of
+// transactions already taken, so assembling a block costs in proportion to the
+// block, not to the memory pool.
 //
-class COrphan
+
+//! The block being assembled
+struct CBlockAssembly
+{
+    CBlockTemplate* pblocktemplate;
+    CCoinsViewCache* pview;
+    int nHeight;
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    int nBlockSigOps;
+    CAmount nFees;
+    CTxMemPool::setEntries setInBlock;
+    bool fPrintPriority;
+};
+
+//! The packages of entries with ancestors already in the block, without those ancestors
+class CModifiedPackages
 {
+private:
+    typedef std::pair<uint64_t, CAmount> Package;
+    std::map<CTxMemPool::txiter, Package, CTxMemPool::CompareIteratorByHash> mapPackage;
+
+    struct CompareByFeeRate
+    {
+        const CModifiedPackages* pthis;
+        CompareByFeeRate(const CModifiedPackages* pthisIn) : pthis(pthisIn) {}
+        bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+        {
+            const Package& pa = pthis->mapPackage.find(a)->second;
+            const Package& pb = pthis->mapPackage.find(b)->second;
+            double f1 = (double)pa.second * pb.first;
+            double f2 = (double)pb.second * pa.first;
+            if (f1 == f2)
+                return a->first < b->first;
+            return f1 > f2;
+        }
+    };
+    std::set<CTxMemPool::txiter, CompareByFeeRate> setByFeeRate;
+
 public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
+    CModifiedPackages() : setByFeeRate(CompareByFeeRate(this)) {}
+
+    bool empty() const { return setByFeeRate.empty(); }
+    bool count(CTxMemPool::txiter it) const { return mapPackage.count(it) != 0; }
+    CTxMemPool::txiter top() const { return *setByFeeRate.begin(); }
+    uint64_t GetSize(CTxMemPool::txiter it) const { return mapPackage.find(it)->second.first; }
+    CAmount GetFees(CTxMemPool::txiter it) const { return mapPackage.find(it)->second.second; }
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+    //! Takes an ancestor now in the block out of the package of it
+    void RemoveAncestor(CTxMemPool::txiter it, CTxMemPool::txiter ancestor)
     {
+        std::map<CTxMemPool::txiter, Package, CTxMemPool::CompareIteratorByHash>::iterator mi = mapPackage.find(it);
+        if (mi == mapPackage.end())
+            mi = mapPackage.insert(std::make_pair(it, Package(it->second.GetSizeWithAncestors(), it->second.GetModFeesWithAncestors()))).first;
+        else
+            setByFeeRate.erase(it);
+        mi->second.first -= ancestor->second.GetTxSize();
+        mi->second.second -= ancestor->second.GetModifiedFee();
+        setByFeeRate.insert(it);
+    }
+
+    void erase(CTxMemPool::txiter it)
+    {
+        if (mapPackage.count(it)) {
+            setByFeeRate.erase(it);
+            mapPackage.erase(it);
+        }
     }
 
-    void print() const
+    //! Whether the package of a beats that of the mempool entry b, which has none of its ancestors in the block
+    bool Beats(CTxMemPool::txiter a, CTxMemPool::txiter b) const
     {
-        LogPrintf("COrphan(hash=%s, dPriority=%.1f, FeePerKb=%d)\n",
-               ptx->GetHash().ToString(), dPriority, feeRate.GetFeePerK());
-        BOOST_FOREACH(uint256 hash, setDependsOn)
-            LogPrintf("   setDependsOn %s\n", hash.ToString());
+        const Package& pa = mapPackage.find(a)->second;
+        double f1 = (double)pa.second * b->second.GetSizeWithAncestors();
+        double f2 = (double)b->second.GetModFeesWithAncestors() * pa.first;
+        if (f1 == f2)
+            return a->first < b->first;
+        return f1 > f2;
     }
 };
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
+//! Takes transactions just added to the block out of the packages of their descendants
+static void UpdatePackagesForAdded(const CBlockAssembly& assembly, CModifiedPackages& modified, const std::vector<CTxMemPool::txiter>& vAdded)
 {
-    bool byFee;
-
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) { }
-
-    bool operator()(const TxPriority& a, const TxPriority& b)
+    BOOST_FOREACH(const CTxMemPool::txiter& added, vAdded)
     {
-        if (byFee)
+        modified.erase(added);
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(added, setDescendants);
+        BOOST_FOREACH(const CTxMemPool::txiter& descendant, setDescendants)
         {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
+            if (!assembly.setInBlock.count(descendant))
+                modified.RemoveAncestor(descendant, added);
         }
-        else
+    }
+}
+
+/**
+ * Adds the transactions of a package, parents first, if all of them fit and are valid in the
+ * block.  The size, sigop and script checks are still done for each, as the mempool is
+ * trusted to order transactions, not to only hold valid ones.
+ */
+static bool AddPackage(CBlockAssembly& assembly, const std::vector<CTxMemPool::txiter>& vPackage, unsigned int nBlockMaxSize)
+{
+    CCoinsViewCache viewPackage(assembly.pview);
+    uint64_t nPackageSize = 0;
+    int nPackageSigOps = 0;
+    std::vector<CAmount> vTxFees;
+    std::vector<int> vTxSigOps;
+    BOOST_FOREACH(const CTxMemPool::txiter& it, vPackage)
+    {
+        const CTransaction& tx = it->second.GetTx();
+        if (tx.IsCoinBase() || !IsFinalTx(tx, assembly.nHeight))
+            return false;
+
+        // Size limits
+        unsigned int nTxSize = it->second.GetTxSize();
+        if (assembly.nBlockSize + nPackageSize + nTxSize >= nBlockMaxSize)
+            return false;
+
+        // Legacy limits on sigOps:
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        if (assembly.nBlockSigOps + nPackageSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            return false;
+
+        if (!viewPackage.HaveInputs(tx))
+            return false;
+
+        CAmount nTxFees = viewPackage.GetValueIn(tx)-tx.GetValueOut();
+
+        nTxSigOps += GetP2SHSigOpCount(tx, viewPackage);
+        if (assembly.nBlockSigOps + nPackageSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            return false;
+
+        // Note that flags: we don't want to set mempool/IsStandard()
+        // policy here, but we still have to ensure that the block we
+        // create only contains transactions that are valid in new blocks.
+        CValidationState state;
+        if (!CheckInputs(tx, state, viewPackage, true, SCRIPT_VERIFY_P2SH, true))
+            return false;
+
+        UpdateCoins(tx, state, viewPackage, assembly.nHeight);
+        nPackageSize += nTxSize;
+        nPackageSigOps += nTxSigOps;
+        vTxFees.push_back(nTxFees);
+        vTxSigOps.push_back(nTxSigOps);
+    }
+    viewPackage.Flush();
+
+    // Added
+    for (unsigned int i = 0; i < vPackage.size(); i++)
+    {
+        const CTransaction& tx = vPackage[i]->second.GetTx();
+        assembly.pblocktemplate->block.vtx.push_back(tx);
+        assembly.pblocktemplate->vTxFees.push_back(vTxFees[i]);
+        assembly.pblocktemplate->vTxSigOps.push_back(vTxSigOps[i]);
+        assembly.setInBlock.insert(vPackage[i]);
+        assembly.nBlockSize += vPackage[i]->second.GetTxSize();
+        ++assembly.nBlockTx;
+        assembly.nBlockSigOps += vTxSigOps[i];
+        assembly.nFees += vTxFees[i];
+
+        if (assembly.fPrintPriority)
         {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                mempool.GetModifiedPriority(vPackage[i], assembly.nHeight), CFeeRate(vTxFees[i], vPackage[i]->second.GetTxSize()).ToString(), tx.GetHash().ToString());
         }
     }
-};
+    return true;
+}
 
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
@@ -158,182 +283,108 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);                    // Create an empty coin cache view, based on the main pcoinsTip cache
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi)
+        CBlockAssembly assembly;
+        assembly.pblocktemplate = pblocktemplate.get();
+        assembly.pview = &view;
+        assembly.nHeight = nHeight;
+        assembly.nBlockSize = 1000;
+        assembly.nBlockTx = 0;
+        assembly.nBlockSigOps = 100;
+        assembly.nFees = 0;
+        assembly.fPrintPriority = GetBoolArg("-printpriority", false);
+
+        CModifiedPackages modified;
+
+        // High priority transactions first, included regardless of the fees they pay.  The mempool
+        // orders them at the height after the last block it saw connected, while whether they are
+        // free enough is decided at the height of this block.  Children wait for the fee rate pass.
+        for (std::set<std::pair<double, CTxMemPool::txiter>, CTxMemPool::CompareByPriority>::iterator pi = mempool.setByPriority.begin();
+             pi != mempool.setByPriority.end() && assembly.nBlockSize < nBlockPrioritySize; ++pi)
         {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight))
+            CTxMemPool::txiter it = pi->second;
+            if (!AllowFree(pi->first) || !AllowFree(mempool.GetModifiedPriority(it, nHeight)))
+                break;
+            if (assembly.nBlockSize + it->second.GetTxSize() >= nBlockPrioritySize)
+                break;
+            if (!mempool.GetMemPoolParents(it).empty())
                 continue;
+            std::vector<CTxMemPool::txiter> vPackage(1, it);
+            if (AddPackage(assembly, vPackage, nBlockMaxSize))
+                UpdatePackagesForAdded(assembly, modified, vPackage);
+        }
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        // Then packages by fee rate
+        static const int MAX_CONSECUTIVE_FAILURES = 1000;
+        int nConsecutiveFailed = 0;
+        CTxMemPool::setEntries setFailed;
+        std::set<CTxMemPool::txiter, CTxMemPool::CompareByAncestorFeeRate>::iterator mi = mempool.setByAncestorFeeRate.begin();
+        while (mi != mempool.setByAncestorFeeRate.end() || !modified.empty())
+        {
+            // Entries with ancestors in the block are taken from modified instead
+            if (mi != mempool.setByAncestorFeeRate.end() &&
+                (assembly.setInBlock.count(*mi) || setFailed.count(*mi) || modified.count(*mi)))
             {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash))
-                {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash))
-                    {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan)
-                    {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
+                ++mi;
+                continue;
             }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
 
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn-tx.GetValueOut(), nTxSize);
-
-            if (porphan)
+            CTxMemPool::txiter it;
+            uint64_t nPackageSize;
+            CAmount nPackageFees;
+            if (mi == mempool.setByAncestorFeeRate.end() || (!modified.empty() && modified.Beats(modified.top(), *mi)))
             {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
+                it = modified.top();
+                nPackageSize = modified.GetSize(it);
+                nPackageFees = modified.GetFees(it);
+                modified.erase(it);
             }
             else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty())
-        {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
             {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                it = *mi;
+                ++mi;
+                nPackageSize = it->second.GetSizeWithAncestors();
+                nPackageFees = it->second.GetModFeesWithAncestors();
             }
 
-            if (!view.HaveInputs(tx))
-                continue;
+            // Past the minimum block size no package pays less than the relay fee, nor will any after it
+            if (CFeeRate(nPackageFees, nPackageSize) < ::minRelayTxFee && assembly.nBlockSize + nPackageSize >= nBlockMinSize)
+                break;
 
-            CAmount nTxFees = view.GetValueIn(tx)-tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, SCRIPT_VERIFY_P2SH, true))
+            if (assembly.nBlockSize + nPackageSize >= nBlockMaxSize)
+            {
+                setFailed.insert(it);
+                // Stop looking once the block is close to full and nothing fits any more
+                if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && assembly.nBlockSize > nBlockMaxSize - 4000)
+                    break;
                 continue;
+            }
 
-            UpdateCoins(tx, state, view, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority)
+            CTxMemPool::setEntries setAncestors;
+            mempool.CalculateAncestors(it, setAncestors);
+            std::vector<CTxMemPool::txiter> vPackage;
+            bool fFailedAncestor = false;
+            BOOST_FOREACH(const CTxMemPool::txiter& ancestor, setAncestors)
             {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
+                if (setFailed.count(ancestor))
+                    fFailedAncestor = true;
+                if (!assembly.setInBlock.count(ancestor))
+                    vPackage.push_back(ancestor);
             }
+            vPackage.push_back(it);
+            std::sort(vPackage.begin(), vPackage.end(), CTxMemPool::CompareByAncestorCount());
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash))
+            if (fFailedAncestor || !AddPackage(assembly, vPackage, nBlockMaxSize))
             {
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
-                {
-                    if (!porphan->setDependsOn.empty())
-                    {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty())
-                        {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
+                setFailed.insert(it);
+                ++nConsecutiveFailed;
+                continue;
             }
+            nConsecutiveFailed = 0;
+            UpdatePackagesForAdded(assembly, modified, vPackage);
         }
+        uint64_t nBlockSize = assembly.nBlockSize;
+        uint64_t nBlockTx = assembly.nBlockTx;
+        nFees = assembly.nFees;
 
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
@@ -734,8 +785,16 @@ void static AnoncoinMiner(CWallet *pwallet)
 
     //! Each thread gets its own Hash Meter, with a unique ID
     boost::scoped_ptr<CHashMeter> spMyMeter(new CHashMeter( nMyID ));
-    //! Each thread gets its own Scrypt mining ScratchPad buffer, they are large.
-    boost::scoped_ptr<char> spScratchPad( new char[ SCRYPT_SCRATCHPAD_SIZE ] );
+    //! Each thread gets its own Scrypt mining ScratchPad buffer, they are large, and big enough for the multi-lane engine.
+    boost::scoped_array<char> spScratchPad( new char[ SCRYPT_MULTI_SCRATCHPAD_SIZE ] );
+    //! Scrypt nonces are scanned in batches of the multi-lane engine width, which always divides 256
+    const uint32_t nScryptLanes = scrypt_multi_lanes();
+    std::vector<char> vScryptInput( nScryptLanes * 80 );
+    std::vector<uint256> vScryptHashes( nScryptLanes );
+    //! GOST3411 nonces are scanned in batches too, from a header midstate set up at the start of every 256 nonce scan
+    const uint32_t nGostBatch = 8;
+    CGOST3411HeaderHasher gostHasher;
+    std::vector<unsigned char> vGostDigests( nGostBatch * CGOST3411HeaderHasher::OUTPUT_SIZE );
     // Each thread gets its own scratchpad buffer, allocated in normal data storage and off the stack...
     // char* pScratchPadBuffer = (char*) ::operator new (SCRYPT_SCRATCHPAD_SIZE, nothrow);
     // if( !pScratchPadBuffer ) {
@@ -782,17 +841,47 @@ void static AnoncoinMiner(CWallet *pwallet)
                 bool fAccepted = false;
                 uint16_t nHashesDone = 0;
                 uint256 thash;
-                //! Scan nonces looking for a solution
+                const bool fGost3411 = pindexPrev->nHeight+1 >= ancConsensus.nDifficultySwitchHeight6;
+                if( fGost3411 ) {
+                    pblock->nVersion = 3;
+                    pblock->nHeight  = pindexPrev->nHeight+1;
+                    powHashType = "gost3411";
+                    gostHasher.SetHeader( (const unsigned char*)BEGIN(pblock->nVersion) );
+                }
+                //! Scan nonces looking for a solution, from wherever the last scan stopped
+                const uint32_t nScanStart = pblock->nNonce;
                 while(true) {
-                    if (pindexPrev->nHeight+1 >= ancConsensus.nDifficultySwitchHeight6)
-                    {
-                        thash = HashGOST(BEGIN(pblock->nVersion), END(pblock->nNonce));
-                        pblock->nVersion = 3;
-                        pblock->nHeight  = pindexPrev->nHeight+1;
-                        powHashType = "gost3411";
+                    if( fGost3411 ) {
+                        //! Hash the next nGostBatch nonces from the midstate, then step to the first winning one, if any
+                        const uint32_t nFirstNonce = pblock->nNonce;
+                        gostHasher.HashNonces( nFirstNonce, nGostBatch, &vGostDigests[0] );
+                        uint32_t nLane = 0;
+                        while( true ) {
+                            //! To little endian, as HashGOST() does
+                            const uint32_t* pDigest = (const uint32_t*)&vGostDigests[nLane * CGOST3411HeaderHasher::OUTPUT_SIZE];
+                            for( int i = 0; i < 8; i++ )
+                                thash.pn[i] = ByteReverse( pDigest[7-i] );
+                            if( nLane == nGostBatch - 1 || thash <= hashTarget )
+                                break;
+                            nLane++;
+                        }
+                        pblock->nNonce = nFirstNonce + nLane;
+                        nHashesDone += nLane;
                     } else {
-                        scrypt_1024_1_1_256_sp(BEGIN(pblock->nVersion), BEGIN(thash), spScratchPad.get());
                         pblock->nVersion = 2;
+                        //! Hash the next nScryptLanes nonces in one call, then step to the first winning one, if any
+                        const uint32_t nFirstNonce = pblock->nNonce;
+                        for( uint32_t i = 0; i < nScryptLanes; i++ ) {
+                            pblock->nNonce = nFirstNonce + i;
+                            memcpy( &vScryptInput[i * 80], BEGIN(pblock->nVersion), 80 );
+                        }
+                        scrypt_1024_1_1_256_sp_multi( &vScryptInput[0], BEGIN(vScryptHashes[0]), nScryptLanes, spScratchPad.get() );
+                        uint32_t nLane = 0;
+                        while( nLane < nScryptLanes - 1 && vScryptHashes[nLane] > hashTarget )
+                            nLane++;
+                        pblock->nNonce = nFirstNonce + nLane;
+                        thash = vScryptHashes[nLane];
+                        nHashesDone += nLane;
                     }
                     nHashesDone++;
                     if( thash <= hashTarget ) {
@@ -816,8 +905,9 @@ void static AnoncoinMiner(CWallet *pwallet)
                         break;
                     }
                     pblock->nNonce++;
-                    //! In this inner loop, we calculate 256 hashes, if none are found, we'll try updating some other factors
-                    if( (pblock->nNonce & 0xFF) == 0 )
+                    //! In this inner loop, we calculate up to 256 hashes, if none are found, we'll try updating some other factors.
+                    //! A batch steps over several nonces and the scan need not start aligned, so look for crossing a multiple of 256.
+                    if( (nScanStart ^ pblock->nNonce) & ~0xFFU )
                         break;
                 }
 
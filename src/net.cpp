@@ -22,6 +22,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -77,6 +81,12 @@ const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** -socketevents default */
+#ifdef HAVE_SYS_EPOLL_H
+const char * const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+const char * const DEFAULT_SOCKETEVENTS = "select";
+#endif
 
 namespace {
     const int MAX_OUTBOUND_CONNECTIONS = 16;
@@ -972,10 +982,189 @@ static void AddIncomingI2pConnection(SOCKET hSocket, const CAddress& addr)
 }
 #endif // ENABLE_I2PSAM
 
+/**
+ * The readiness of the sockets ThreadSocketHandler services.  With select() the fd_sets are built over again for
+ * every pass, with all the sockets in them.  With epoll each socket is registered once for its lifetime, edge
+ * triggered for both directions, and once an event reports it ready it stays ready here until a recv(), send()
+ * or accept() on it would block.  A pass then only costs the sockets that have something to do, however many
+ * connections there are, and none of them are limited to FD_SETSIZE.  The sockets with a flag still set are kept
+ * in a set, so ThreadSocketHandler can find them without going through every node.
+ */
+class CSocketEvents
+{
+public:
+    enum { EVENT_RECV = 1, EVENT_SEND = 2 };
+
+    //! Only used with select(), filled in by ThreadSocketHandler
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+
+    CSocketEvents();
+    ~CSocketEvents();
+
+    bool IsEdgeTriggered() const;
+    //! Adds a socket to the epoll set, sockets already in it are fine.  Nothing to do for select()
+    bool Register(SOCKET hSocket);
+    //! Waits at most nTimeoutMs for events on the registered sockets, false on error
+    bool Wait(int nTimeoutMs);
+    bool IsReady(SOCKET hSocket, int nEvent);
+    //! The socket would block, it is not ready again until its next event
+    void ClearReady(SOCKET hSocket, int nEvent);
+    //! The sockets epoll reported that are still ready for something, always empty with select()
+    const std::set<SOCKET>& GetReady() const { return setReady; }
+
+private:
+    std::set<SOCKET> setReady;
+#ifdef HAVE_SYS_EPOLL_H
+    static const int MAX_EVENTS = 256;
+    int hEpoll;
+    std::vector<unsigned char> vReady; // EVENT_ flags, indexed by socket
+#endif
+};
+
+CSocketEvents::CSocketEvents()
+{
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+#ifdef HAVE_SYS_EPOLL_H
+    hEpoll = -1;
+    if (UseSocketEventsEpoll()) {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1)
+            LogPrintf("ERROR - epoll_create1 failed: %s, using select() instead\n", NetworkErrorString(errno));
+    }
+#endif
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1)
+        close(hEpoll);
+#endif
+}
+
+bool CSocketEvents::IsEdgeTriggered() const
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return hEpoll != -1;
+#else
+    return false;
+#endif
+}
+
+bool CSocketEvents::Register(SOCKET hSocket)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll == -1 || hSocket == INVALID_SOCKET)
+        return true;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = hSocket;
+    // An inbound I2P socket is still registered from the time it was listening
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hSocket, &event) == 0) {
+        // Whatever is left from a closed socket with the same number is not for this one
+        if ((size_t)hSocket < vReady.size())
+            vReady[hSocket] = 0;
+        setReady.erase(hSocket);
+        return true;
+    }
+    if (errno == EEXIST)
+        return true;
+    LogPrintf("socket epoll_ctl failed: %s\n", NetworkErrorString(errno));
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool CSocketEvents::Wait(int nTimeoutMs)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[MAX_EVENTS];
+    int nEvents = epoll_wait(hEpoll, events, MAX_EVENTS, nTimeoutMs);
+    if (nEvents < 0)
+        return errno == EINTR;
+    // Edge triggered events not returned this time, because there were more than MAX_EVENTS, are returned by the next wait
+    for (int i = 0; i < nEvents; i++) {
+        const int hSocket = events[i].data.fd;
+        if ((size_t)hSocket >= vReady.size())
+            vReady.resize(hSocket + 1, 0);
+        // Errors and hangups show up as a recv() returning zero or failing
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            vReady[hSocket] |= EVENT_RECV;
+        if (events[i].events & EPOLLOUT)
+            vReady[hSocket] |= EVENT_SEND;
+        if (vReady[hSocket])
+            setReady.insert(hSocket);
+    }
+#endif
+    return true;
+}
+
+bool CSocketEvents::IsReady(SOCKET hSocket, int nEvent)
+{
+    if (hSocket == INVALID_SOCKET)
+        return false;
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1)
+        return (size_t)hSocket < vReady.size() && (vReady[hSocket] & nEvent);
+#endif
+    if (nEvent == EVENT_RECV)
+        return FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError);
+    return FD_ISSET(hSocket, &fdsetSend);
+}
+
+void CSocketEvents::ClearReady(SOCKET hSocket, int nEvent)
+{
+    if (hSocket == INVALID_SOCKET)
+        return;
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll != -1) {
+        if ((size_t)hSocket < vReady.size())
+            vReady[hSocket] &= ~nEvent;
+        if ((size_t)hSocket >= vReady.size() || !vReady[hSocket])
+            setReady.erase(hSocket);
+        return;
+    }
+#endif
+    if (nEvent == EVENT_RECV) {
+        FD_CLR(hSocket, &fdsetRecv);
+        FD_CLR(hSocket, &fdsetError);
+    } else
+        FD_CLR(hSocket, &fdsetSend);
+}
+
  //! Main Thread that handles socket's & their housekeeping...
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    CSocketEvents events;
+    const bool fEdgeTriggered = events.IsEdgeTriggered();
+    LogPrintf("%s : waiting for sockets with %s\n", __func__, fEdgeTriggered ? "epoll" : "select()");
+#ifndef WIN32
+    // The connection limit was only kept below FD_SETSIZE in init when epoll was not going to be used
+    if (!fEdgeTriggered && UseSocketEventsEpoll())
+        LogPrintf("%s : select() cannot watch sockets numbered %d or above, connections needing them are dropped\n", __func__, FD_SETSIZE);
+#endif
+    // Set when a socket is known to still be ready, so the next wait should not sleep
+    bool fMoreWork = false;
+    // With epoll only the nodes with a ready socket are serviced, apart from a pass over all of them once a
+    // second for the inactivity checks and each time nodes came or went.  Nodes are only ever removed by this
+    // thread, so the number of them tells when others were added.
+    std::map<SOCKET, CNode*> mapNodeSockets;
+    size_t nNodesKnown = 0;
+    int64_t nLastFullPass = 0;
+    bool fNodesRemoved = false;
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        events.Register(hListenSocket.socket);
+#ifdef ENABLE_I2PSAM
+    // I2P listen sockets come and go, each one is registered the first time it is seen
+    std::set<SOCKET> setI2PListenRegistered;
+#endif
     while (true)
     {
         //
@@ -992,6 +1181,7 @@ void ThreadSocketHandler()
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                    fNodesRemoved = true;
 
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
@@ -1050,94 +1240,123 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
+        if (fEdgeTriggered)
+        {
 #ifdef ENABLE_I2PSAM
-        BOOST_FOREACH(SOCKET hI2PListenSocket, vhI2PListenSocket) {
-            if (hI2PListenSocket != INVALID_SOCKET) {
-                FD_SET(hI2PListenSocket, &fdsetRecv);
-                hSocketMax = max(hSocketMax, hI2PListenSocket);
-                have_fds = true;
+            BOOST_FOREACH(SOCKET hI2PListenSocket, vhI2PListenSocket) {
+                if (hI2PListenSocket != INVALID_SOCKET && !setI2PListenRegistered.count(hI2PListenSocket) && events.Register(hI2PListenSocket))
+                    setI2PListenRegistered.insert(hI2PListenSocket);
             }
-        }
 #endif // ENABLE_I2PSAM
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            // New nodes are registered as they are serviced, with epoll reporting whatever is already waiting for them
+            if (!events.Wait(fMoreWork ? 0 : 50))
+            {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+                MilliSleep(50);
+            }
         }
-
+        else
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
+            struct timeval timeout;
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = fMoreWork ? 0 : 50000; // frequency to poll pnode->vSend
+
+            fd_set& fdsetRecv = events.fdsetRecv;
+            fd_set& fdsetSend = events.fdsetSend;
+            fd_set& fdsetError = events.fdsetError;
+            FD_ZERO(&fdsetRecv);
+            FD_ZERO(&fdsetSend);
+            FD_ZERO(&fdsetError);
+            SOCKET hSocketMax = 0;
+            bool have_fds = false;
+
+    #ifdef ENABLE_I2PSAM
+            BOOST_FOREACH(SOCKET hI2PListenSocket, vhI2PListenSocket) {
+                if (hI2PListenSocket != INVALID_SOCKET) {
+                    FD_SET(hI2PListenSocket, &fdsetRecv);
+                    hSocketMax = max(hSocketMax, hI2PListenSocket);
+                    have_fds = true;
+                }
+            }
+    #endif // ENABLE_I2PSAM
+
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                FD_SET(hListenSocket.socket, &fdsetRecv);
+                hSocketMax = max(hSocketMax, hListenSocket.socket);
                 have_fds = true;
+            }
 
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
                 {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+    #ifndef WIN32
+                    // Only when epoll could not be set up can there be more sockets than an fd_set holds
+                    if (pnode->hSocket >= FD_SETSIZE)
+                    {
+                        if (!pnode->fDisconnect)
+                            LogPrintf("socket %d of %s is beyond FD_SETSIZE for select(), disconnecting\n", pnode->hSocket, GetPeerLogStr(pnode));
+                        pnode->fDisconnect = true;
                         continue;
                     }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+    #endif
+                    FD_SET(pnode->hSocket, &fdsetError);
+                    hSocketMax = max(hSocketMax, pnode->hSocket);
+                    have_fds = true;
+
+                    // Implement the following logic:
+                    // * If there is data to send, select() for sending data. As this only
+                    //   happens when optimistic write failed, we choose to first drain the
+                    //   write buffer in this case before receiving more. This avoids
+                    //   needlessly queueing received data, if the remote peer is not themselves
+                    //   receiving data. This means properly utilizing TCP flow control signalling.
+                    // * Otherwise, if there is no (complete) message in the receive buffer,
+                    //   or there is space left in the buffer, select() for receiving data.
+                    // * (if neither of the above applies, there is certainly one message
+                    //   in the receiver buffer ready to be processed).
+                    // Together, that means that at least one of the following is always possible,
+                    // so we don't deadlock:
+                    // * We send some data.
+                    // * We wait for data to be received (and disconnect after timeout).
+                    // * We process a message in the buffer (message handler thread).
+                    {
+                        TRY_LOCK(pnode->cs_vSend, lockSend);
+                        if (lockSend && !pnode->vSendMsg.empty()) {
+                            FD_SET(pnode->hSocket, &fdsetSend);
+                            continue;
+                        }
+                    }
+                    {
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv && (
+                            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                            FD_SET(pnode->hSocket, &fdsetRecv);
+                    }
                 }
             }
-        }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+            int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                                 &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+            boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
+            if (nSelect == SOCKET_ERROR)
             {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                if (have_fds)
+                {
+                    int nErr = WSAGetLastError();
+                    LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                    for (unsigned int i = 0; i <= hSocketMax; i++)
+                        FD_SET(i, &fdsetRecv);
+                }
+                FD_ZERO(&fdsetSend);
+                FD_ZERO(&fdsetError);
+                MilliSleep(50);
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
         }
+        fMoreWork = false;
 
         //
         // Accept new connections
@@ -1145,7 +1364,7 @@ void ThreadSocketHandler()
         if( !IsI2POnly() ) {    //If I2P is the onlynet, we do not execute listen code for clearnet
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (events.IsReady(hListenSocket.socket, CSocketEvents::EVENT_RECV))
             {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
@@ -1168,13 +1387,25 @@ void ThreadSocketHandler()
                 if (hSocket == INVALID_SOCKET)
                 {
                     int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
+                    if (nErr == WSAEWOULDBLOCK)
+                        events.ClearReady(hListenSocket.socket, CSocketEvents::EVENT_RECV);
+                    else
                         LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+                    continue;
+                }
+                // There may be more connections queued up behind this one
+                fMoreWork = true;
+                if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
+                {
+                    CloseSocket(hSocket);
                 }
-                else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
+#ifndef WIN32
+                else if (!fEdgeTriggered && hSocket >= FD_SETSIZE)
                 {
+                    LogPrintf("connection from %s dropped, socket %d is beyond FD_SETSIZE for select()\n", addr.ToString(), hSocket);
                     CloseSocket(hSocket);
                 }
+#endif
                 else if (CNode::IsBanned(addr) && !whitelisted)
                 {
                     LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
@@ -1212,8 +1443,10 @@ void ThreadSocketHandler()
                     continue;
                 }
                 // At this point we have a valid socket setup to accept inbound connections, lets see if anyone is knocking...
-                if (FD_ISSET(hI2PListenSocket, &fdsetRecv))
+                if (events.IsReady(hI2PListenSocket, CSocketEvents::EVENT_RECV))
                 {
+                    // Whatever happens next, this socket stops listening
+                    const SOCKET hListening = hI2PListenSocket;
                     const size_t bufSize = 1024;            // Same as i2pd has set on the other end
                     char pchBuf[bufSize];
                     memset(pchBuf, 0, bufSize);             // Yap someone is trying, lets find out who
@@ -1258,8 +1491,11 @@ void ThreadSocketHandler()
                     {
                         // error
                         const int nErr = WSAGetLastError();
-                        if (nErr == WSAEWOULDBLOCK || nErr == WSAEMSGSIZE || nErr == WSAEINTR || nErr == WSAEINPROGRESS)
+                        if (nErr == WSAEWOULDBLOCK || nErr == WSAEMSGSIZE || nErr == WSAEINTR || nErr == WSAEINPROGRESS) {
+                            events.ClearReady(hI2PListenSocket, CSocketEvents::EVENT_RECV);
+                            it++;
                             continue;
+                        }
 
                         LogPrintf("WARNING - I2P listen socket recv error %d, Will attempt to open a new one.\n", nErr);
                         CloseSocket(hI2PListenSocket);
@@ -1267,6 +1503,7 @@ void ThreadSocketHandler()
                     // We now need to invalidate that socket from accepting new inbound connections,
                     // it was either closed do to an error, or hopefully a new node was added to our peers list as inbound.
                     // It will be sweep away and erased, then a new acceptor added later
+                    setI2PListenRegistered.erase(hListening);
                     *it++ = INVALID_SOCKET;
                 } else                                      // Just keep looking
                     it++;
@@ -1280,7 +1517,50 @@ void ThreadSocketHandler()
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
+            const int64_t nNow = GetTime();
+            if (!fEdgeTriggered || fNodesRemoved || vNodes.size() != nNodesKnown || nNow != nLastFullPass)
+            {
+                vNodesCopy = vNodes;
+                if (fEdgeTriggered)
+                {
+                    mapNodeSockets.clear();
+                    BOOST_FOREACH(CNode* pnode, vNodes)
+                        if (pnode->hSocket != INVALID_SOCKET)
+                            mapNodeSockets[pnode->hSocket] = pnode;
+                    // Forget the events of sockets closed since, any listening socket keeps its own
+                    const std::set<SOCKET> setReady = events.GetReady();
+                    BOOST_FOREACH(SOCKET hSocket, setReady)
+                    {
+                        if (mapNodeSockets.count(hSocket))
+                            continue;
+                        bool fListening = false;
+                        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+                            if (hListenSocket.socket == hSocket)
+                                fListening = true;
+#ifdef ENABLE_I2PSAM
+                        if (setI2PListenRegistered.count(hSocket))
+                            fListening = true;
+#endif
+                        if (!fListening)
+                        {
+                            events.ClearReady(hSocket, CSocketEvents::EVENT_RECV);
+                            events.ClearReady(hSocket, CSocketEvents::EVENT_SEND);
+                        }
+                    }
+                    nNodesKnown = vNodes.size();
+                    nLastFullPass = nNow;
+                    fNodesRemoved = false;
+                }
+            }
+            else
+            {
+                BOOST_FOREACH(SOCKET hSocket, events.GetReady())
+                {
+                    std::map<SOCKET, CNode*>::const_iterator it = mapNodeSockets.find(hSocket);
+                    if (it != mapNodeSockets.end())
+                        vNodesCopy.push_back(it->second);
+                }
+            }
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
@@ -1293,10 +1573,29 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (fEdgeTriggered && !pnode->fSocketRegistered)
             {
+                if (!events.Register(pnode->hSocket))
+                {
+                    pnode->CloseSocketDisconnect();
+                    continue;
+                }
+                pnode->fSocketRegistered = true;
+            }
+            if (events.IsReady(pnode->hSocket, CSocketEvents::EVENT_RECV))
+            {
+                // select() is only asked about the sockets it makes sense to receive on, with epoll the same
+                // rules are applied here, and a socket passed over stays ready for a later pass
+                bool fSendFirst = false;
+                if (fEdgeTriggered)
+                {
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    fSendFirst = lockSend && !pnode->vSendMsg.empty();
+                }
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (lockRecv && !fSendFirst && (!fEdgeTriggered ||
+                    pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
                 {
                     {
                         // typical socket buffer is 8K-64K
@@ -1304,6 +1603,11 @@ void ThreadSocketHandler()
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
+                            // A short read drained the socket, any data arriving after it raises a new event
+                            if (nBytes < (int)sizeof(pchBuf))
+                                events.ClearReady(pnode->hSocket, CSocketEvents::EVENT_RECV);
+                            else
+                                fMoreWork = true;
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
@@ -1321,7 +1625,9 @@ void ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            if (nErr == WSAEWOULDBLOCK)
+                                events.ClearReady(pnode->hSocket, CSocketEvents::EVENT_RECV);
+                            else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
@@ -1337,11 +1643,22 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (events.IsReady(pnode->hSocket, CSocketEvents::EVENT_SEND))
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend && !pnode->vSendMsg.empty())
+                {
                     SocketSendData(pnode);
+                    // Anything left over is waiting for the socket buffer to drain
+                    if (!pnode->vSendMsg.empty())
+                        events.ClearReady(pnode->hSocket, CSocketEvents::EVENT_SEND);
+                }
+                else if (lockSend && fEdgeTriggered)
+                {
+                    // Nothing to send, a later send that cannot go out whole raises a new event once the
+                    // socket drains, so an idle socket does not keep its node in every pass
+                    events.ClearReady(pnode->hSocket, CSocketEvents::EVENT_SEND);
+                }
             }
 
             //
@@ -2464,6 +2781,15 @@ bool CAddrDB::Read(CAddrMan& addr)
 unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 
+bool UseSocketEventsEpoll()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return GetArg("-socketevents", DEFAULT_SOCKETEVENTS) == "epoll";
+#else
+    return false;
+#endif
+}
+
 //! As i2p addrs are MUCH larger than ip addresses, we're reducing the most-recently-used(mru) setAddrKnown to 1250, to have a smaller memory profile per node.
 CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) :
     ssSend(SER_NETWORK, INIT_PROTO_VERSION),
@@ -2486,6 +2812,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     ssSend.SetType( nStreamType );
     nServices = 0;
     hSocket = hSocketIn;
+    fSocketRegistered = false;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -59,9 +59,13 @@ extern const bool DEFAULT_LISTEN;
 extern const bool DEFAULT_UPNP;
 /** The maximum number of entries in mapAskFor */
 extern const size_t MAPASKFOR_MAX_SZ;
+/** -socketevents default, "epoll" where it is available, otherwise "select" */
+extern const char * const DEFAULT_SOCKETEVENTS;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
+/** True when ThreadSocketHandler waits on epoll, which unlike select() is not limited to FD_SETSIZE sockets */
+bool UseSocketEventsEpoll();
 
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
@@ -231,6 +235,7 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
+    bool fSocketRegistered; // hSocket is in the epoll set of ThreadSocketHandler
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -22,11 +22,13 @@
 #include <arpa/inet.h>
 #endif
 #include <fcntl.h>
+#include <poll.h>
 #endif
 
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
 #include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
 #include <openssl/sha.h>
 
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
@@ -244,6 +246,7 @@ bool LookupNumeric(const char *pszName, CService& addr, int portDefault)
     return Lookup(pszName, addr, portDefault, false);
 }
 
+#ifdef WIN32
 /**
  * Convert milliseconds to a struct timeval for select.
  */
@@ -254,6 +257,29 @@ struct timeval static MillisToTimeval(int64_t nTimeout)
     timeout.tv_usec = (nTimeout % 1000) * 1000;
     return timeout;
 }
+#endif
+
+/**
+ * Wait up to nTimeout milliseconds for the socket to become readable, or writable with fWrite.  Returns as select()
+ * does, the number of sockets ready, 0 on timeout or SOCKET_ERROR.  Uses poll() where there is one, with epoll a
+ * socket can be above FD_SETSIZE and would not fit in an fd_set.
+ */
+static int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout)
+{
+#ifdef WIN32
+    struct timeval timeout = MillisToTimeval(nTimeout);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    return select(hSocket + 1, fWrite ? NULL : &fdset, fWrite ? &fdset : NULL, NULL, &timeout);
+#else
+    struct pollfd pollSocket;
+    pollSocket.fd = hSocket;
+    pollSocket.events = fWrite ? POLLOUT : POLLIN;
+    pollSocket.revents = 0;
+    return poll(&pollSocket, 1, nTimeout);
+#endif
+}
 
 /**
  * Read bytes from socket. This will either read the full number of bytes requested
@@ -270,7 +296,7 @@ bool static InterruptibleRecv(char* data, size_t len, int timeout, SOCKET& hSock
 {
     int64_t curTime = GetTimeMillis();
     int64_t endTime = curTime + timeout;
-    // Maximum time to wait in one select call. It will take up until this time (in millis)
+    // Maximum time to wait in one WaitForSocket call. It will take up until this time (in millis)
     // to break off in case of an interruption.
     const int64_t maxWait = 1000;
     while (len > 0 && curTime < endTime) {
@@ -283,11 +309,7 @@ bool static InterruptibleRecv(char* data, size_t len, int timeout, SOCKET& hSock
         } else { // Other error or blocking
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
-                struct timeval tval = MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, NULL, NULL, &tval);
+                int nRet = WaitForSocket(hSocket, false, std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -477,11 +499,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL)
         {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, NULL, &fdset, NULL, &timeout);
+            int nRet = WaitForSocket(hSocket, true, nTimeout);
             if (nRet == 0)
             {
                 LogPrint("net", "connection to %s timeout\n", addrConnect.ToString());
@@ -490,7 +508,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
             }
             if (nRet == SOCKET_ERROR)
             {
-                LogPrintf("select() for %s failed: %s\n", addrConnect.ToString(), NetworkErrorString(WSAGetLastError()));
+                LogPrintf("waiting for connection to %s failed: %s\n", addrConnect.ToString(), NetworkErrorString(WSAGetLastError()));
                 CloseSocket(hSocket);
                 return false;
             }
@@ -507,7 +525,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
             }
             if (nRet != 0)
             {
-                LogPrintf("connect() to %s failed after select(): %s\n", addrConnect.ToString(), NetworkErrorString(nRet));
+                LogPrintf("connect() to %s failed after waiting: %s\n", addrConnect.ToString(), NetworkErrorString(nRet));
                 CloseSocket(hSocket);
                 return false;
             }
@@ -684,16 +702,104 @@ bool ConnectSocketByName(CService &addr, SOCKET& hSocketRet, const char *pszDest
     return true;
 }
 
+//! An interned I2P destination, see CI2pDestination
+struct CI2pDestinationData
+{
+    uint256 hash;
+    unsigned char dest[I2P_DESTINATION_STORE];
+};
+
+//! Every destination in use, by hash.  The raw pointer identifies which entry a slot was made for,
+//! after an entry expires a new one for the same destination can take its slot before it is deleted.
+typedef std::map<uint256, std::pair<const CI2pDestinationData*, boost::weak_ptr<const CI2pDestinationData> > > I2pDestinationMap;
+
+struct CI2pDestinationStore
+{
+    CCriticalSection cs;
+    I2pDestinationMap mapDestinations;
+};
+
+//! Never destroyed, global addresses like the ones in addrman release their destinations during exit
+static CI2pDestinationStore& GetI2pDestinationStore()
+{
+    static CI2pDestinationStore* pstore = new CI2pDestinationStore();
+    return *pstore;
+}
+
+static void ReleaseI2pDestination(const CI2pDestinationData* pdata)
+{
+    {
+        CI2pDestinationStore& store = GetI2pDestinationStore();
+        LOCK(store.cs);
+        I2pDestinationMap::iterator it = store.mapDestinations.find(pdata->hash);
+        if (it != store.mapDestinations.end() && it->second.first == pdata)
+            store.mapDestinations.erase(it);
+    }
+    delete pdata;
+}
+
+static const unsigned char pchZeroDest[I2P_DESTINATION_STORE] = {};
+
+void CI2pDestination::Set(const unsigned char* pch)
+{
+    if (memcmp(pch, pchZeroDest, I2P_DESTINATION_STORE) == 0) {
+        SetNull();
+        return;
+    }
+
+    //! Native destinations are keyed by their b32 hash, anything else found in the field by a hash of its bytes
+    static const unsigned char pchAAAA[] = {'A','A','A','A'};
+    uint256 hash;
+    if (pch[0] != 0 && memcmp(pch + I2P_DESTINATION_STORE - sizeof(pchAAAA), pchAAAA, sizeof(pchAAAA)) == 0)
+        hash = GetI2pDestinationHash(std::string(pch, pch + I2P_DESTINATION_STORE));
+    else
+        hash = Hash(pch, pch + I2P_DESTINATION_STORE);
+
+    CI2pDestinationStore& store = GetI2pDestinationStore();
+    LOCK(store.cs);
+    std::pair<const CI2pDestinationData*, boost::weak_ptr<const CI2pDestinationData> >& slot = store.mapDestinations[hash];
+    boost::shared_ptr<const CI2pDestinationData> pexisting = slot.second.lock();
+    if (pexisting && memcmp(pexisting->dest, pch, I2P_DESTINATION_STORE) == 0) {
+        pdata = pexisting;
+        return;
+    }
+
+    CI2pDestinationData* pnew = new CI2pDestinationData();
+    pnew->hash = hash;
+    memcpy(pnew->dest, pch, I2P_DESTINATION_STORE);
+    pdata.reset(pnew, ReleaseI2pDestination);
+    //! A different destination with the same hash keeps its slot, this one just isn't shared
+    if (!pexisting) {
+        slot.first = pnew;
+        slot.second = pdata;
+    }
+}
+
+const unsigned char* CI2pDestination::begin() const
+{
+    return pdata ? pdata->dest : pchZeroDest;
+}
+
+uint256 CI2pDestination::GetB32Hash() const
+{
+    return pdata ? pdata->hash : GetI2pDestinationHash(std::string());
+}
+
+int CI2pDestination::Compare(const CI2pDestination& b) const
+{
+    return (pdata == b.pdata) ? 0 : memcmp(begin(), b.begin(), I2P_DESTINATION_STORE);
+}
+
 void CNetAddr::Init()
 {
     memset(ip, 0, sizeof(ip));
-    memset(i2pDest, 0, I2P_DESTINATION_STORE);
+    i2pDest.SetNull();
 }
 
 void CNetAddr::SetIP(const CNetAddr& ipIn)
 {
     memcpy(ip, ipIn.ip, sizeof(ip));
-    memcpy(i2pDest, ipIn.i2pDest, I2P_DESTINATION_STORE);
+    i2pDest = ipIn.i2pDest;
 }
 
 void CNetAddr::SetRaw(Network network, const uint8_t *ip_in)
@@ -710,7 +816,7 @@ void CNetAddr::SetRaw(Network network, const uint8_t *ip_in)
         default:
             assert(!"invalid network");
     }
-    memset(i2pDest, 0, I2P_DESTINATION_STORE);
+    i2pDest.SetNull();
 }
 
 static const unsigned char pchOnionCat[] = {0xFD,0x87,0xD8,0x7E,0xEB,0x43};
@@ -771,7 +877,7 @@ bool CNetAddr::SetSpecial(const std::string &strName)
         // If we make it here 'addr' has i2p destination address as a base 64 string...
         // Now we can build the output array of bytes as we need for protocol 70009+ by using the concept of a IP6 string we call pchGarlicCat
         memcpy(ip, pchGarlicCat, sizeof(pchGarlicCat));
-        memcpy(i2pDest, addr.c_str(), I2P_DESTINATION_STORE);         // So now copy it to our CNetAddr object variable
+        i2pDest.Set((const unsigned char*)addr.c_str());              // So now copy it to our CNetAddr object variable
         return true;                                                        // Special handling taken care of
     }
 
@@ -924,12 +1030,12 @@ bool CNetAddr::IsNativeI2P() const
     // In order for this to work however, it's important that the memory has been cleared when this object
     // was created.
     // ToDo: More work could be done here to confirm it will never mistakenly see a valid native i2p address.
-    return (i2pDest[0] != 0) && (memcmp(i2pDest + I2P_DESTINATION_STORE - sizeof(pchAAAA), pchAAAA, sizeof(pchAAAA)) == 0);
+    return !i2pDest.IsNull() && (i2pDest.begin()[0] != 0) && (memcmp(i2pDest.end() - sizeof(pchAAAA), pchAAAA, sizeof(pchAAAA)) == 0);
 }
 
 std::string CNetAddr::GetI2pDestination() const
 {
-    return IsNativeI2P() ? std::string(i2pDest, i2pDest + I2P_DESTINATION_STORE) : std::string();
+    return IsNativeI2P() ? std::string(i2pDest.begin(), i2pDest.end()) : std::string();
 }
 
 /** \brief Checks for a valid i2p destination, if the garlic field is not set correctly, it makes sure that field is set properly
@@ -962,18 +1068,22 @@ bool CNetAddr::SetI2pDestination( const std::string& sBase64Dest )
         Init();
         memcpy(ip, pchGarlicCat, sizeof(pchGarlicCat));
     } else          // First & always if we're given some non-zero value, Make sure the whole field is zeroed out
-        memset(i2pDest, 0, I2P_DESTINATION_STORE);
+        i2pDest.SetNull();
 
     // Copy what the caller wants put there, up to the max size
     // Its not going to be valid, if the size is wrong, but do it anyway
-    if( iSize ) memcpy( i2pDest, sBase64Dest.c_str(), iSize < I2P_DESTINATION_STORE ? iSize : I2P_DESTINATION_STORE );
+    if( iSize ) {
+        unsigned char pchDest[I2P_DESTINATION_STORE] = {};
+        memcpy( pchDest, sBase64Dest.c_str(), iSize < I2P_DESTINATION_STORE ? iSize : I2P_DESTINATION_STORE );
+        i2pDest.Set( pchDest );
+    }
     return (iSize == I2P_DESTINATION_STORE) && IsNativeI2P();
 }
 
 // Convert this netaddress objects native i2p address into a b32.i2p address
 std::string CNetAddr::ToB32String() const
 {
-    return B32AddressFromDestination( GetI2pDestination() );
+    return IsNativeI2P() ? B32AddressFromHash( i2pDest.GetB32Hash() ) : B32AddressFromDestination( std::string() );
 }
 
 bool CNetAddr::IsLocal() const
@@ -1115,17 +1225,17 @@ std::string CNetAddr::ToString() const
 
 bool operator==(const CNetAddr& a, const CNetAddr& b)
 {
-    return (memcmp(a.ip, b.ip, 16) == 0 && memcmp(a.i2pDest, b.i2pDest, I2P_DESTINATION_STORE) == 0);
+    return (memcmp(a.ip, b.ip, 16) == 0 && a.i2pDest == b.i2pDest);
 }
 
 bool operator!=(const CNetAddr& a, const CNetAddr& b)
 {
-    return (memcmp(a.ip, b.ip, 16) != 0 || memcmp(a.i2pDest, b.i2pDest, I2P_DESTINATION_STORE) != 0);
+    return (memcmp(a.ip, b.ip, 16) != 0 || a.i2pDest != b.i2pDest);
 }
 
 bool operator<(const CNetAddr& a, const CNetAddr& b)
 {
-    return (memcmp(a.ip, b.ip, 16) < 0 || (memcmp(a.ip, b.ip, 16) == 0 && memcmp(a.i2pDest, b.i2pDest, I2P_DESTINATION_STORE) < 0));
+    return (memcmp(a.ip, b.ip, 16) < 0 || (memcmp(a.ip, b.ip, 16) == 0 && a.i2pDest.Compare(b.i2pDest) < 0));
 }
 
 bool CNetAddr::GetInAddr(struct in_addr* pipv4Addr) const
@@ -1155,7 +1265,7 @@ std::vector<unsigned char> CNetAddr::GetGroup() const
     if( IsI2P() ) {
         vchRet.resize(I2P_DESTINATION_STORE + 1);
         vchRet[0] = NET_I2P;
-        memcpy(&vchRet[1], i2pDest, I2P_DESTINATION_STORE);
+        memcpy(&vchRet[1], i2pDest.begin(), I2P_DESTINATION_STORE);
         return vchRet;
     }
 
@@ -1221,7 +1331,7 @@ std::vector<unsigned char> CNetAddr::GetGroup() const
 
 uint64_t CNetAddr::GetHash() const
 {
-    uint256 hash = IsI2P() ? Hash(i2pDest, i2pDest + I2P_DESTINATION_STORE) : Hash(&ip[0], &ip[16]);
+    uint256 hash = IsI2P() ? Hash(i2pDest.begin(), i2pDest.end()) : Hash(&ip[0], &ip[16]);
     uint64_t nRet;
     memcpy(&nRet, &hash, sizeof(nRet));
     return nRet;
@@ -1448,7 +1558,7 @@ std::vector<unsigned char> CService::GetKey() const
     {
         assert( IsI2P() );
         vKey.resize(I2P_DESTINATION_STORE);
-        memcpy(&vKey[0], i2pDest, I2P_DESTINATION_STORE);
+        memcpy(&vKey[0], i2pDest.begin(), I2P_DESTINATION_STORE);
         return vKey;
     }
      vKey.resize(18);
@@ -1758,7 +1868,11 @@ uint256 GetI2pDestinationHash( const std::string& destination )
 
 std::string B32AddressFromDestination(const std::string& destination)
 {
-    uint256 b32hash = GetI2pDestinationHash( destination );
+    return B32AddressFromHash( GetI2pDestinationHash( destination ) );
+}
+
+std::string B32AddressFromHash(const uint256& b32hash)
+{
     std::string result = EncodeBase32(b32hash.begin(), b32hash.end() - b32hash.begin()) + ".b32.i2p";
     for (size_t pos = result.find_first_of('='); pos != std::string::npos; pos = result.find_first_of('=', pos-1))
         result.erase(pos, 1);
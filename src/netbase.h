@@ -17,6 +17,8 @@
 #include <string>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+
 extern int nConnectTimeout;
 extern bool fNameLookup;
 
@@ -52,12 +54,60 @@ extern int nConnectTimeout;
 extern bool fNameLookup;
 extern CAddrMan addrman;
 
+struct CI2pDestinationData;
+
+/**
+ * The I2P destination of a CNetAddr.  Destinations are interned in one shared store, keyed by their b32 hash,
+ * so each one is kept in memory once however many addresses refer to it, and copying an address only copies
+ * a reference.  Addresses on other networks, where the destination is all zeros, hold no reference at all.
+ * Serialized it is the same I2P_DESTINATION_STORE bytes it always was.
+ */
+class CI2pDestination
+{
+    private:
+        boost::shared_ptr<const CI2pDestinationData> pdata;
+
+    public:
+        //! Sets the destination from I2P_DESTINATION_STORE bytes
+        void Set(const unsigned char* pch);
+        void SetNull() { pdata.reset(); }
+        bool IsNull() const { return !pdata; }
+        //! The I2P_DESTINATION_STORE bytes of the destination, all zeros if it is null
+        const unsigned char* begin() const;
+        const unsigned char* end() const { return begin() + I2P_DESTINATION_STORE; }
+        //! The b32 hash of a native I2P destination, as GetI2pDestinationHash() gives it
+        uint256 GetB32Hash() const;
+        int Compare(const CI2pDestination& b) const;
+
+        friend bool operator==(const CI2pDestination& a, const CI2pDestination& b) { return a.Compare(b) == 0; }
+        friend bool operator!=(const CI2pDestination& a, const CI2pDestination& b) { return a.Compare(b) != 0; }
+
+        unsigned int GetSerializeSize(int nType, int nVersion) const
+        {
+            return I2P_DESTINATION_STORE;
+        }
+
+        template<typename Stream>
+        void Serialize(Stream& s, int nType, int nVersion) const
+        {
+            s.write((const char*)begin(), I2P_DESTINATION_STORE);
+        }
+
+        template<typename Stream>
+        void Unserialize(Stream& s, int nType, int nVersion)
+        {
+            unsigned char pch[I2P_DESTINATION_STORE];
+            s.read((char*)pch, sizeof(pch));
+            Set(pch);
+        }
+};
+
 /** IP address (IPv6, or IPv4 using mapped IPv6 range (::FFFF:0:0/96)) */
 class CNetAddr
 {
     protected:
         unsigned char ip[16]; // in network byte order
-        unsigned char i2pDest[I2P_DESTINATION_STORE]; // I2P Destination
+        CI2pDestination i2pDest; // I2P Destination
     public:
         CNetAddr();
         CNetAddr(const struct in_addr& ipv4Addr);
@@ -122,7 +172,7 @@ class CNetAddr
         inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
             READWRITE(FLATDATA(ip));
              if (!(nType & SER_IPADDRONLY)) {
-                READWRITE(FLATDATA(i2pDest));
+                READWRITE(i2pDest);
              }
         }
 };
@@ -188,7 +238,7 @@ class CService : public CNetAddr
         inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
             READWRITE(FLATDATA(ip));
              if (!(nType & SER_IPADDRONLY)) {
-                READWRITE(FLATDATA(i2pDest));
+                READWRITE(i2pDest);
              }
             unsigned short portN = htons(port);
             READWRITE(portN);
@@ -232,6 +282,7 @@ bool isValidI2pAddress( const std::string& I2pAddr );
 bool isValidI2pB32( const std::string& B32Address );
 bool isStringI2pDestination( const std::string & strName );
 std::string B32AddressFromDestination(const std::string& destination);
+std::string B32AddressFromHash(const uint256& b32hash);
 uint256 GetI2pDestinationHash( const std::string& destination );
 
 #endif // ANONCOIN_NETBASE_H
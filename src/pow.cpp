@@ -16,6 +16,8 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <algorithm>
+#include <limits>
 #include <stdint.h>
 
 //! Only required if your writing debug output to a streamed file
@@ -531,6 +533,134 @@ uint256 NextWorkRequiredKgwV2(const CBlockIndex* pindexLast)
     return uintNewDifficulty;
 }
 
+void CRetargetWindow::Clear()
+{
+    dqRecords.clear();
+    dqUndo.clear();
+    pTip = NULL;
+    fComplete = false;
+}
+
+//! Adds the block two below a new tip, taking off the records it is no newer than
+void CRetargetWindow::Push( const CBlockIndex* pIndex )
+{
+    Record aRecord;
+    aRecord.nHeight = pIndex->nHeight;
+    aRecord.nBlockTime = pIndex->GetBlockTime();
+    dqUndo.push_back( std::vector<Record>() );
+    while( !dqRecords.empty() && dqRecords.back().nBlockTime >= aRecord.nBlockTime ) {
+        dqUndo.back().push_back( dqRecords.back() );
+        dqRecords.pop_back();
+    }
+    dqRecords.push_back( aRecord );
+    if( dqUndo.size() > MAX_REWIND_BLOCKS )
+        dqUndo.pop_front();
+}
+
+//! Undoes the latest Push(), Trim() never takes a record that is still to be popped by an undo
+void CRetargetWindow::Pop()
+{
+    assert( !dqUndo.empty() && !dqRecords.empty() );
+    dqRecords.pop_back();
+    const std::vector<Record>& vPopped = dqUndo.back();
+    for( std::vector<Record>::const_reverse_iterator it = vPopped.rbegin(); it != vPopped.rend(); ++it )
+        dqRecords.push_back( *it );
+    dqUndo.pop_back();
+}
+
+//! Keeps the newest record no newer than nTrimTime and drops those below it, which only searches much further back would need.
+//! After a long stall that can reach records pushed for the latest heights, those pushes are then no longer undone.
+void CRetargetWindow::Trim( int64_t nTrimTime )
+{
+    while( dqRecords.size() > 1 && dqRecords[1].nBlockTime <= nTrimTime ) {
+        //! The pushes are one per height up to the top record, the undo data of the oldest is at the front
+        while( (int64_t)dqUndo.size() > (int64_t)dqRecords.back().nHeight - dqRecords.front().nHeight )
+            dqUndo.pop_front();
+        dqRecords.pop_front();
+        fComplete = false;
+    }
+}
+
+//! Walks the block index back from pIndex, until it finds a record no newer than nTrimTime or the genesis block
+void CRetargetWindow::Rebuild( const CBlockIndex* pIndex, int64_t nTrimTime )
+{
+    Clear();
+    pTip = pIndex;
+    fComplete = true;
+    int64_t nMinTime = std::numeric_limits<int64_t>::max();
+    for( const CBlockIndex* pIndexSearch = pIndex->pprev ? pIndex->pprev->pprev : NULL; pIndexSearch; pIndexSearch = pIndexSearch->pprev ) {
+        if( pIndexSearch->GetBlockTime() >= nMinTime )
+            continue;
+        nMinTime = pIndexSearch->GetBlockTime();
+        Record aRecord;
+        aRecord.nHeight = pIndexSearch->nHeight;
+        aRecord.nBlockTime = nMinTime;
+        dqRecords.push_front( aRecord );
+        if( nMinTime <= nTrimTime ) {
+            fComplete = pIndexSearch->pprev == NULL;
+            break;
+        }
+    }
+}
+
+//! Moves the records from the current tip to pIndex, returns false if that takes a rebuild
+bool CRetargetWindow::SetTip( const CBlockIndex* pIndex )
+{
+    if( !pTip )
+        return false;
+
+    //! Find where the branches meet, rewinding no further than can be undone
+    const CBlockIndex* pFork = pTip;
+    const CBlockIndex* pBranch = pIndex->nHeight > pTip->nHeight ? pIndex->GetAncestor( pTip->nHeight ) : pIndex;
+    unsigned int nRewind = 0;
+    while( pFork != pBranch ) {
+        if( pFork->nHeight > pBranch->nHeight ) {
+            pFork = pFork->pprev;
+        } else {
+            pFork = pFork->pprev;
+            pBranch = pBranch->pprev;
+        }
+        if( ++nRewind > dqUndo.size() || !pFork || !pBranch )
+            return false;
+    }
+    //! The records start two below the tip, near the genesis block a rebuild is simpler and just as fast
+    if( pFork->nHeight < 2 )
+        return false;
+
+    for( unsigned int i = 0; i < nRewind; i++ )
+        Pop();
+    std::vector<const CBlockIndex*> vAdvance;
+    for( const CBlockIndex* pIndexSearch = pIndex->pprev->pprev; pIndexSearch->nHeight > pFork->nHeight - 2; pIndexSearch = pIndexSearch->pprev )
+        vAdvance.push_back( pIndexSearch );
+    for( std::vector<const CBlockIndex*>::reverse_iterator it = vAdvance.rbegin(); it != vAdvance.rend(); ++it )
+        Push( *it );
+    pTip = pIndex;
+    return true;
+}
+
+const CBlockIndex* CRetargetWindow::FindOldest( const CBlockIndex* pIndex, int64_t nOldestBlockTime )
+{
+    assert( pIndex->pprev );
+    //! Keep enough below the oldest time for it to move back by another integration period
+    int64_t nTrimTime = nOldestBlockTime - std::max( pIndex->GetBlockTime() - nOldestBlockTime, (int64_t)0 );
+    if( pTip != pIndex && !SetTip( pIndex ) )
+        Rebuild( pIndex, nTrimTime );
+    Trim( nTrimTime );
+
+    Record aSearch;
+    aSearch.nBlockTime = nOldestBlockTime;
+    std::deque<Record>::const_iterator it = std::upper_bound( dqRecords.begin(), dqRecords.end(), aSearch );
+    if( it == dqRecords.begin() && !fComplete ) {
+        //! Searching further back than the records go, which a rebuild always reaches
+        Rebuild( pIndex, nTrimTime );
+        it = std::upper_bound( dqRecords.begin(), dqRecords.end(), aSearch );
+    }
+    if( it == dqRecords.begin() )
+        return pIndex->GetAncestor( 0 );
+    --it;
+    return pIndex->GetAncestor( it->nHeight + 1 );
+}
+
 CRetargetPidController::CRetargetPidController( const double dProportionalGainIn, const int64_t nIntegrationTimeIn, const double dIntegratorGainIn, const double dDerivativeGainIn ) :
     dProportionalGain(dProportionalGainIn), nIntegrationTime(nIntegrationTimeIn), dIntegratorGain(dIntegratorGainIn), dDerivativeGain(dDerivativeGainIn)
 {
@@ -999,27 +1129,17 @@ bool CRetargetPidController::ChargeIntegrator( const CBlockIndex* pIndex )
         return true;
     }
 
-    //! And some interm values used in the loop
+    //! And some interm values used in the search
     const int64_t nMostRecentBlockTime = pIndex->GetBlockTime();
     const int64_t nOldestBlockTime = nMostRecentBlockTime - nIntegrationTime;
-    int64_t nBlockTime;
 
-    //! Initialize the number of samples we have taken.  For any case greater than 2 blocks, a failure to
-    //! have a sufficient BlockIndex will cause this next loop to exit with the samples taken set correctly.
-    nBlocksSampled = 1;
-
-    //! This loop always gets executed at least once, or we would not have made it this far.
-    //! If we run into a previous blockindex that is null or what normally happens is the
-    //! block time about to be added to the sample set, has a time that is less that the
-    //! nIntegrationTime defined by the user and as started with the MostRecentBlockTime.
-    //! When that is found, it falls through the loop with what data it was able to gather.
-    do {
-        pIndex = pIndex->pprev;                                 //! Always moving backwards to the previous block from the starting blockindex entry given
-        nBlockTime = pIndex->GetBlockTime();                    //! Get a local copy of the absolute time when this block was mined
-        nBlocksSampled++;                                       //! Maintain an accurate count of the blocks we have sampled
-    } while( pIndex->pprev && nOldestBlockTime < pIndex->pprev->GetBlockTime() );
-    //! If we're about to hit a block with a time older than our integration period, do not include it,
-    //! it could be the genesis block and ancient, which leads to a period of 678+days of blocktime summed
+    //! Going back from the starting blockindex entry given, at least to the previous block, the samples stop when
+    //! we're about to hit a block with a time older than our integration period, or run out of blocks.  That one is
+    //! not included, it could be the genesis block and ancient, which leads to a period of 678+days of blocktime summed.
+    //! The window follows the tip, so this is a search and not a walk over the whole integration period each time.
+    const CBlockIndex* pOldestIndex = integratorWindow.FindOldest( pIndex, nOldestBlockTime );
+    const int64_t nBlockTime = pOldestIndex->GetBlockTime();
+    nBlocksSampled = pIndex->nHeight - pOldestIndex->nHeight + 1;
 
     //! Calc how much time has past between this data point and the starting blockindex entry given
     nIntegratorChargeTime = nMostRecentBlockTime - nBlockTime;
@@ -17,7 +17,9 @@
 #include "consensus.h"
 #include "sync.h"
 
+#include <deque>
 #include <stdint.h>
+#include <vector>
 
 class CBlockHeader;
 class CBlockIndex;
@@ -75,6 +77,50 @@ struct RetargetStats
     std::vector<FilterPoint> vTipFilter;
 };
 
+/**
+ * Finds the oldest block the PID Integrator samples, without walking the whole integration period back from every
+ * new tip.  The walk stops at the first block, going back from the tip, whose predecessor is no newer than the
+ * oldest time allowed.  Block times are not in order, so that is the block above the newest of them at or below
+ * that time, which this finds by binary search over the blocks no newer than every block above them up to the tip.
+ * Those are kept as the tip moves, one block pushed per height, and popped ones remembered for the last
+ * MAX_REWIND_BLOCKS, so short reorgs are undone rather than walked again.  Deeper reorgs, jumps onto another branch
+ * and a search past what is kept all fall back to a full rebuild from the block index.
+ */
+class CRetargetWindow
+{
+private:
+    static const unsigned int MAX_REWIND_BLOCKS = 100;
+
+    struct Record
+    {
+        int32_t nHeight;
+        int64_t nBlockTime;
+        bool operator < (const Record& rhs) const { return nBlockTime < rhs.nBlockTime; }
+    };
+
+    //! Heights and block times ascending, the top is two below the tip
+    std::deque<Record> dqRecords;
+    //! For each of the latest heights pushed, the records its push popped
+    std::deque<std::vector<Record> > dqUndo;
+    //! The tip the records are kept for, NULL until the first rebuild
+    const CBlockIndex* pTip;
+    //! True if the records reach down to the genesis block, so every height below the lowest one is newer
+    bool fComplete;
+
+    void Push( const CBlockIndex* pIndex );
+    void Pop();
+    void Trim( int64_t nTrimTime );
+    void Rebuild( const CBlockIndex* pIndex, int64_t nTrimTime );
+    bool SetTip( const CBlockIndex* pIndex );
+
+public:
+    CRetargetWindow() { Clear(); }
+
+    void Clear();
+    //! The oldest block the integrator samples going back from pIndex, which must have a predecessor
+    const CBlockIndex* FindOldest( const CBlockIndex* pIndex, int64_t nOldestBlockTime );
+};
+
 // namespace retargetpid {
 
 class CRetargetPidController
@@ -123,6 +169,7 @@ private:
     int32_t nIntegratorHeight;      //! Saves recalculating if we already have the Integrator charge at this height
     int32_t nIndexFilterHeight;     //! Same goes for the IndexTipFilter, where the previous difficulty calculation is made
     const CBlockIndex* pChargedToIndex;   //! Its quicker and easier to just keep a copy of the pointer to the BlockIndex, than search for it.
+    CRetargetWindow integratorWindow;     //! Follows the tip, so each charge finds the start of the integration period in O(log n)
 
     uint32_t nMaxDiffIncrease;
     uint32_t nMaxDiffDecrease;
@@ -44,6 +44,7 @@ public:
 
 extern void TxToJSON(const CTransaction& tx, const uintFakeHash hashBlock, Object& entry);
 extern Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void WriteBlockJSON(CJSONStreamWriter& writer, const CBlock& block, const Object& objBlock, bool txDetails);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -94,6 +95,7 @@ static bool rest_block(AcceptedConnection* conn,
                        string& strReq,
                        map<string, string>& mapHeaders,
                        bool fRun,
+                       int nProto,
                        bool showTxDetails)
 {
     vector<string> params;
@@ -104,7 +106,10 @@ static bool rest_block(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, aBlockHash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    //! The binary and hex formats are the block as it is stored, only json needs it deserialized
     CBlock block;
+    vector<char> vBlock;
+    Object objBlock;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -116,31 +121,35 @@ static bool rest_block(AcceptedConnection* conn,
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[aBlockHash];
-        if (!ReadBlockFromDisk(block, pblockindex))
+        bool fRead = (rf == RF_JSON) ? ReadBlockFromDisk(block, pblockindex) : ReadRawBlockFromDisk(vBlock, pblockindex);
+        if (!fRead)
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        //! The transactions are converted as they are written, after the lock is released
+        if (rf == RF_JSON)
+            objBlock = blockToJSON(block, pblockindex);
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryBlock.size(), "application/octet-stream") << binaryBlock << std::flush;
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, vBlock.size(), "application/octet-stream");
+        conn->stream().write(&vBlock[0], vBlock.size());
+        conn->stream() << std::flush;
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(vBlock.begin(), vBlock.end()) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
         return true;
     }
 
     case RF_JSON: {
-        Object objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = write_string(Value(objBlock), false) + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
-        return true;
+        CHTTPReplyStreamBuf buf(conn->stream(), HTTP_OK, fRun, HTTPAcceptsChunked(nProto, mapHeaders));
+        std::ostream out(&buf);
+        CJSONStreamWriter writer(out);
+        WriteBlockJSON(writer, block, objBlock, showTxDetails);
+        out << "\n";
+        return buf.Finish();
     }
 
     default: {
@@ -155,23 +164,26 @@ static bool rest_block(AcceptedConnection* conn,
 static bool rest_block_extended(AcceptedConnection* conn,
                        string& strReq,
                        map<string, string>& mapHeaders,
-                       bool fRun)
+                       bool fRun,
+                       int nProto)
 {
-    return rest_block(conn, strReq, mapHeaders, fRun, true);
+    return rest_block(conn, strReq, mapHeaders, fRun, nProto, true);
 }
 
 static bool rest_block_notxdetails(AcceptedConnection* conn,
                        string& strReq,
                        map<string, string>& mapHeaders,
-                       bool fRun)
+                       bool fRun,
+                       int nProto)
 {
-    return rest_block(conn, strReq, mapHeaders, fRun, false);
+    return rest_block(conn, strReq, mapHeaders, fRun, nProto, false);
 }
 
 static bool rest_tx(AcceptedConnection* conn,
                     string& strReq,
                     map<string, string>& mapHeaders,
-                    bool fRun)
+                    bool fRun,
+                    int nProto)
 {
     vector<string> params;
     enum RetFormat rf = ParseDataFormat(params, strReq);
@@ -224,7 +236,8 @@ static const struct {
     bool (*handler)(AcceptedConnection* conn,
                     string& strURI,
                     map<string, string>& mapHeaders,
-                    bool fRun);
+                    bool fRun,
+                    int nProto);
 } uri_prefixes[] = {
       {"/rest/tx/", rest_tx},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
@@ -234,7 +247,8 @@ static const struct {
 bool HTTPReq_REST(AcceptedConnection* conn,
                   string& strURI,
                   map<string, string>& mapHeaders,
-                  bool fRun)
+                  bool fRun,
+                  int nProto)
 {
     try {
         std::string statusmessage;
@@ -245,7 +259,7 @@ bool HTTPReq_REST(AcceptedConnection* conn,
             unsigned int plen = strlen(uri_prefixes[i].prefix);
             if (strURI.substr(0, plen) == uri_prefixes[i].prefix) {
                 string strReq = strURI.substr(plen);
-                return uri_prefixes[i].handler(conn, strReq, mapHeaders, fRun);
+                return uri_prefixes[i].handler(conn, strReq, mapHeaders, fRun, nProto);
             }
         }
     } catch (RestErr& re) {
@@ -96,6 +96,33 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDe
     return result;
 }
 
+/**
+ * Writes the block as blockToJSON() returns it, objBlock being what it returned without the transaction details.
+ * With txDetails the transactions are converted one at a time as they are written, which needs no locks.
+ */
+void WriteBlockJSON(CJSONStreamWriter& writer, const CBlock& block, const Object& objBlock, bool txDetails)
+{
+    writer.BeginObject();
+    BOOST_FOREACH(const Pair& pair, objBlock)
+    {
+        if (pair.name_ == "tx" && txDetails)
+        {
+            writer.Key("tx");
+            writer.BeginArray();
+            BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            {
+                Object objTx;
+                TxToJSON(tx, uint256(0), objTx);
+                writer.Write(objTx);
+            }
+            writer.EndArray();
+        }
+        else
+            writer.Write(pair.name_, pair.value_);
+    }
+    writer.EndObject();
+}
+
 
 Value getblockcount(const Array& params, bool fHelp)
 {
@@ -158,6 +185,72 @@ Value getdifficulty(const Array& params, bool fHelp)
 }
 
 
+//! What getrawmempool shows of a mempool entry, copied so the reply is built and sent without holding the locks
+struct CMempoolEntryInfo
+{
+    uint256 hash;
+    int nSize;
+    CAmount nFee;
+    int64_t nTime;
+    int nHeight;
+    double dStartingPriority;
+    double dCurrentPriority;
+    int64_t nCountWithDescendants;
+    int64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+    int64_t nCountWithAncestors;
+    int64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    set<string> setDepends;
+};
+
+static void GetMempoolEntries(vector<CMempoolEntryInfo>& vEntries)
+{
+    LOCK2(cs_main, mempool.cs);
+    vEntries.reserve(mempool.mapTx.size());
+    for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+    {
+        const CTxMemPoolEntry& e = it->second;
+        vEntries.push_back(CMempoolEntryInfo());
+        CMempoolEntryInfo& info = vEntries.back();
+        info.hash = it->first;
+        info.nSize = (int)e.GetTxSize();
+        info.nFee = e.GetFee();
+        info.nTime = e.GetTime();
+        info.nHeight = (int)e.GetHeight();
+        info.dStartingPriority = e.GetPriority(e.GetHeight());
+        info.dCurrentPriority = e.GetPriority(chainActive.Height());
+        info.nCountWithDescendants = (int64_t)e.GetCountWithDescendants();
+        info.nSizeWithDescendants = (int64_t)e.GetSizeWithDescendants();
+        info.nModFeesWithDescendants = e.GetModFeesWithDescendants();
+        info.nCountWithAncestors = (int64_t)e.GetCountWithAncestors();
+        info.nSizeWithAncestors = (int64_t)e.GetSizeWithAncestors();
+        info.nModFeesWithAncestors = e.GetModFeesWithAncestors();
+        BOOST_FOREACH(const CTxMemPool::txiter& parent, mempool.GetMemPoolParents(it))
+            info.setDepends.insert(parent->first.ToString());
+    }
+}
+
+static Object MempoolEntryToJSON(const CMempoolEntryInfo& e)
+{
+    Object info;
+    info.push_back(Pair("size", e.nSize));
+    info.push_back(Pair("fee", ValueFromAmount(e.nFee)));
+    info.push_back(Pair("time", e.nTime));
+    info.push_back(Pair("height", e.nHeight));
+    info.push_back(Pair("startingpriority", e.dStartingPriority));
+    info.push_back(Pair("currentpriority", e.dCurrentPriority));
+    info.push_back(Pair("descendantcount", e.nCountWithDescendants));
+    info.push_back(Pair("descendantsize", e.nSizeWithDescendants));
+    info.push_back(Pair("descendantfees", ValueFromAmount(e.nModFeesWithDescendants)));
+    info.push_back(Pair("ancestorcount", e.nCountWithAncestors));
+    info.push_back(Pair("ancestorsize", e.nSizeWithAncestors));
+    info.push_back(Pair("ancestorfees", ValueFromAmount(e.nModFeesWithAncestors)));
+    Array depends(e.setDepends.begin(), e.setDepends.end());
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 Value getrawmempool(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -180,6 +273,12 @@ Value getrawmempool(const Array& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) modified fees of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -190,38 +289,18 @@ Value getrawmempool(const Array& params, bool fHelp)
             + HelpExampleRpc("getrawmempool", "true")
         );
 
-    LOCK(cs_main);
-
     bool fVerbose = false;
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
 
     if (fVerbose)
     {
-        LOCK(mempool.cs);
+        vector<CMempoolEntryInfo> vEntries;
+        GetMempoolEntries(vEntries);
+
         Object o;
-        BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool.mapTx)
-        {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            Object info;
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-            Array depends(setDepends.begin(), setDepends.end());
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
+        BOOST_FOREACH(const CMempoolEntryInfo& info, vEntries)
+            o.push_back(Pair(info.hash.ToString(), MempoolEntryToJSON(info)));
         return o;
     }
     else
@@ -237,6 +316,39 @@ Value getrawmempool(const Array& params, bool fHelp)
     }
 }
 
+void getrawmempool_stream(const Array& params, CJSONStreamWriter& writer)
+{
+    if (params.size() > 1) {
+        writer.Write(getrawmempool(params, false));
+        return;
+    }
+
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    if (fVerbose)
+    {
+        vector<CMempoolEntryInfo> vEntries;
+        GetMempoolEntries(vEntries);
+
+        writer.BeginObject();
+        BOOST_FOREACH(const CMempoolEntryInfo& info, vEntries)
+            writer.Write(info.hash.ToString(), MempoolEntryToJSON(info));
+        writer.EndObject();
+    }
+    else
+    {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        writer.BeginArray();
+        BOOST_FOREACH(const uint256& hash, vtxid)
+            writer.Write(hash.ToString());
+        writer.EndArray();
+    }
+}
+
 Value getblockhash(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -270,6 +382,21 @@ Value getblockhash(const Array& params, bool fHelp)
     return result;
 }
 
+//! The block a hash parameter names, requires cs_main
+static CBlockIndex* LookupBlockParam(const Value& param)
+{
+    uintFakeHash GivenHash;
+    GivenHash.SetHex(param.get_str());
+    //! Allow the user to enter either the real block hash value or the sha256d hash,
+    //! so we can better have backwards compatibility while working with rpc input.
+    uint256 aRealHash = GivenHash.GetRealHash();
+    if(aRealHash != 0)  GivenHash = aRealHash;
+
+    if (mapBlockIndex.count(GivenHash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    return mapBlockIndex[GivenHash];
+}
+
 Value getblock(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -310,34 +437,25 @@ Value getblock(const Array& params, bool fHelp)
 
     LOCK(cs_main);
 
-    uintFakeHash GivenHash;
-    GivenHash.SetHex(params[0].get_str());
-    //! Allow the user to enter either the real block hash value or the sha256d hash,
-    //! so we can better have backwards compatibility while working with rpc input.
-    uint256 aRealHash = GivenHash.GetRealHash();
-    if(aRealHash != 0)  GivenHash = aRealHash;
-
     bool fVerbose = true;
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(GivenHash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[GivenHash];
-
-    if(!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = LookupBlockParam(params[0]);
 
     if (!fVerbose)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        // The hex encoded block is the block as it is stored, there is no need to deserialize it
+        std::vector<char> vBlock;
+        if (!ReadRawBlockFromDisk(vBlock, pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        return HexStr(vBlock.begin(), vBlock.end());
     }
 
+    if(!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -508,7 +626,18 @@ Value getblockchaininfo(const Array& params, bool fHelp)
             "  \"bestblockhash\": \"...\",       (string) the hash of the currently best block\n"
             "  \"difficulty\" : x.xxx,         (numeric) The current required difficulty. Based on the minimum, smaller = harder, larger = easier.\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1], based on the last checkpoint.\n"
-            "  \"chainwork\": \"xxxx\"           (hex string) Total amount of work in the active chain.\n"
+            "  \"chainwork\": \"xxxx\",          (hex string) Total amount of work in the active chain.\n"
+            "  \"coinsflush\": {                 (object) the background writes of the coins cache to the coin database\n"
+            "    \"flushes\": xxxx,              (numeric) number of writes since startup\n"
+            "    \"inflight\": true|false,       (boolean) whether a write is waiting or in progress\n"
+            "    \"last_ms\": x.xx,              (numeric) duration of the last write in milliseconds\n"
+            "    \"max_ms\": x.xx,               (numeric) longest write in milliseconds\n"
+            "    \"last_copy_ms\": x.xx,         (numeric) time the last write held up block validation to copy the dirty coins\n"
+            "    \"last_bytes\": xxxx,           (numeric) approximate size of the last write\n"
+            "    \"bytes\": xxxx,                (numeric) approximate size of all writes\n"
+            "    \"entries\": xxxx,              (numeric) number of coins entries written\n"
+            "    \"evicted\": xxxx               (numeric) number of clean entries dropped from the cache after writes\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getblockchaininfo", "")
@@ -531,6 +660,20 @@ Value getblockchaininfo(const Array& params, bool fHelp)
     obj.push_back(Pair("difficulty_hex",    strprintf( "0x%08x",hexVal.GetCompact()) ));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork",     chainActive.Tip()->nChainWork.GetHex()));
+
+    CCoinsFlushStats flushStats;
+    GetCoinsFlushStats(flushStats);
+    Object flush;
+    flush.push_back(Pair("flushes",      (uint64_t)flushStats.nFlushes));
+    flush.push_back(Pair("inflight",     flushStats.fInFlight));
+    flush.push_back(Pair("last_ms",      flushStats.nLastFlushMicros * 0.001));
+    flush.push_back(Pair("max_ms",       flushStats.nMaxFlushMicros * 0.001));
+    flush.push_back(Pair("last_copy_ms", flushStats.nLastCopyMicros * 0.001));
+    flush.push_back(Pair("last_bytes",   (uint64_t)flushStats.nLastBytes));
+    flush.push_back(Pair("bytes",        (uint64_t)flushStats.nBytesWritten));
+    flush.push_back(Pair("entries",      (uint64_t)flushStats.nEntriesWritten));
+    flush.push_back(Pair("evicted",      (uint64_t)flushStats.nEvicted));
+    obj.push_back(Pair("coinsflush", flush));
     return obj;
 }
 
@@ -652,6 +795,9 @@ Value getmempoolinfo(const Array& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx   (numeric) Current tx count\n"
             "  \"bytes\": xxxxx  (numeric) Sum of all tx sizes\n"
+            "  \"usage\": xxxxx  (numeric) Estimated memory usage of the mempool\n"
+            "  \"maxmempool\": xxxxx     (numeric) Maximum memory usage of the mempool\n"
+            "  \"mempoolminfee\": xxxxx  (numeric) Minimum fee rate in ANC/kB for a transaction to be accepted\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -661,6 +807,10 @@ Value getmempoolinfo(const Array& params, bool fHelp)
     Object ret;
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
+    size_t nMaxMempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("maxmempool", (int64_t) nMaxMempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(nMaxMempool), ::minRelayTxFee).GetFeePerK())));
 
     return ret;
 }
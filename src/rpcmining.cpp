@@ -602,6 +602,8 @@ Value getblocktemplate(const Array& params, bool fHelp)
         {
             checktxtime = boost::get_system_time() + boost::posix_time::seconds(30);    // Anoncoin waits 30 seconds
 
+            // Another worker answers the other calls meanwhile
+            CRPCLongPoll longpoll;
             boost::unique_lock<boost::mutex> lock(csBestBlock);
             while ( chainActive.Tip()->GetBlockSha256dHash() == hashWatchedChain && IsRPCRunning())
             {
@@ -64,6 +64,7 @@ static const char *httpStatusDescription(int nStatus)
         case HTTP_FORBIDDEN: return "Forbidden";
         case HTTP_NOT_FOUND: return "Not Found";
         case HTTP_INTERNAL_SERVER_ERROR: return "Internal Server Error";
+        case HTTP_SERVICE_UNAVAILABLE: return "Service Unavailable";
         default: return "";
     }
 }
@@ -111,6 +112,24 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         FormatFullVersion());
 }
 
+string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char *contentType)
+{
+    return strprintf(
+            "HTTP/1.1 %d %s\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Content-Type: %s\r\n"
+            "Server: anoncoin-json-rpc/%s\r\n"
+            "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
+        FormatFullVersion());
+}
+
 string HTTPReply(int nStatus, const string& strMsg, bool keepalive,
                  bool headersOnly, const char *contentType)
 {
@@ -200,6 +219,67 @@ int ReadHTTPHeaders(std::basic_istream<char>& stream, map<string, string>& mapHe
     return nLen;
 }
 
+/**
+ * Whether a reply to this request may be sent in chunks.  Older releases of anoncoin-cli speak HTTP/1.1 but can not
+ * read chunked bodies, so the client has to ask for them with "TE: chunked".
+ */
+bool HTTPAcceptsChunked(int nProto, const map<string, string>& mapHeaders)
+{
+    if (nProto < 1)
+        return false;
+    map<string, string>::const_iterator it = mapHeaders.find("te");
+    if (it == mapHeaders.end())
+        return false;
+    vector<string> vCodings;
+    boost::split(vCodings, it->second, boost::is_any_of(","));
+    BOOST_FOREACH(string& strCoding, vCodings) {
+        // Drop any parameters such as ";q=1"
+        strCoding = strCoding.substr(0, strCoding.find(';'));
+        boost::trim(strCoding);
+        if (boost::iequals(strCoding, "chunked"))
+            return true;
+    }
+    return false;
+}
+
+
+//! Read a body sent with chunked transfer encoding, false if it is cut short or longer than max_size
+static bool ReadHTTPChunks(std::basic_istream<char>& stream, string& strMessageRet, size_t max_size)
+{
+    while (true)
+    {
+        // The size of the chunk in hex, possibly followed by extensions
+        string str;
+        std::getline(stream, str);
+        const char* pbegin = str.c_str();
+        char* pend;
+        unsigned long nChunk = strtoul(pbegin, &pend, 16);
+        if (!stream || pend == pbegin)
+            return false;
+        if (nChunk == 0)
+            break;
+        if (nChunk > max_size - strMessageRet.size())
+            return false;
+        size_t ptr = strMessageRet.size();
+        strMessageRet.resize(ptr + nChunk);
+        stream.read(&strMessageRet[ptr], nChunk);
+        // The line end after the chunk
+        std::getline(stream, str);
+        if (!stream) // Connection lost while reading
+            return false;
+    }
+
+    // Trailer headers, up to the empty line ending the message
+    while (true)
+    {
+        string str;
+        std::getline(stream, str);
+        if (!stream)
+            return false;
+        if (str.empty() || str == "\r")
+            return true;
+    }
+}
 
 int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
                     string>& mapHeadersRet, string& strMessageRet,
@@ -214,7 +294,14 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0)
+    map<string, string>::const_iterator itEncoding = mapHeadersRet.find("transfer-encoding");
+    if (itEncoding != mapHeadersRet.end() && boost::iequals(itEncoding->second, "chunked"))
+    {
+        if (!ReadHTTPChunks(stream, strMessageRet, max_size))
+            return HTTP_INTERNAL_SERVER_ERROR;
+        LogPrint( "rpcio", "%s : Message %s\n", __func__, strMessageRet);
+    }
+    else if (nLen > 0)
     {
         vector<char> vch;
         size_t ptr = 0;
@@ -288,3 +375,130 @@ Object JSONRPCError(int code, const string& message)
     error.push_back(Pair("message", message));
     return error;
 }
+
+CHTTPReplyStreamBuf::CHTTPReplyStreamBuf(std::ostream& streamIn, int nStatusIn, bool fKeepAliveIn, bool fAllowChunkedIn,
+                                         const char* contentTypeIn, size_t nChunkSize) :
+    stream(streamIn), nStatus(nStatusIn), fKeepAlive(fKeepAliveIn), contentType(contentTypeIn),
+    fAllowChunked(fAllowChunkedIn), vBuffer(std::max(nChunkSize, (size_t)1)), fChunked(false)
+{
+    setp(&vBuffer[0], &vBuffer[0] + vBuffer.size());
+}
+
+void CHTTPReplyStreamBuf::SendChunk()
+{
+    if (!fChunked) {
+        stream << HTTPReplyHeaderChunked(nStatus, fKeepAlive, contentType);
+        fChunked = true;
+    }
+    // An empty chunk would end the body
+    size_t nSize = pptr() - pbase();
+    if (nSize > 0) {
+        stream << strprintf("%x\r\n", nSize);
+        stream.write(pbase(), nSize);
+        stream << "\r\n";
+    }
+    setp(&vBuffer[0], &vBuffer[0] + vBuffer.size());
+}
+
+int CHTTPReplyStreamBuf::overflow(int c)
+{
+    if (fAllowChunked) {
+        SendChunk();
+        if (!stream)
+            return traits_type::eof();
+    } else {
+        size_t nSize = pptr() - pbase();
+        vBuffer.resize(vBuffer.size() * 2);
+        setp(&vBuffer[0], &vBuffer[0] + vBuffer.size());
+        pbump(nSize);
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+bool CHTTPReplyStreamBuf::Finish()
+{
+    if (fChunked) {
+        SendChunk();
+        stream << "0\r\n\r\n";
+    } else {
+        size_t nSize = pptr() - pbase();
+        stream << HTTPReplyHeader(nStatus, fKeepAlive, nSize, contentType);
+        stream.write(pbase(), nSize);
+    }
+    stream << std::flush;
+    return stream.good();
+}
+
+CJSONStreamWriter::CJSONStreamWriter(std::ostream& streamIn) : stream(streamIn), fAfterKey(false)
+{
+}
+
+void CJSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vHasMembers.empty()) {
+        if (vHasMembers.back())
+            stream << ',';
+        vHasMembers.back() = true;
+    }
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separate();
+    stream << '{';
+    vHasMembers.push_back(false);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vHasMembers.empty() && !fAfterKey);
+    vHasMembers.pop_back();
+    stream << '}';
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separate();
+    stream << '[';
+    vHasMembers.push_back(false);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vHasMembers.empty());
+    vHasMembers.pop_back();
+    stream << ']';
+}
+
+void CJSONStreamWriter::Key(const string& strKey)
+{
+    Separate();
+    stream << write_string(Value(strKey), false) << ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Write(const Value& value)
+{
+    Separate();
+    stream << write_string(value, false);
+}
+
+void CJSONStreamWriter::Write(const string& strKey, const Value& value)
+{
+    Key(strKey);
+    Write(value);
+}
+
+void CJSONStreamWriter::WriteMembers(const Object& obj)
+{
+    BOOST_FOREACH(const Pair& pair, obj)
+        Write(pair.name_, pair.value_);
+}
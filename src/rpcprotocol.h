@@ -11,6 +11,7 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/asio.hpp>
@@ -161,10 +162,13 @@ std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength,
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive,
                       bool headerOnly = false,
                       const char *contentType = "application/json");
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive,
+                      const char *contentType = "application/json");
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
                          std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto);
 int ReadHTTPHeaders(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet);
+bool HTTPAcceptsChunked(int nProto, const std::map<std::string, std::string>& mapHeaders);
 int ReadHTTPMessage(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet,
                     std::string& strMessageRet, int nProto, size_t max_size);
 std::string JSONRPCRequest(const std::string& strMethod, const json_spirit::Array& params, const json_spirit::Value& id);
@@ -172,4 +176,73 @@ json_spirit::Object JSONRPCReplyObj(const json_spirit::Value& result, const json
 std::string JSONRPCReply(const json_spirit::Value& result, const json_spirit::Value& error, const json_spirit::Value& id);
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
+//! Bytes of a reply collected before they are sent as a chunk
+const size_t HTTP_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * The body of an HTTP reply written as it is produced.  A reply that fits in the buffer goes out whole with a
+ * Content-Length, as HTTPReply() sends it.  Once a reply outgrows the buffer, the header is sent with
+ * "Transfer-Encoding: chunked" and the buffer is sent as a chunk each time it fills, so neither side has to hold
+ * all of it.  That is only done for clients that asked for it, see HTTPAcceptsChunked().  Older releases of
+ * anoncoin-cli can not read chunks, for them and for HTTP/1.0 clients the buffer grows to hold the whole reply.
+ */
+class CHTTPReplyStreamBuf : public std::streambuf
+{
+private:
+    std::ostream& stream;
+    const int nStatus;
+    const bool fKeepAlive;
+    const char* contentType;
+    const bool fAllowChunked;
+    std::vector<char> vBuffer;
+    //! The header went out, the rest of the body follows as chunks
+    bool fChunked;
+
+    void SendChunk();
+
+protected:
+    int overflow(int c);
+
+public:
+    CHTTPReplyStreamBuf(std::ostream& streamIn, int nStatusIn, bool fKeepAliveIn, bool fAllowChunkedIn,
+                        const char* contentTypeIn = "application/json", size_t nChunkSize = HTTP_CHUNK_SIZE);
+
+    //! Whether part of the reply went out already, after which it can not be replaced by an error reply anymore
+    bool IsSent() const { return fChunked; }
+
+    //! Send what is left of the reply, returns false if the connection failed
+    bool Finish();
+};
+
+/**
+ * Writes a JSON document a piece at a time, byte for byte as write_string() without pretty printing would, so a
+ * large result does not have to be built as one json_spirit tree and turned into one string.  Values are written
+ * with write_string(), the callers pass the big arrays and objects a member at a time.
+ */
+class CJSONStreamWriter
+{
+private:
+    std::ostream& stream;
+    //! For each array or object being written, whether it has a member yet
+    std::vector<bool> vHasMembers;
+    //! A key was written, its value comes next
+    bool fAfterKey;
+
+    void Separate();
+
+public:
+    explicit CJSONStreamWriter(std::ostream& streamIn);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! Start a member of the object being written, the value written next is its value
+    void Key(const std::string& strKey);
+    void Write(const json_spirit::Value& value);
+    void Write(const std::string& strKey, const json_spirit::Value& value);
+    //! The members of obj as members of the object being written
+    void WriteMembers(const json_spirit::Object& obj);
+};
+
 #endif  // ANONCOINRPC_PROTOCOL_H
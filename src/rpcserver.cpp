@@ -18,6 +18,9 @@
 #include "wallet.h"
 #endif
 
+#include <deque>
+#include <set>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -291,123 +294,124 @@ Value stop(const Array& params, bool fHelp)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode streamActor
+  //  --------------------- ------------------------  -----------------------  ---------- ----------------------
     /* Overall control/query calls */
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getinfo",                &getinfo,                true,  NULL }, /* uses wallet if enabled */
+    { "control",            "help",                   &help,                   true,  NULL },
+    { "control",            "getrpcinfo",             &getrpcinfo,             true,  NULL },
+    { "control",            "stop",                   &stop,                   true,  NULL },
 
     /* P2P networking */
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "destination",            &destination,            true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "ping",                   &ping,                   true  },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  NULL },
+    { "network",            "addnode",                &addnode,                true,  NULL },
+    { "network",            "destination",            &destination,            true,  NULL },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  NULL },
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,  NULL },
+    { "network",            "getnettotals",           &getnettotals,           true,  NULL },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,  NULL },
+    { "network",            "ping",                   &ping,                   true,  NULL },
 
     /* Block chain and UTXO */
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "invalidateblock",        &invalidateblock,        true  },
-    { "blockchain",         "reconsiderblock",        &reconsiderblock,        true  },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  NULL },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  NULL },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  NULL },
+    { "blockchain",         "getblock",               &getblock,               true,  NULL },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  NULL },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  NULL },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  NULL },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  NULL },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  &getrawmempool_stream },
+    { "blockchain",         "gettxout",               &gettxout,               true,  NULL },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  NULL },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  NULL },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  NULL },
+    { "blockchain",         "verifychain",            &verifychain,            true,  NULL },
+    { "blockchain",         "invalidateblock",        &invalidateblock,        true,  NULL },
+    { "blockchain",         "reconsiderblock",        &reconsiderblock,        true,  NULL },
 
     /* Mining and Coin generation */
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
-    { "mining",             "getretargetpid",         &getretargetpid,         true  },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  NULL },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,  NULL },
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  NULL },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  NULL },
+    { "mining",             "submitblock",            &submitblock,            true,  NULL },
+    { "mining",             "getretargetpid",         &getretargetpid,         true,  NULL },
 #ifdef ENABLE_WALLET
-    { "mining",             "getwork",                &getwork,                true  },
-    { "mining",             "getworkex",              &getworkex,              true  },
-    { "mining",             "getgenerate",            &getgenerate,            true  },
-    { "mining",             "gethashmeter",           &gethashmeter,           true  },
-    { "mining",             "setgenerate",            &setgenerate,            true  },
+    { "mining",             "getwork",                &getwork,                true,  NULL },
+    { "mining",             "getworkex",              &getworkex,              true,  NULL },
+    { "mining",             "getgenerate",            &getgenerate,            true,  NULL },
+    { "mining",             "gethashmeter",           &gethashmeter,           true,  NULL },
+    { "mining",             "setgenerate",            &setgenerate,            true,  NULL },
 #endif
 
     /* Raw transactions */
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  NULL },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  NULL },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  NULL },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  NULL },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, NULL },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, NULL }, /* uses wallet if enabled */
 
     /* Utility functions */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
+    { "util",               "createmultisig",         &createmultisig,         true,  NULL },
+    { "util",               "validateaddress",        &validateaddress,        true,  NULL }, /* uses wallet if enabled */
+    { "util",               "verifymessage",          &verifymessage,          true,  NULL },
+    { "util",               "estimatefee",            &estimatefee,            true,  NULL },
+    { "util",               "estimatepriority",       &estimatepriority,       true,  NULL },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
-    { "hidden",             "makekeypair",            &makekeypair,            true  },
-    { "hidden",             "sendalert",              &sendalert,              true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,  NULL },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  NULL },
+    { "hidden",             "setmocktime",            &setmocktime,            true,  NULL },
+    { "hidden",             "makekeypair",            &makekeypair,            true,  NULL },
+    { "hidden",             "sendalert",              &sendalert,              true,  NULL },
 #ifdef ENABLE_WALLET
-    { "hidden",             "generate",               &generate,               true  },
+    { "hidden",             "generate",               &generate,               true,  NULL },
 #endif
 
 #ifdef ENABLE_WALLET
     /* Wallet */
-    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true  },
-    { "wallet",             "backupwallet",           &backupwallet,           true  },
-    { "wallet",             "dumpprivkey",            &dumpprivkey,            true  },
-    { "wallet",             "dumpwallet",             &dumpwallet,             true  },
-    { "wallet",             "encryptwallet",          &encryptwallet,          true  },
-    { "wallet",             "getaccountaddress",      &getaccountaddress,      true  },
-    { "wallet",             "getaccount",             &getaccount,             true  },
-    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true  },
-    { "wallet",             "getbalance",             &getbalance,             false },
-    { "wallet",             "getnewaddress",          &getnewaddress,          true  },
-    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true  },
-    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false },
-    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false },
-    { "wallet",             "gettransaction",         &gettransaction,         false },
-    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false },
-    { "wallet",             "getwalletinfo",          &getwalletinfo,          false },
-    { "wallet",             "importprivkey",          &importprivkey,          true  },
-    { "wallet",             "importwallet",           &importwallet,           true  },
-    { "wallet",             "importaddress",          &importaddress,          true  },
-    { "wallet",             "keypoolrefill",          &keypoolrefill,          true  },
-    { "wallet",             "listaccounts",           &listaccounts,           false },
-    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false },
-    { "wallet",             "listlockunspent",        &listlockunspent,        false },
-    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false },
-    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false },
-    { "wallet",             "listsinceblock",         &listsinceblock,         false },
-    { "wallet",             "listtransactions",       &listtransactions,       false },
-    { "wallet",             "listunspent",            &listunspent,            false },
-    { "wallet",             "lockunspent",            &lockunspent,            true  },
-    { "wallet",             "move",                   &movecmd,                false },
-    { "wallet",             "resendwallettransactions",&resendwallettransactions,true},
-    { "wallet",             "sendfrom",               &sendfrom,               false },
-    { "wallet",             "sendmany",               &sendmany,               false },
-    { "wallet",             "sendtoaddress",          &sendtoaddress,          false },
-    { "wallet",             "setaccount",             &setaccount,             true  },
-    { "wallet",             "settxfee",               &settxfee,               true  },
-    { "wallet",             "signmessage",            &signmessage,            true  },
-    { "wallet",             "walletlock",             &walletlock,             true  },
-    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true  },
-    { "wallet",             "walletpassphrase",       &walletpassphrase,       true  },
+    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true,  NULL },
+    { "wallet",             "backupwallet",           &backupwallet,           true,  NULL },
+    { "wallet",             "dumpprivkey",            &dumpprivkey,            true,  NULL },
+    { "wallet",             "dumpwallet",             &dumpwallet,             true,  NULL },
+    { "wallet",             "encryptwallet",          &encryptwallet,          true,  NULL },
+    { "wallet",             "getaccountaddress",      &getaccountaddress,      true,  NULL },
+    { "wallet",             "getaccount",             &getaccount,             true,  NULL },
+    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true,  NULL },
+    { "wallet",             "getbalance",             &getbalance,             false, NULL },
+    { "wallet",             "getnewaddress",          &getnewaddress,          true,  NULL },
+    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true,  NULL },
+    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false, NULL },
+    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false, NULL },
+    { "wallet",             "gettransaction",         &gettransaction,         false, NULL },
+    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false, NULL },
+    { "wallet",             "getwalletinfo",          &getwalletinfo,          false, NULL },
+    { "wallet",             "importprivkey",          &importprivkey,          true,  NULL },
+    { "wallet",             "importwallet",           &importwallet,           true,  NULL },
+    { "wallet",             "importaddress",          &importaddress,          true,  NULL },
+    { "wallet",             "keypoolrefill",          &keypoolrefill,          true,  NULL },
+    { "wallet",             "listaccounts",           &listaccounts,           false, NULL },
+    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false, NULL },
+    { "wallet",             "listlockunspent",        &listlockunspent,        false, NULL },
+    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false, NULL },
+    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false, NULL },
+    { "wallet",             "listsinceblock",         &listsinceblock,         false, NULL },
+    { "wallet",             "listtransactions",       &listtransactions,       false, NULL },
+    { "wallet",             "listunspent",            &listunspent,            false, NULL },
+    { "wallet",             "lockunspent",            &lockunspent,            true,  NULL },
+    { "wallet",             "move",                   &movecmd,                false, NULL },
+    { "wallet",             "resendwallettransactions",&resendwallettransactions,true,  NULL },
+    { "wallet",             "sendfrom",               &sendfrom,               false, NULL },
+    { "wallet",             "sendmany",               &sendmany,               false, NULL },
+    { "wallet",             "sendtoaddress",          &sendtoaddress,          false, NULL },
+    { "wallet",             "setaccount",             &setaccount,             true,  NULL },
+    { "wallet",             "settxfee",               &settxfee,               true,  NULL },
+    { "wallet",             "signmessage",            &signmessage,            true,  NULL },
+    { "wallet",             "walletlock",             &walletlock,             true,  NULL },
+    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true,  NULL },
+    { "wallet",             "walletpassphrase",       &walletpassphrase,       true,  NULL },
 #endif // ENABLE_WALLET
 };
 
@@ -486,16 +490,103 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
+//! Seconds a request may stall and a keep-alive connection may wait for the next one (-rpcservertimeout)
+static int nRPCServerTimeout = DEFAULT_RPC_SERVER_TIMEOUT;
+
+/**
+ * A connection the server answers one request at a time on.  Between requests it waits in the io_service for the
+ * client to send the next one, without holding a thread, and a worker takes it from the queue to answer it.
+ */
+class RPCConnection : public AcceptedConnection
+{
+private:
+    boost::mutex csDeadline;
+    //! When the read or write a worker is in should be given up on, 0 outside of one
+    int64_t nIODeadline;
+
+public:
+    const bool fUseSSL;
+    //! Waiting for a request, which the idle timer may end.  Only used on the io_service thread
+    bool fWaiting;
+    deadline_timer idleTimer;
+
+    RPCConnection(boost::asio::io_service& io_service, bool fUseSSLIn) : nIODeadline(0), fUseSSL(fUseSSLIn), fWaiting(false), idleTimer(io_service) {}
+
+    //! Call handler on the io_service thread once the client sent something
+    virtual void AsyncWaitReadable(const boost::function<void (const boost::system::error_code&)>& handler) = 0;
+    //! Whether the next request was read along with the last one already, the socket does not signal it again
+    virtual bool HasBufferedInput() = 0;
+    //! Make the blocked read or write fail, the worker closes the connection
+    virtual void Abort() = 0;
+
+    void BeginIO()
+    {
+        boost::unique_lock<boost::mutex> lock(csDeadline);
+        nIODeadline = GetTime() + nRPCServerTimeout;
+    }
+
+    void EndIO()
+    {
+        boost::unique_lock<boost::mutex> lock(csDeadline);
+        nIODeadline = 0;
+    }
+
+    bool IsStalled(int64_t nNow)
+    {
+        boost::unique_lock<boost::mutex> lock(csDeadline);
+        return nIODeadline != 0 && nNow > nIODeadline;
+    }
+};
+
+/**
+ * The device of a server connection, which gives every read and write -rpcservertimeout seconds.  Once asio waited
+ * on a socket asynchronously it is non-blocking underneath, its blocking reads and writes then wait in poll()
+ * without a limit and SO_RCVTIMEO/SO_SNDTIMEO have no effect.  The work queue watchdog aborts the ones that run over.
+ */
 template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class RPCStreamDevice : public SSLIOStreamDevice<Protocol>
+{
+private:
+    RPCConnection* pconn;
+
+    class CIOScope
+    {
+        RPCConnection* pconn;
+    public:
+        CIOScope(RPCConnection* pconnIn) : pconn(pconnIn) { pconn->BeginIO(); }
+        ~CIOScope() { pconn->EndIO(); }
+    };
+
+public:
+    RPCStreamDevice(boost::asio::ssl::stream<typename Protocol::socket> &streamIn, bool fUseSSLIn, RPCConnection* pconnIn) :
+        SSLIOStreamDevice<Protocol>(streamIn, fUseSSLIn), pconn(pconnIn) {}
+
+    std::streamsize read(char* s, std::streamsize n)
+    {
+        CIOScope scope(pconn);
+        return SSLIOStreamDevice<Protocol>::read(s, n);
+    }
+
+    std::streamsize write(const char* s, std::streamsize n)
+    {
+        CIOScope scope(pconn);
+        return SSLIOStreamDevice<Protocol>::write(s, n);
+    }
+};
+
+typedef boost::shared_ptr<RPCConnection> RPCConnectionPtr;
+
+template <typename Protocol>
+class AcceptedConnectionImpl : public RPCConnection
 {
 public:
     AcceptedConnectionImpl(
             boost::asio::io_service& io_service,
             ssl::context &context,
             bool fUseSSL) :
+        RPCConnection(io_service, fUseSSL),
         sslStream(io_service, context),
-        _d(sslStream, fUseSSL),
+        _d(sslStream, fUseSSL, this),
         _stream(_d)
     {
     }
@@ -513,24 +604,301 @@ public:
     virtual void close()
     {
         _stream.close();
+        boost::system::error_code ec;
+        sslStream.lowest_layer().close(ec);
+    }
+
+    virtual void AsyncWaitReadable(const boost::function<void (const boost::system::error_code&)>& handler)
+    {
+        sslStream.next_layer().async_read_some(boost::asio::null_buffers(), boost::bind(handler, boost::asio::placeholders::error));
+    }
+
+    virtual bool HasBufferedInput()
+    {
+        if (_stream.rdbuf()->in_avail() > 0)
+            return true;
+        return fUseSSL && SSL_pending(sslStream.native_handle()) > 0;
+    }
+
+    virtual void Abort()
+    {
+        // Shutting down wakes a read or write waiting in poll(), closing the descriptor under it would not be safe
+        boost::system::error_code ec;
+        sslStream.lowest_layer().shutdown(boost::asio::socket_base::shutdown_both, ec);
     }
 
     typename Protocol::endpoint peer;
     boost::asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
-    SSLIOStreamDevice<Protocol> _d;
-    boost::iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
+    RPCStreamDevice<Protocol> _d;
+    boost::iostreams::stream< RPCStreamDevice<Protocol> > _stream;
 };
 
-void ServiceConnection(AcceptedConnection *conn);
+static bool ServiceRequest(AcceptedConnection *conn);
+static void RPCWaitForRequest(RPCConnectionPtr conn);
+
+/**
+ * The requests waiting for a worker.  Connections only get here once the client sent a request, idle ones wait in
+ * the io_service, so a few keep-alive clients can not take all the workers.  The queue is bounded, when it is full
+ * further requests are turned away with a 503 instead of piling up.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    boost::condition_variable condWatchdog;
+    std::deque<std::pair<RPCConnectionPtr, int64_t> > queue;
+    //! The connections the workers are answering
+    std::set<RPCConnectionPtr> setServing;
+    boost::thread_group* pThreadGroup;
+    size_t nMaxDepth;
+    bool fRunning;
+    int nWorkers;
+    int nThreads;
+    int nBusy;
+    int nLongPolls;
+    size_t nPeakDepth;
+    uint64_t nRequests;
+    uint64_t nRejected;
+    uint64_t nIdleClosed;
+    uint64_t nStalled;
+    int64_t nTotalWaitMicros;
+    int64_t nMaxWaitMicros;
+
+public:
+    CRPCWorkQueue() : pThreadGroup(NULL), nMaxDepth(0), fRunning(false), nWorkers(0), nThreads(0), nBusy(0), nLongPolls(0),
+                      nPeakDepth(0), nRequests(0), nRejected(0), nIdleClosed(0), nStalled(0), nTotalWaitMicros(0),
+                      nMaxWaitMicros(0) {}
+
+    //! Start the workers and the watchdog in threadGroup
+    void Start(size_t nMaxDepthIn, int nWorkersIn, boost::thread_group& threadGroup)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        pThreadGroup = &threadGroup;
+        nMaxDepth = nMaxDepthIn;
+        nWorkers = nWorkersIn;
+        fRunning = true;
+        for (nThreads = 0; nThreads < nWorkers; nThreads++)
+            pThreadGroup->create_thread(boost::bind(&CRPCWorkQueue::Run, this));
+        pThreadGroup->create_thread(boost::bind(&CRPCWorkQueue::Watchdog, this));
+    }
+
+    //! Make the workers return once they answered the request they are on, and drop the waiting ones.  Replies
+    //! still being read or written are aborted, the client may never finish them.
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        queue.clear();
+        BOOST_FOREACH(const RPCConnectionPtr& conn, setServing)
+            conn->Abort();
+        cond.notify_all();
+        condWatchdog.notify_all();
+    }
+
+    bool Enqueue(const RPCConnectionPtr& conn)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning || queue.size() >= nMaxDepth) {
+            nRejected++;
+            return false;
+        }
+        queue.push_back(std::make_pair(conn, GetTimeMicros()));
+        nPeakDepth = std::max(nPeakDepth, queue.size());
+        cond.notify_one();
+        return true;
+    }
+
+    void IdleClosed()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nIdleClosed++;
+    }
+
+    //! A worker, answering the requests in the order they came in
+    void Run()
+    {
+        while (true) {
+            RPCConnectionPtr conn;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    return;
+                conn = queue.front().first;
+                int64_t nWaitMicros = GetTimeMicros() - queue.front().second;
+                queue.pop_front();
+                nTotalWaitMicros += nWaitMicros;
+                nMaxWaitMicros = std::max(nMaxWaitMicros, nWaitMicros);
+                nBusy++;
+                setServing.insert(conn);
+            }
+            bool fKeepAlive = false;
+            try {
+                fKeepAlive = ServiceRequest(conn.get());
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Error: %s\n", __func__, e.what());
+            }
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                setServing.erase(conn);
+                nBusy--;
+                nRequests++;
+            }
+            // Socket operations are started from the io_service thread, as are the ones of the other connections
+            if (fKeepAlive && IsRPCRunning())
+                rpc_io_service->post(boost::bind(&RPCWaitForRequest, conn));
+            else
+                conn->close();
+        }
+    }
+
+    //! Once a second, abort the reads and writes a client has stalled for longer than -rpcservertimeout
+    void Watchdog()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (fRunning) {
+            condWatchdog.timed_wait(lock, boost::posix_time::seconds(1));
+            int64_t nNow = GetTime();
+            BOOST_FOREACH(const RPCConnectionPtr& conn, setServing) {
+                if (!conn->IsStalled(nNow))
+                    continue;
+                LogPrint("rpc", "Aborting RPC connection from %s, stalled for %d seconds\n", conn->peer_address_to_string(), nRPCServerTimeout);
+                conn->Abort();
+                conn->EndIO();
+                nStalled++;
+            }
+        }
+    }
+
+    /**
+     * The worker calling this is about to wait for a long time.  While fewer than -rpcthreads others are left for
+     * short calls, another worker is started in its place, up to MAX_RPC_LONGPOLL_THREADS more.  These stay for
+     * the next long poll.
+     */
+    void BeginLongPoll()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nLongPolls++;
+        if (fRunning && nThreads - nLongPolls < nWorkers && nThreads < nWorkers + MAX_RPC_LONGPOLL_THREADS) {
+            pThreadGroup->create_thread(boost::bind(&CRPCWorkQueue::Run, this));
+            nThreads++;
+        }
+    }
+
+    void EndLongPoll()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nLongPolls--;
+    }
+
+    Object GetInfo()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        Object obj;
+        obj.push_back(Pair("workers", nWorkers));
+        obj.push_back(Pair("threads", nThreads));
+        obj.push_back(Pair("busy", nBusy));
+        obj.push_back(Pair("longpolls", nLongPolls));
+        obj.push_back(Pair("depth", (uint64_t)queue.size()));
+        obj.push_back(Pair("maxdepth", (uint64_t)nMaxDepth));
+        obj.push_back(Pair("peakdepth", (uint64_t)nPeakDepth));
+        obj.push_back(Pair("requests", nRequests));
+        obj.push_back(Pair("rejected", nRejected));
+        obj.push_back(Pair("idleclosed", nIdleClosed));
+        obj.push_back(Pair("stalled", nStalled));
+        obj.push_back(Pair("avgwaitms", nRequests ? nTotalWaitMicros * 0.001 / nRequests : 0.0));
+        obj.push_back(Pair("maxwaitms", nMaxWaitMicros * 0.001));
+        return obj;
+    }
+};
+
+static CRPCWorkQueue rpcWorkQueue;
+
+//! Hand the connection to a worker, or turn the request away if too many are waiting
+static void RPCEnqueue(const RPCConnectionPtr& conn)
+{
+    if (rpcWorkQueue.Enqueue(conn))
+        return;
+    LogPrint("rpc", "RPC work queue full, turning away a request from %s\n", conn->peer_address_to_string());
+    // Over SSL the reply would have to wait for the handshake, the client sees the connection closed instead
+    if (!conn->fUseSSL)
+        conn->stream() << HTTPError(HTTP_SERVICE_UNAVAILABLE, false) << std::flush;
+    conn->close();
+}
+
+static void RPCRequestReady(RPCConnectionPtr conn, const boost::system::error_code& error)
+{
+    conn->fWaiting = false;
+    boost::system::error_code ec;
+    conn->idleTimer.cancel(ec);
+    // An error is the idle timer or the shutdown closing the connection
+    if (!error)
+        RPCEnqueue(conn);
+}
+
+static void RPCIdleTimeout(RPCConnectionPtr conn, const boost::system::error_code& error)
+{
+    if (error || !conn->fWaiting)
+        return;
+    LogPrint("rpc", "Closing RPC connection from %s, no request for %d seconds\n", conn->peer_address_to_string(), nRPCServerTimeout);
+    rpcWorkQueue.IdleClosed();
+    conn->close();
+}
+
+/** Wait for the next request on the connection without holding a thread, on the io_service thread */
+static void RPCWaitForRequest(RPCConnectionPtr conn)
+{
+    if (conn->HasBufferedInput()) {
+        RPCEnqueue(conn);
+        return;
+    }
+    conn->fWaiting = true;
+    conn->idleTimer.expires_from_now(boost::posix_time::seconds(nRPCServerTimeout));
+    conn->idleTimer.async_wait(boost::bind(&RPCIdleTimeout, conn, boost::asio::placeholders::error));
+    conn->AsyncWaitReadable(boost::bind(&RPCRequestReady, conn, _1));
+}
+
+Value getrpcinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the state of the queue of requests waiting for an RPC worker.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workers\": n,          (numeric) The threads answering requests, see -rpcthreads\n"
+            "  \"threads\": n,          (numeric) The workers started, including those taking the place of long polls\n"
+            "  \"busy\": n,             (numeric) The workers answering a request, this one included\n"
+            "  \"longpolls\": n,        (numeric) The workers waiting in a long poll\n"
+            "  \"depth\": n,            (numeric) The requests waiting for a worker\n"
+            "  \"maxdepth\": n,         (numeric) The requests that may wait before more are turned away, see -rpcworkqueue\n"
+            "  \"peakdepth\": n,        (numeric) The most requests that waited at once\n"
+            "  \"requests\": n,         (numeric) The requests answered\n"
+            "  \"rejected\": n,         (numeric) The requests turned away as too many were waiting\n"
+            "  \"idleclosed\": n,       (numeric) The keep-alive connections closed after -rpcservertimeout seconds without a request\n"
+            "  \"stalled\": n,          (numeric) The connections aborted as a read or write stalled for -rpcservertimeout seconds\n"
+            "  \"avgwaitms\": x.xxx,    (numeric) The average time requests waited for a worker in milliseconds\n"
+            "  \"maxwaitms\": x.xxx     (numeric) The longest time a request waited for a worker in milliseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    return rpcWorkQueue.GetInfo();
+}
+
 
 //! Forward declaration required for RPCListen
 template <typename Protocol>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol> > acceptor,
                              ssl::context& context,
                              bool fUseSSL,
-                             boost::shared_ptr< AcceptedConnection > conn,
+                             RPCConnectionPtr conn,
                              const boost::system::error_code& error);
 
 /**
@@ -563,7 +931,7 @@ template <typename Protocol>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol> > acceptor,
                              ssl::context& context,
                              const bool fUseSSL,
-                             boost::shared_ptr< AcceptedConnection > conn,
+                             RPCConnectionPtr conn,
                              const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
@@ -587,10 +955,8 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol>
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
         conn->close();
     }
-    else {
-        ServiceConnection(conn.get());
-        conn->close();
-    }
+    else
+        RPCWaitForRequest(conn);
 }
 
 static ip::tcp::endpoint ParseEndpoint(const std::string &strEndpoint, int defaultPort)
@@ -652,6 +1018,8 @@ void StartRPCThreads()
         return;
     }
 
+    nRPCServerTimeout = std::max((int)GetArg("-rpcservertimeout", DEFAULT_RPC_SERVER_TIMEOUT), 1);
+
     assert(rpc_io_service == NULL);
     rpc_io_service = new boost::asio::io_service();
     rpc_ssl_context = new ssl::context(ssl::context::sslv23);
@@ -754,9 +1122,12 @@ void StartRPCThreads()
         return;
     }
 
+    // One thread runs the io_service, it accepts the connections and waits on them between requests.  The
+    // -rpcthreads workers answer the requests, a watchdog aborts the ones a client stalls.
+    int nWorkers = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&boost::asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&boost::asio::io_service::run, rpc_io_service));
+    rpcWorkQueue.Start(std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1), nWorkers, *rpc_worker_group);
     fRPCRunning = true;
     g_rpcSignals.Started();
 }
@@ -800,6 +1171,8 @@ void StopRPCThreads()
     }
     deadlineTimers.clear();
 
+    // The workers return once done with the request they are on, long polls see fRPCRunning cleared
+    rpcWorkQueue.Interrupt();
     rpc_io_service->stop();
     g_rpcSignals.Stopped();
     if (rpc_worker_group != NULL)
@@ -815,6 +1188,16 @@ bool IsRPCRunning()
     return fRPCRunning;
 }
 
+void RPCBeginLongPoll()
+{
+    rpcWorkQueue.BeginLongPoll();
+}
+
+void RPCEndLongPoll()
+{
+    rpcWorkQueue.EndLongPoll();
+}
+
 void SetRPCWarmupStatus(const std::string& newStatus)
 {
     LOCK(cs_rpcWarmup);
@@ -941,10 +1324,42 @@ static string JSONRPCExecBatch(const Array& vReq)
     return write_string(Value(ret), false) + "\n";
 }
 
+/**
+ * Send the reply to a request, writing the result of the command as it is produced.  Errors before any of the reply
+ * went out are thrown, to be sent as usual.  After that the status can not change anymore, the connection is closed
+ * and the client sees the reply cut short.
+ */
+static bool StreamJSONRPCReply(AcceptedConnection *conn, const JSONRequest& jreq, bool fRun, bool fAllowChunked)
+{
+    CHTTPReplyStreamBuf buf(conn->stream(), HTTP_OK, fRun, fAllowChunked);
+    std::ostream out(&buf);
+    CJSONStreamWriter writer(out);
+    try
+    {
+        writer.BeginObject();
+        writer.Key("result");
+        tableRPC.executeStream(jreq.strMethod, jreq.params, writer);
+        writer.Write("error", Value::null);
+        writer.Write("id", jreq.id);
+        writer.EndObject();
+        out << "\n";
+    }
+    catch (...)
+    {
+        if (!buf.IsSent())
+            throw;
+        LogPrintf("%s : Error in %s after part of the reply was sent to %s\n", __func__, jreq.strMethod, conn->peer_address_to_string());
+        return false;
+    }
+    LogPrint("rpcio", "ThreadRPCServer streamed response to %s\n", jreq.strMethod);
+    return buf.Finish();
+}
+
 static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
                             string& strRequest,
                             map<string, string>& mapHeaders,
-                            bool fRun)
+                            bool fRun,
+                            int nProto)
 {
     // Check authorization
     if (mapHeaders.count("authorization") == 0)
@@ -986,6 +1401,11 @@ static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
         if (valRequest.type() == obj_type) {
             jreq.parse(valRequest);
 
+            // Commands with large results write the reply as they produce it
+            const CRPCCommand *pcmd = tableRPC[jreq.strMethod];
+            if (pcmd && pcmd->streamActor)
+                return StreamJSONRPCReply(conn, jreq, fRun, HTTPAcceptsChunked(nProto, mapHeaders));
+
             Value result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -1014,43 +1434,45 @@ static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection *conn)
+/** Read and answer one request on the connection, returns whether the client keeps it open for more */
+static bool ServiceRequest(AcceptedConnection *conn)
 {
-    bool fRun = true;
-    while (fRun && !ShutdownRequested())
-    {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
+    if (ShutdownRequested())
+        return false;
 
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
+    int nProto = 0;
+    map<string, string> mapHeaders;
+    string strRequest, strMethod, strURI;
 
-        //! Read HTTP message headers and body...
-        //! Fixed max_size so it does not generate server 500 errors on processing,
-        //! MAX_SIZE was to vague, now using a good size, defined in rpcprotocol.h
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, POST_READ_SIZE);
+    // Read HTTP request line
+    if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
+        return false;
 
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
+    //! Read HTTP message headers and body...
+    //! Fixed max_size so it does not generate server 500 errors on processing,
+    //! MAX_SIZE was to vague, now using a good size, defined in rpcprotocol.h
+    ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, POST_READ_SIZE);
 
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    // HTTP Keep-Alive is false; close connection immediately
+    bool fRun = true;
+    if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
+        fRun = false;
 
-        // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+    // Process via JSON-RPC API
+    if (strURI == "/") {
+        if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun, nProto))
+            return false;
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
+    // Process via HTTP REST API
+    } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+        if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun, nProto))
+            return false;
+
+    } else {
+        conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        return false;
     }
+    return fRun;
 }
 
 json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
@@ -1075,6 +1497,29 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+void CRPCTable::executeStream(const std::string &strMethod, const json_spirit::Array &params, CJSONStreamWriter& writer) const
+{
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (!pcmd || !pcmd->streamActor) {
+        writer.Write(execute(strMethod, params));
+        return;
+    }
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try
+    {
+        // Execute
+        pcmd->streamActor(params, writer);
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+}
+
 std::string HelpExampleCli(string methodname, string args){
     return "> anoncoin-cli " + methodname + " " + args + "\n";
 }
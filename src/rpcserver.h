@@ -37,6 +37,15 @@ namespace RPCServer
 class CBlockIndex;
 class CNetAddr;
 
+//! Threads answering RPC and REST requests
+static const int DEFAULT_RPC_THREADS = 4;
+//! Requests that may wait for a free thread before more are turned away
+static const int DEFAULT_RPC_WORKQUEUE = 16;
+//! Seconds a request may stall and a keep-alive connection may wait for the next one
+static const int DEFAULT_RPC_SERVER_TIMEOUT = 30;
+//! Threads started beyond -rpcthreads so long polls do not hold up the other calls
+static const int MAX_RPC_LONGPOLL_THREADS = 16;
+
 class AcceptedConnection
 {
 public:
@@ -59,6 +68,20 @@ void StartDummyRPCThread();
 void StopRPCThreads();
 /** Query whether RPC is running */
 bool IsRPCRunning();
+/**
+ * Mark the calling RPC worker as waiting in a long poll, another worker takes its place for the
+ * other calls.  A no-op when the server is not running.
+ */
+void RPCBeginLongPoll();
+void RPCEndLongPoll();
+
+/** Marks the RPC worker as waiting in a long poll for its lifetime */
+class CRPCLongPoll
+{
+public:
+    CRPCLongPoll() { RPCBeginLongPoll(); }
+    ~CRPCLongPoll() { RPCEndLongPoll(); }
+};
 
 /**
  * Set the RPC warmup status.  When this is done, all RPC calls will error out
@@ -95,6 +118,7 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
 
 typedef json_spirit::Value(*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
+typedef void(*rpcstreamfn_type)(const json_spirit::Array& params, CJSONStreamWriter& writer);
 
 class CRPCCommand
 {
@@ -103,6 +127,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Optional, writes the result of actor a piece at a time for commands whose results can get large
+    rpcstreamfn_type streamActor;
 };
 
 /**
@@ -125,6 +151,13 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string &method, const json_spirit::Array &params) const;
+
+    /**
+     * Execute a method, writing its result to writer as it is produced.  Methods without a streamActor are run
+     * with execute() and their result written whole.
+     * @throws as execute() does, once part of the result was written the document in writer is incomplete.
+     */
+    void executeStream(const std::string &method, const json_spirit::Array &params, CJSONStreamWriter& writer) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -214,6 +247,7 @@ extern json_spirit::Value walletlock(const json_spirit::Array& params, bool fHel
 extern json_spirit::Value encryptwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value validateaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getrpcinfo(const json_spirit::Array& params, bool fHelp); // in rpcserver.cpp
 extern json_spirit::Value getwalletinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockchaininfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnetworkinfo(const json_spirit::Array& params, bool fHelp);
@@ -238,6 +272,7 @@ extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool f
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern void getrawmempool_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxoutsetinfo(const json_spirit::Array& params, bool fHelp);
@@ -255,7 +290,8 @@ extern json_spirit::Value makekeypair(const json_spirit::Array& params, bool fHe
 extern bool HTTPReq_REST(AcceptedConnection *conn,
                   std::string& strURI,
                   std::map<std::string, std::string>& mapHeaders,
-                  bool fRun);
+                  bool fRun,
+                  int nProto);
 
 extern void InitializeTestNetBlocks();
 #endif // ANONCOINRPC_SERVER_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2009 Colin Percival, 2011 ArtForz, 2012-2013 pooler
+ * Copyright (c) 2013-2017 The Anoncoin Core developers
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file was originally written by Colin Percival as part of the Tarsnap
+ * online backup system.
+ */
+
+#include "scrypt.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <smmintrin.h>
+
+//! Four independent scrypt lanes are processed together. The 32 word B/X state
+//! of each lane is held transposed, word k of all four lanes lives in X[k], so
+//! that Salsa20/8 runs over whole registers without any shuffles.
+
+#define ROTL_4WAY(a, b) _mm_or_si128(_mm_slli_epi32((a), (b)), _mm_srli_epi32((a), 32 - (b)))
+
+static inline void xor_salsa8_4way(__m128i B[16], const __m128i Bx[16])
+{
+	__m128i x00,x01,x02,x03,x04,x05,x06,x07,x08,x09,x10,x11,x12,x13,x14,x15;
+	int i;
+
+	x00 = (B[ 0] = _mm_xor_si128(B[ 0], Bx[ 0]));
+	x01 = (B[ 1] = _mm_xor_si128(B[ 1], Bx[ 1]));
+	x02 = (B[ 2] = _mm_xor_si128(B[ 2], Bx[ 2]));
+	x03 = (B[ 3] = _mm_xor_si128(B[ 3], Bx[ 3]));
+	x04 = (B[ 4] = _mm_xor_si128(B[ 4], Bx[ 4]));
+	x05 = (B[ 5] = _mm_xor_si128(B[ 5], Bx[ 5]));
+	x06 = (B[ 6] = _mm_xor_si128(B[ 6], Bx[ 6]));
+	x07 = (B[ 7] = _mm_xor_si128(B[ 7], Bx[ 7]));
+	x08 = (B[ 8] = _mm_xor_si128(B[ 8], Bx[ 8]));
+	x09 = (B[ 9] = _mm_xor_si128(B[ 9], Bx[ 9]));
+	x10 = (B[10] = _mm_xor_si128(B[10], Bx[10]));
+	x11 = (B[11] = _mm_xor_si128(B[11], Bx[11]));
+	x12 = (B[12] = _mm_xor_si128(B[12], Bx[12]));
+	x13 = (B[13] = _mm_xor_si128(B[13], Bx[13]));
+	x14 = (B[14] = _mm_xor_si128(B[14], Bx[14]));
+	x15 = (B[15] = _mm_xor_si128(B[15], Bx[15]));
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		x04 = _mm_xor_si128(x04, ROTL_4WAY(_mm_add_epi32(x00, x12),  7));
+		x09 = _mm_xor_si128(x09, ROTL_4WAY(_mm_add_epi32(x05, x01),  7));
+		x14 = _mm_xor_si128(x14, ROTL_4WAY(_mm_add_epi32(x10, x06),  7));
+		x03 = _mm_xor_si128(x03, ROTL_4WAY(_mm_add_epi32(x15, x11),  7));
+
+		x08 = _mm_xor_si128(x08, ROTL_4WAY(_mm_add_epi32(x04, x00),  9));
+		x13 = _mm_xor_si128(x13, ROTL_4WAY(_mm_add_epi32(x09, x05),  9));
+		x02 = _mm_xor_si128(x02, ROTL_4WAY(_mm_add_epi32(x14, x10),  9));
+		x07 = _mm_xor_si128(x07, ROTL_4WAY(_mm_add_epi32(x03, x15),  9));
+
+		x12 = _mm_xor_si128(x12, ROTL_4WAY(_mm_add_epi32(x08, x04), 13));
+		x01 = _mm_xor_si128(x01, ROTL_4WAY(_mm_add_epi32(x13, x09), 13));
+		x06 = _mm_xor_si128(x06, ROTL_4WAY(_mm_add_epi32(x02, x14), 13));
+		x11 = _mm_xor_si128(x11, ROTL_4WAY(_mm_add_epi32(x07, x03), 13));
+
+		x00 = _mm_xor_si128(x00, ROTL_4WAY(_mm_add_epi32(x12, x08), 18));
+		x05 = _mm_xor_si128(x05, ROTL_4WAY(_mm_add_epi32(x01, x13), 18));
+		x10 = _mm_xor_si128(x10, ROTL_4WAY(_mm_add_epi32(x06, x02), 18));
+		x15 = _mm_xor_si128(x15, ROTL_4WAY(_mm_add_epi32(x11, x07), 18));
+
+		/* Operate on rows. */
+		x01 = _mm_xor_si128(x01, ROTL_4WAY(_mm_add_epi32(x00, x03),  7));
+		x06 = _mm_xor_si128(x06, ROTL_4WAY(_mm_add_epi32(x05, x04),  7));
+		x11 = _mm_xor_si128(x11, ROTL_4WAY(_mm_add_epi32(x10, x09),  7));
+		x12 = _mm_xor_si128(x12, ROTL_4WAY(_mm_add_epi32(x15, x14),  7));
+
+		x02 = _mm_xor_si128(x02, ROTL_4WAY(_mm_add_epi32(x01, x00),  9));
+		x07 = _mm_xor_si128(x07, ROTL_4WAY(_mm_add_epi32(x06, x05),  9));
+		x08 = _mm_xor_si128(x08, ROTL_4WAY(_mm_add_epi32(x11, x10),  9));
+		x13 = _mm_xor_si128(x13, ROTL_4WAY(_mm_add_epi32(x12, x15),  9));
+
+		x03 = _mm_xor_si128(x03, ROTL_4WAY(_mm_add_epi32(x02, x01), 13));
+		x04 = _mm_xor_si128(x04, ROTL_4WAY(_mm_add_epi32(x07, x06), 13));
+		x09 = _mm_xor_si128(x09, ROTL_4WAY(_mm_add_epi32(x08, x11), 13));
+		x14 = _mm_xor_si128(x14, ROTL_4WAY(_mm_add_epi32(x13, x12), 13));
+
+		x00 = _mm_xor_si128(x00, ROTL_4WAY(_mm_add_epi32(x03, x02), 18));
+		x05 = _mm_xor_si128(x05, ROTL_4WAY(_mm_add_epi32(x04, x07), 18));
+		x10 = _mm_xor_si128(x10, ROTL_4WAY(_mm_add_epi32(x09, x08), 18));
+		x15 = _mm_xor_si128(x15, ROTL_4WAY(_mm_add_epi32(x14, x13), 18));
+	}
+	B[ 0] = _mm_add_epi32(B[ 0], x00);
+	B[ 1] = _mm_add_epi32(B[ 1], x01);
+	B[ 2] = _mm_add_epi32(B[ 2], x02);
+	B[ 3] = _mm_add_epi32(B[ 3], x03);
+	B[ 4] = _mm_add_epi32(B[ 4], x04);
+	B[ 5] = _mm_add_epi32(B[ 5], x05);
+	B[ 6] = _mm_add_epi32(B[ 6], x06);
+	B[ 7] = _mm_add_epi32(B[ 7], x07);
+	B[ 8] = _mm_add_epi32(B[ 8], x08);
+	B[ 9] = _mm_add_epi32(B[ 9], x09);
+	B[10] = _mm_add_epi32(B[10], x10);
+	B[11] = _mm_add_epi32(B[11], x11);
+	B[12] = _mm_add_epi32(B[12], x12);
+	B[13] = _mm_add_epi32(B[13], x13);
+	B[14] = _mm_add_epi32(B[14], x14);
+	B[15] = _mm_add_epi32(B[15], x15);
+}
+
+/**
+ * Hash exactly four consecutive 80 byte inputs into four consecutive 32 byte outputs.
+ * The scratchpad must be at least 4 * 131072 + 63 bytes, see SCRYPT_MULTI_SCRATCHPAD_SIZE.
+ */
+void scrypt_1024_1_1_256_sp_4way_sse41(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[4][128];
+	union {
+		__m128i i128[32];
+		uint32_t u32[32][4];
+	} X;
+	__m128i *V;
+	const uint32_t *V32;
+	uint32_t i, j0, j1, j2, j3, k, l;
+
+	V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	V32 = (const uint32_t *)V;
+
+	for (l = 0; l < 4; l++) {
+		PBKDF2_SHA256((const uint8_t *)&input[l * 80], 80, (const uint8_t *)&input[l * 80], 80, 1, B[l], 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[l][4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i128[k];
+		xor_salsa8_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_4way(&X.i128[16], &X.i128[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		//! Every lane indexes the scratchpad independently, gather its words into the register
+		j0 = 128 * (X.u32[16][0] & 1023) + 0;
+		j1 = 128 * (X.u32[16][1] & 1023) + 1;
+		j2 = 128 * (X.u32[16][2] & 1023) + 2;
+		j3 = 128 * (X.u32[16][3] & 1023) + 3;
+		for (k = 0; k < 32; k++) {
+			__m128i T = _mm_cvtsi32_si128(V32[j0 + k * 4]);
+			T = _mm_insert_epi32(T, V32[j1 + k * 4], 1);
+			T = _mm_insert_epi32(T, V32[j2 + k * 4], 2);
+			T = _mm_insert_epi32(T, V32[j3 + k * 4], 3);
+			X.i128[k] = _mm_xor_si128(X.i128[k], T);
+		}
+		xor_salsa8_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_4way(&X.i128[16], &X.i128[0]);
+	}
+
+	for (l = 0; l < 4; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[l][4 * k], X.u32[k][l]);
+		PBKDF2_SHA256((const uint8_t *)&input[l * 80], 80, B[l], 128, 1, (uint8_t *)&output[l * 32], 32);
+	}
+}
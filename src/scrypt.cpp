@@ -52,6 +52,7 @@
 
 //! Constants found in this source codes header(.h)
 const int32_t SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
+const int32_t SCRYPT_MULTI_SCRATCHPAD_SIZE = 8 * 131072 + 63;
 
 static inline uint32_t be32dec(const void *pp)
 {
@@ -295,26 +296,47 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
+//! Multi-lane engine, it hashes exactly nScryptMultiLanes inputs per call.  Until scrypt_detect_sse2()
+//! has been called, it is not set and every input goes through the single lane function.
+static void (*scrypt_1024_1_1_256_sp_lanes)(const char *input, char *output, char *scratchpad) = NULL;
+static uint32_t nScryptMultiLanes = 1;
+
 #if defined(USE_SSE2)
 // By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
 void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
 
+#if !defined(USE_SSE2_ALWAYS) && !defined(_MSC_VER)
+//! True if the OS saves and restores the ymm registers (XCR0 bits 1 and 2) on a context switch
+static bool OSSupportsAVX()
+{
+    uint32_t a, d;
+    __asm__ ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 void scrypt_detect_sse2()
 {
 #if defined(USE_SSE2_ALWAYS)
     LogPrintf("scrypt: Powered by scrypt-sse2, as built.  Hardware detection disabled.\n");
 #else // USE_SSE2_ALWAYS
     // 32bit x86 Linux or Windows, detect cpuid features
-    unsigned int cpuid_edx=0;
+    unsigned int cpuid_ecx=0, cpuid_edx=0, cpuid7_ebx=0;
 #if defined(_MSC_VER)
     // MSVC
     int x86cpuid[4];
     __cpuid(x86cpuid, 1);
-    cpuid_edx = (unsigned int)buffer[3];
+    cpuid_ecx = (unsigned int)x86cpuid[2];
+    cpuid_edx = (unsigned int)x86cpuid[3];
 #else // _MSC_VER
     // Linux or i686-w64-mingw32 (gcc-4.6.3)
-    unsigned int eax, ebx, ecx;
-    __get_cpuid(1, &eax, &ebx, &ecx, &cpuid_edx);
+    unsigned int eax, ebx;
+    __get_cpuid(1, &eax, &ebx, &cpuid_ecx, &cpuid_edx);
+    //! AVX2 is reported in leaf 7, but is only usable when the OS has enabled the ymm state (OSXSAVE + XCR0)
+    if ((cpuid_ecx & 1<<27) && OSSupportsAVX() && __get_cpuid_max(0, NULL) >= 7) {
+        unsigned int ecx7, edx7;
+        __cpuid_count(7, 0, eax, cpuid7_ebx, ecx7, edx7);
+    }
 #endif // _MSC_VER
 
     if (cpuid_edx & 1<<26)
@@ -327,10 +349,49 @@ void scrypt_detect_sse2()
         scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_generic;
         LogPrintf("scrypt: Using scrypt-generic, SSE2 hardware unavailable.\n");
     }
+
+    scrypt_1024_1_1_256_sp_lanes = NULL;
+    nScryptMultiLanes = 1;
+#if defined(ENABLE_AVX2)
+    if (cpuid7_ebx & 1<<5) {
+        scrypt_1024_1_1_256_sp_lanes = &scrypt_1024_1_1_256_sp_8way_avx2;
+        nScryptMultiLanes = 8;
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (!scrypt_1024_1_1_256_sp_lanes && (cpuid_ecx & 1<<19)) {
+        scrypt_1024_1_1_256_sp_lanes = &scrypt_1024_1_1_256_sp_4way_sse41;
+        nScryptMultiLanes = 4;
+    }
+#endif
+    if (scrypt_1024_1_1_256_sp_lanes)
+        LogPrintf("scrypt: Batched hashing powered by the %s %u-way engine.\n", nScryptMultiLanes == 8 ? "avx2" : "sse4.1", nScryptMultiLanes);
 #endif // USE_SSE2_ALWAYS
 }
 #endif
 
+uint32_t scrypt_multi_lanes()
+{
+    return nScryptMultiLanes;
+}
+
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, uint32_t nCount, char *scratchpad)
+{
+    uint32_t i = 0;
+    if (scrypt_1024_1_1_256_sp_lanes) {
+        for (; i + nScryptMultiLanes <= nCount; i += nScryptMultiLanes)
+            scrypt_1024_1_1_256_sp_lanes(&input[i * 80], &output[i * 32], scratchpad);
+    }
+    for (; i < nCount; i++)
+        scrypt_1024_1_1_256_sp(&input[i * 80], &output[i * 32], scratchpad);
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, uint32_t nCount)
+{
+    boost::scoped_array<char> spScratchPad( new char[ SCRYPT_MULTI_SCRATCHPAD_SIZE ] );
+    scrypt_1024_1_1_256_sp_multi(input, output, nCount, spScratchPad.get());
+}
+
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
     //! Switch to using a scoped pointer for the scratchpad buffer...
@@ -16,10 +16,22 @@
 #include <stdint.h>
 
 extern const int32_t SCRYPT_SCRATCHPAD_SIZE;
+//! Large enough for the widest multi-lane engine, 8 independent 128KB scratchpads
+extern const int32_t SCRYPT_MULTI_SCRATCHPAD_SIZE;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/**
+ * Batched scrypt, hashes nCount consecutive 80 byte inputs (block headers) into nCount consecutive
+ * 32 byte outputs.  Groups of scrypt_multi_lanes() inputs are run through the widest SIMD engine
+ * detected at runtime, any remainder falls back to the single lane scrypt_1024_1_1_256_sp().
+ * The scratchpad version requires a buffer of at least SCRYPT_MULTI_SCRATCHPAD_SIZE bytes.
+ */
+void scrypt_1024_1_1_256_multi(const char *input, char *output, uint32_t nCount);
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, uint32_t nCount, char *scratchpad);
+uint32_t scrypt_multi_lanes();
+
 #if defined(USE_SSE2)
 // GR note: Commented out, because the machine building this is not the target host, we can only allow detecting the possibility of using that hardware.
 // #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
@@ -32,6 +44,13 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 void scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
 extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
+//! The multi-lane engines hash exactly their lane count of inputs per call
+#if defined(ENABLE_SSE41)
+void scrypt_1024_1_1_256_sp_4way_sse41(const char *input, char *output, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX2)
+void scrypt_1024_1_1_256_sp_8way_avx2(const char *input, char *output, char *scratchpad);
+#endif
 #else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
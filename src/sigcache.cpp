@@ -6,13 +6,15 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
 #include "key.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <algorithm>
+#include <limits>
+#include <string.h>
 
 using namespace boost;
 using namespace std;
@@ -43,71 +45,133 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     return true;
 }
 
-namespace {
+void CSignatureCache::ComputeEntry(uint64_t entry[4], const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    unsigned char digest[CSHA256::OUTPUT_SIZE];
+    CSHA256(hasherSalted).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.empty() ? NULL : &vchSig[0], vchSig.size()).Finalize(digest);
+    memcpy(entry, digest, sizeof(digest));
+    // All zeros marks an empty entry
+    if ((entry[0] | entry[1] | entry[2] | entry[3]) == 0)
+        entry[0] = 1;
+}
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+CSignatureCache::CBucket& CSignatureCache::Bucket(const uint64_t entry[4], unsigned int n) const
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+    return buckets[((entry[n] >> 32) * nBuckets) >> 32];
+}
+
+bool CSignatureCache::Contains(const CBucket& bucket, const uint64_t entry[4]) const
+{
+    uint32_t nSequence = bucket.nSequence.load(boost::memory_order_acquire);
+    if (nSequence & 1)
         return false;
+    bool fFound = false;
+    for (unsigned int i = 0; i < BUCKET_ENTRIES && !fFound; i++) {
+        fFound = bucket.entries[i][0].load(boost::memory_order_relaxed) == entry[0] &&
+                 bucket.entries[i][1].load(boost::memory_order_relaxed) == entry[1] &&
+                 bucket.entries[i][2].load(boost::memory_order_relaxed) == entry[2] &&
+                 bucket.entries[i][3].load(boost::memory_order_relaxed) == entry[3];
     }
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    return fFound && bucket.nSequence.load(boost::memory_order_relaxed) == nSequence;
+}
+
+bool CSignatureCache::Insert(CBucket& bucket, const uint64_t entry[4], bool fEvict)
+{
+    uint32_t nSequence = bucket.nSequence.load(boost::memory_order_relaxed);
+    if ((nSequence & 1) || !bucket.nSequence.compare_exchange_strong(nSequence, nSequence + 1, boost::memory_order_acquire))
+        return false;
+    boost::atomic_thread_fence(boost::memory_order_release);
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    unsigned int nSlot = BUCKET_ENTRIES;
+    for (unsigned int i = 0; i < BUCKET_ENTRIES && nSlot == BUCKET_ENTRIES; i++) {
+        if ((bucket.entries[i][0].load(boost::memory_order_relaxed) | bucket.entries[i][1].load(boost::memory_order_relaxed) |
+             bucket.entries[i][2].load(boost::memory_order_relaxed) | bucket.entries[i][3].load(boost::memory_order_relaxed)) == 0)
+            nSlot = i;
+    }
+    // Evict an entry picked by the digest, which is as unpredictable as a random one
+    if (nSlot == BUCKET_ENTRIES && fEvict)
+        nSlot = (uint32_t)entry[2] % BUCKET_ENTRIES;
+    if (nSlot != BUCKET_ENTRIES) {
+        for (unsigned int j = 0; j < 4; j++)
+            bucket.entries[nSlot][j].store(entry[j], boost::memory_order_relaxed);
     }
-};
 
+    bucket.nSequence.store(nSequence + 2, boost::memory_order_release);
+    return nSlot != BUCKET_ENTRIES;
 }
 
-bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+CSignatureCache::~CSignatureCache()
+{
+    delete[] buckets;
+}
+
+size_t CSignatureCache::Setup(uint64_t nBytes)
+{
+    delete[] buckets;
+    buckets = NULL;
+    nBuckets = std::min(nBytes / sizeof(CBucket), std::min((uint64_t)std::numeric_limits<uint32_t>::max(), (uint64_t)std::numeric_limits<size_t>::max() / sizeof(CBucket)));
+    if (nBuckets == 0)
+        return 0;
+
+    buckets = new CBucket[nBuckets];
+    for (uint32_t n = 0; n < nBuckets; n++) {
+        buckets[n].nSequence.store(0, boost::memory_order_relaxed);
+        for (unsigned int i = 0; i < BUCKET_ENTRIES; i++)
+            for (unsigned int j = 0; j < 4; j++)
+                buckets[n].entries[i][j].store(0, boost::memory_order_relaxed);
+    }
+
+    uint256 nonce = GetRandHash();
+    static const unsigned char PADDING[32] = {0};
+    hasherSalted = CSHA256();
+    hasherSalted.Write(nonce.begin(), 32).Write(PADDING, sizeof(PADDING));
+    return (size_t)nBuckets * BUCKET_ENTRIES;
+}
+
+bool CSignatureCache::Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
+{
+    if (buckets == NULL)
+        return false;
+    uint64_t entry[4];
+    ComputeEntry(entry, hash, vchSig, pubKey);
+    return Contains(Bucket(entry, 0), entry) || Contains(Bucket(entry, 1), entry);
+}
+
+void CSignatureCache::Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    if (buckets == NULL)
+        return;
+    uint64_t entry[4];
+    ComputeEntry(entry, hash, vchSig, pubKey);
+    // Prefer a free entry in either bucket, only when both are full evict one from the first
+    if (!Insert(Bucket(entry, 0), entry, false) && !Insert(Bucket(entry, 1), entry, false))
+        Insert(Bucket(entry, 0), entry, true);
+}
+
+namespace {
+
+CSignatureCache signatureCache;
+
+}
+
+void InitSignatureCache()
 {
-    static CSignatureCache signatureCache;
+    uint64_t nBytes = (uint64_t)DEFAULT_SIG_CACHE_MIB << 20;
+    if (mapArgs.count("-sigcachemib"))
+        nBytes = (uint64_t)std::max((int64_t)0, std::min(GetArg("-sigcachemib", DEFAULT_SIG_CACHE_MIB), MAX_SIG_CACHE_MIB)) << 20;
+    else if (mapArgs.count("-maxsigcachesize")) {
+        // Older releases counted entries here, keep the same number of them
+        int64_t nMaxEntries = std::max((int64_t)0, GetArg("-maxsigcachesize", 0));
+        nBytes = std::min((uint64_t)nMaxEntries * CSignatureCache::BytesPerEntry(), (uint64_t)MAX_SIG_CACHE_MIB << 20);
+        LogPrintf("-maxsigcachesize is deprecated, use -sigcachemib to size the signature cache in MiB\n");
+    }
+    size_t nEntries = signatureCache.Setup(nBytes);
+    LogPrintf("Using %u KiB for the signature cache, able to store %u elements\n", (unsigned int)(nBytes >> 10), (unsigned int)nEntries);
+}
 
+bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
 
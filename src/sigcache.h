@@ -7,13 +7,74 @@
 #ifndef ANONCOIN_SCRIPT_SIGCACHE_H
 #define ANONCOIN_SCRIPT_SIGCACHE_H
 
+#include "crypto/sha256.h"
 #include "script.h"
 #include "transaction.h"
+#include "uint256.h"
 
+#include <stdint.h>
 #include <vector>
 
+#include <boost/atomic.hpp>
+
 class CPubKey;
 
+/** Default for -sigcachemib, the size of the signature cache in MiB */
+static const int64_t DEFAULT_SIG_CACHE_MIB = 32;
+/** Largest -sigcachemib accepted */
+static const int64_t MAX_SIG_CACHE_MIB = 1024;
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ *
+ * An entry is just the 32 byte digest of (signature hash, signature, public key),
+ * salted with a secret nonce so nobody can aim entries at the same bucket.  Each
+ * digest may live in either of two buckets of a fixed size table.  Every bucket
+ * is guarded by a sequence number instead of a lock: a reader that sees it change
+ * while it looks reports a miss, which is always safe, as the signature is then
+ * just verified again.  A writer that finds its bucket being written by another
+ * thread drops its entry for the same reason.
+ */
+class CSignatureCache
+{
+private:
+    static const unsigned int BUCKET_ENTRIES = 4;
+
+    struct CBucket
+    {
+        //! Odd while a writer is changing the bucket
+        boost::atomic<uint32_t> nSequence;
+        //! The digests as 64-bit words, all zeros is an empty entry
+        boost::atomic<uint64_t> entries[BUCKET_ENTRIES][4];
+    };
+
+    CBucket* buckets;
+    uint32_t nBuckets;
+    //! SHA256 state after the salt and padding to a full block
+    CSHA256 hasherSalted;
+
+    void ComputeEntry(uint64_t entry[4], const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+    //! The two buckets an entry may be kept in
+    CBucket& Bucket(const uint64_t entry[4], unsigned int n) const;
+    bool Contains(const CBucket& bucket, const uint64_t entry[4]) const;
+    bool Insert(CBucket& bucket, const uint64_t entry[4], bool fEvict);
+
+public:
+    CSignatureCache() : buckets(NULL), nBuckets(0) {}
+    ~CSignatureCache();
+
+    //! The memory an entry takes in the table
+    static size_t BytesPerEntry() { return sizeof(CBucket) / BUCKET_ENTRIES; }
+
+    //! Sizes the table to at most nBytes, returns the number of entries it holds.  Not to be called while in use.
+    size_t Setup(uint64_t nBytes);
+
+    bool Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const;
+    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
+};
+
 // v10 code that needs a new home, it can not go into script.h as we have it structured today Todo:...upgrage to the new script subsystem...
 
 // More classes and code from v10.  This was needed somewhere else a couple days ago, now trying to build with it for anoncoin-tx
@@ -63,6 +124,9 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Sizes the signature cache from -sigcachemib, until then CachingTransactionSignatureChecker caches nothing */
+void InitSignatureCache();
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 
 #endif // ANONCOIN_SCRIPT_SIGCACHE_H
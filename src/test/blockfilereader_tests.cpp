@@ -0,0 +1,71 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilereader.h"
+
+#include "tinyformat.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilereader_tests)
+
+//! Append the bytes nBegin...nBegin+nSize-1 of a counting pattern to the file
+static void AppendPattern(const boost::filesystem::path& path, unsigned int nBegin, unsigned int nSize)
+{
+    FILE* file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file != NULL);
+    for (unsigned int i = nBegin; i < nBegin + nSize; i++)
+        fputc(i & 0xff, file);
+    fclose(file);
+}
+
+static bool CheckPattern(const std::vector<char>& vData, unsigned int nBegin)
+{
+    for (unsigned int i = 0; i < vData.size(); i++) {
+        if ((unsigned char)vData[i] != ((nBegin + i) & 0xff))
+            return false;
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(blockfilereader_read)
+{
+    boost::filesystem::path dir = GetDataDir() / "blockfilereader";
+    boost::filesystem::create_directories(dir);
+    std::vector<boost::filesystem::path> vPaths;
+    for (unsigned int i = 0; i < 3; i++) {
+        vPaths.push_back(dir / strprintf("blk%05u.dat", i));
+        AppendPattern(vPaths.back(), i, 1000);
+    }
+
+    // Keep two of the three files open, so they are closed and opened again as the reads go round
+    CBlockFileReader reader(2);
+    std::vector<char> vData(100);
+    for (unsigned int nRound = 0; nRound < 5; nRound++) {
+        for (unsigned int i = 0; i < vPaths.size(); i++) {
+            BOOST_CHECK(reader.Read(vPaths[i], 10 * nRound, &vData[0], vData.size()));
+            BOOST_CHECK(CheckPattern(vData, i + 10 * nRound));
+            BOOST_CHECK(reader.GetOpenCount() <= 2);
+        }
+    }
+
+    // Reading past the end fails, until the file has grown
+    BOOST_CHECK(!reader.Read(vPaths[2], 950, &vData[0], vData.size()));
+    AppendPattern(vPaths[2], 1002, 50);
+    BOOST_CHECK(reader.Read(vPaths[2], 950, &vData[0], vData.size()));
+    BOOST_CHECK(CheckPattern(vData, 952));
+
+    BOOST_CHECK(!reader.Read(dir / "blk99999.dat", 0, &vData[0], vData.size()));
+
+    reader.CloseAll();
+    BOOST_CHECK_EQUAL(reader.GetOpenCount(), 0U);
+    BOOST_CHECK(reader.Read(vPaths[0], 0, &vData[0], vData.size()));
+    BOOST_CHECK(CheckPattern(vData, 0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Counts how often it runs, and fails when told to
+struct CCountingCheck
+{
+    boost::atomic<unsigned int>* pnRun;
+    bool fResult;
+
+    CCountingCheck() : pnRun(NULL), fResult(true) {}
+    CCountingCheck(boost::atomic<unsigned int>* pnRunIn, bool fResultIn) : pnRun(pnRunIn), fResult(fResultIn) {}
+
+    bool operator()()
+    {
+        (*pnRun)++;
+        return fResult;
+    }
+
+    void swap(CCountingCheck& check)
+    {
+        std::swap(pnRun, check.pnRun);
+        std::swap(fResult, check.fResult);
+    }
+};
+
+void QueueThread(CCheckQueue<CCountingCheck>* pqueue)
+{
+    pqueue->Thread();
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checks_run)
+{
+    CCheckQueue<CCountingCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 7; i++)
+        threadGroup.create_thread(boost::bind(&QueueThread, &queue));
+
+    boost::atomic<unsigned int> nRun(0);
+    unsigned int nExpected = 0;
+    for (unsigned int nRound = 0; nRound < 50; nRound++) {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        // Batches of every size, from the single check of a one input transaction up
+        for (unsigned int nSize = 0; nSize < 40; nSize++) {
+            std::vector<CCountingCheck> vChecks(nSize, CCountingCheck(&nRun, true));
+            control.Add(vChecks);
+            nExpected += nSize;
+        }
+        BOOST_CHECK(control.Wait());
+        BOOST_CHECK_EQUAL(nRun.load(), nExpected);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CCountingCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&QueueThread, &queue));
+
+    boost::atomic<unsigned int> nRun(0);
+    for (unsigned int nFail = 0; nFail < 1000; nFail += 97) {
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            std::vector<CCountingCheck> vChecks;
+            for (unsigned int i = 0; i < 1000; i++)
+                vChecks.push_back(CCountingCheck(&nRun, i != nFail));
+            control.Add(vChecks);
+            BOOST_CHECK(!control.Wait());
+        }
+        // The failure is reset for the next block
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(100, CCountingCheck(&nRun, true));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,12 @@
 
 #include "coins.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 
 #include <vector>
 #include <map>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
@@ -70,6 +72,8 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // It will randomly create/update/delete CCoins entries to a tip of caches, with
 // txids picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
+// When it is the only one, the cache also has its dirty entries written out and
+// is trimmed the way the coins flusher does it, instead of being flushed.
 //
 // During the process, booleans are kept to make sure that the randomized
 // operation hits all branches.
@@ -83,6 +87,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool flushed_dirty_only = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<uint256, CCoins> result;
@@ -139,6 +144,13 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 
         if (insecure_rand() % 100 == 0) {
             // Every 100 iterations, change the cache stack.
+            if (stack.size() == 1 && insecure_rand() % 2 == 0) {
+                CCoinsMap mapDirty;
+                uint256 hashBlock = stack[0]->CopyDirtyCoins(mapDirty);
+                BOOST_CHECK(stack[0]->GetBackend()->BatchWrite(mapDirty, hashBlock));
+                stack[0]->EvictClean(insecure_rand() % (stack[0]->GetCacheSize() + 1));
+                flushed_dirty_only = true;
+            }
             if (stack.size() > 0 && insecure_rand() % 2 == 0) {
                 stack.back()->Flush();
                 delete stack.back();
@@ -173,6 +185,94 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(flushed_dirty_only);
+}
+
+//! The coin database with the best block read where releases from before the per output layout look for it
+class CCoinsViewDBOlderRelease : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBOlderRelease() : CCoinsViewDB(1 << 20, true, true) {}
+
+    uint256 GetOlderReleaseBestBlock() const
+    {
+        uint256 hashBestChain;
+        db.Read('B', hashBestChain);
+        return hashBestChain;
+    }
+};
+
+// Create and spend the same coins in two databases, one of them upgraded to a record per unspent output halfway, and
+// check that they keep reading back the same coins.
+BOOST_AUTO_TEST_CASE(coins_db_per_output)
+{
+    CCoinsViewDB dbPerTx(1 << 20, true, true);
+    CCoinsViewDBOlderRelease dbPerOutput;
+    BOOST_CHECK(!dbPerOutput.IsPerOutput());
+
+    std::vector<uint256> txids(200);
+    for (unsigned int i = 0; i < txids.size(); i++)
+        txids[i] = GetRandHash();
+
+    std::set<uint256> created;
+    bool spent_an_output = false;
+    bool recreated_a_tx = false;
+    for (unsigned int nRound = 0; nRound < 40; nRound++) {
+        if (nRound == 20) {
+            BOOST_CHECK(dbPerOutput.GetOlderReleaseBestBlock() == dbPerTx.GetBestBlock());
+            BOOST_CHECK(dbPerOutput.UpgradeToPerOutput());
+            BOOST_CHECK(dbPerOutput.IsPerOutput());
+            BOOST_CHECK(!dbPerOutput.IsUpgrading());
+            // The best block survives the upgrade, but an older release can not find it anymore
+            BOOST_CHECK(dbPerOutput.GetBestBlock() == dbPerTx.GetBestBlock());
+            BOOST_CHECK(dbPerOutput.GetOlderReleaseBestBlock() != dbPerTx.GetBestBlock());
+        }
+        CCoinsViewCache cachePerTx(&dbPerTx);
+        CCoinsViewCache cachePerOutput(&dbPerOutput);
+        for (unsigned int i = 0; i < 100; i++) {
+            const uint256& txid = txids[insecure_rand() % txids.size()];
+            CCoins coins;
+            cachePerTx.GetCoins(txid, coins);
+            if (coins.IsPruned()) {
+                recreated_a_tx |= !created.insert(txid).second;
+                coins.nVersion = 1 + insecure_rand() % 2;
+                coins.nHeight = insecure_rand() % 100000;
+                coins.fCoinBase = insecure_rand() % 2;
+                coins.vout.resize(1 + insecure_rand() % 4);
+                for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                    coins.vout[n].nValue = insecure_rand() % 100000;
+                    coins.vout[n].scriptPubKey = CScript() << std::vector<unsigned char>(insecure_rand() % 40, n);
+                }
+            } else {
+                unsigned int n = insecure_rand() % coins.vout.size();
+                while (coins.vout[n].IsNull())
+                    n = (n + 1) % coins.vout.size();
+                coins.vout[n].SetNull();
+                coins.Cleanup();
+                spent_an_output = true;
+            }
+            *cachePerTx.ModifyCoins(txid) = coins;
+            *cachePerOutput.ModifyCoins(txid) = coins;
+        }
+        uint256 hashBlock = GetRandHash();
+        cachePerTx.SetBestBlock(hashBlock);
+        cachePerOutput.SetBestBlock(hashBlock);
+        BOOST_CHECK(cachePerTx.Flush());
+        BOOST_CHECK(cachePerOutput.Flush());
+        BOOST_CHECK(dbPerOutput.GetBestBlock() == hashBlock);
+
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            CCoins coinsPerTx, coinsPerOutput;
+            bool fPerTx = dbPerTx.GetCoins(txids[i], coinsPerTx);
+            BOOST_CHECK_EQUAL(fPerTx, dbPerOutput.GetCoins(txids[i], coinsPerOutput));
+            BOOST_CHECK_EQUAL(fPerTx, dbPerOutput.HaveCoins(txids[i]));
+            if (fPerTx)
+                BOOST_CHECK(coinsPerTx == coinsPerOutput);
+        }
+    }
+
+    BOOST_CHECK(spent_an_output);
+    BOOST_CHECK(recreated_a_tx);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "util.h"
 
@@ -283,4 +284,25 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Every batch size up to a few more than the widest implementation runs at once, through each of them
+    for (int fAllowSIMD = 0; fAllowSIMD <= 1; fAllowSIMD++) {
+        BOOST_TEST_MESSAGE("SHA-256 implementation: " << SHA256AutoDetect(fAllowSIMD));
+        for (int i = 0; i <= 32; i++) {
+            std::vector<unsigned char> in(64 * i), out1(32 * i), out2(32 * i);
+            if (i)
+                GetRandBytes(&in[0], in.size());
+            for (int j = 0; j < i; j++)
+                CHash256().Write(&in[64 * j], 64).Finalize(&out1[32 * j]);
+            if (i)
+                SHA256D64(&out2[0], &in[0], i);
+            BOOST_CHECK(out1 == out2);
+        }
+        // The implementation may hash all the whole chunks of a long write at once
+        TestSHA256(std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "streams.h"
 #include "util.h"
 
 #include <vector>
@@ -47,4 +48,126 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+// Reference digests of m[i] = i*13+7 produced by the original table driven implementation
+static const struct {
+    size_t len;
+    const char *hash512;
+    const char *hash256;
+} gostKAT[] = {
+    {0, "8a1a1c4cbf909f8ecb81cd1b5c713abad26a4cac2a5fda3ce86e352855712f36a7f0be98eb6cf51553b507b73a87e97946aebc29859255049f86aa09a25d948e",
+        "bbe19c8d2025d99f943a932a0b365a822aa36a4c479d22cc02c8973e219a533f"},
+    {1, "19e23c34d908ac2976448a721b4c62e80bb2910a0310081d0885c3440d37a7f3a01432ac0eec756f1dde510876aee69742542bed82be52d7c0bd76b53c8e8f97",
+        "5c512a01bf85567edb27d54f4e919cc8fab9d80ec57b142fd87af34f3d1d7d63"},
+    {63, "a0042644952c29dd999f400803ba3249d5d4439c1457f6505e27842e11b265c2daae2d175d073f4a31b369c5bb605eef0f6d29fafee61f2fcc1153da3c3fcce1",
+        "057647882376e9b3fd51772210e52f6dc3b865f699414ff1230190ede39aed77"},
+    {64, "c0d3de6d3c8bd412c1c40d0b0e9f769823b05e3abd910907474eac9d0c3acce8b27ebd6acccb09e63a886c3aca6882ccdf98fa534f666db0231a2c2b80e22e3c",
+        "17c9ed0961f88d24988145fddf0c95ea561845385560e6be59847bee2bc36b27"},
+    {65, "9b7667665e2c9dee55a6784cf897ce983245982f88ea6560a8228d22acc74bbe412ea25e7cefedc87f0ac537dc67840b4a1bcd83487afce67380913184a8a37f",
+        "adcef4b3960fd0e81ac148f105a36adaa722599262e651b3f5e423f4322f47bc"},
+    {80, "ea65a541388a7009899f8c266b7f47c1a0b9d9ffac963134c9ce343706839bb8adbfa18aaf29a2d89decb14e47e6495510bea0ec4ab9f4c3d2735421077042df",
+        "10be2104521bb75a65a1d9b1f6a3ce366bd1410663c115c0e24056a7700e192b"},
+    {128, "4488ae20d3f7bf3ab55d30d71d5e338bfb8debf543955b5b5e7329ffdccfa67dfb87749383829052cf67ce7acbe7ec572a0c1cc57b976bc769ddaa5df4b01b09",
+        "d241d4173dc4cfb9848e79bcc5e9f388d36486097824e4ea20e13e5f9bd35adc"},
+    {200, "c0e4c033d4ed7b8f44c646d6562abe4de18db51cf78b31d0c0a3f2c2e3014acb2dd32f43e8b4825cde5cf087cc1e822c6284562d06f588ea3e6d2ffe18f58fe9",
+        "e7ef823f120ac9740f4e610349e6f56b650011cdca56a374d57ae5ab11bcaef4"},
+};
+
+static void CheckGostKAT()
+{
+    std::vector<unsigned char> msg(200);
+    for (size_t i = 0; i < msg.size(); i++)
+        msg[i] = (unsigned char)(i * 13 + 7);
+
+    for (size_t n = 0; n < sizeof(gostKAT) / sizeof(gostKAT[0]); n++) {
+        unsigned char out512[CGOST3411::OUTPUT_SIZE_512];
+        unsigned char out256[CGOST3411::OUTPUT_SIZE_256];
+        i2p::crypto::GOSTR3411_2012_512(&msg[0], gostKAT[n].len, out512);
+        i2p::crypto::GOSTR3411_2012_256(&msg[0], gostKAT[n].len, out256);
+        BOOST_CHECK_EQUAL(HexStr(out512, out512 + sizeof(out512)), gostKAT[n].hash512);
+        BOOST_CHECK_EQUAL(HexStr(out256, out256 + sizeof(out256)), gostKAT[n].hash256);
+
+        // The same digests written in odd sized pieces, crossing the inline buffer limit
+        for (size_t nStep = 1; nStep <= 71; nStep += 35) {
+            CGOST3411 ctx512, ctx256(true);
+            for (size_t i = 0; i < gostKAT[n].len; i += nStep) {
+                size_t nChunk = std::min(nStep, gostKAT[n].len - i);
+                ctx512.Write(&msg[i], nChunk);
+                ctx256.Write(&msg[i], nChunk);
+            }
+            BOOST_CHECK_EQUAL(ctx256.OutputSize(), CGOST3411::OUTPUT_SIZE_256);
+            ctx512.Finalize(out512);
+            ctx256.Finalize(out256);
+            BOOST_CHECK_EQUAL(HexStr(out512, out512 + sizeof(out512)), gostKAT[n].hash512);
+            BOOST_CHECK_EQUAL(HexStr(out256, out256 + sizeof(out256)), gostKAT[n].hash256);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(gost3411_backends)
+{
+    // The portable implementation, then whichever one the cpu selects
+    const std::vector<unsigned char> vHeader = ParseHex(gostKAT[5].hash512);
+    i2p::crypto::GOSTR3411_2012_AutoDetect(false);
+    CheckGostKAT();
+    uint256 hashGeneric = HashGOST(vHeader.begin(), vHeader.end());
+
+    i2p::crypto::GOSTR3411_2012_AutoDetect();
+    CheckGostKAT();
+    BOOST_CHECK(HashGOST(vHeader.begin(), vHeader.end()) == hashGeneric);
+
+    // Reset must leave the context as good as new
+    CGOST3411 ctx;
+    unsigned char out1[CGOST3411::OUTPUT_SIZE_512], out2[CGOST3411::OUTPUT_SIZE_512];
+    ctx.Write((const unsigned char*)"abc", 3).Finalize(out1);
+    ctx.Reset().Write((const unsigned char*)"abc", 3).Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, sizeof(out1)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(gost3411_header_midstate)
+{
+    unsigned char header[CGOST3411HeaderHasher::HEADER_SIZE];
+    for (size_t i = 0; i < sizeof(header); i++)
+        header[i] = (unsigned char)(i * 31 + 5);
+
+    CGOST3411HeaderHasher hasher;
+    hasher.SetHeader(header);
+    const uint32_t nFirstNonce = 0xfffffffa, nCount = 11;
+    std::vector<unsigned char> vHashes(nCount * CGOST3411HeaderHasher::OUTPUT_SIZE);
+    hasher.HashNonces(nFirstNonce, nCount, &vHashes[0]);
+
+    for (uint32_t i = 0; i < nCount; i++) {
+        const uint32_t nNonce = nFirstNonce + i;
+        memcpy(header + 76, &nNonce, 4);
+        unsigned char hash1[CGOST3411::OUTPUT_SIZE_512], hash2[CGOST3411::OUTPUT_SIZE_256], hash3[CGOST3411HeaderHasher::OUTPUT_SIZE];
+        i2p::crypto::GOSTR3411_2012_512(header, sizeof(header), hash1);
+        i2p::crypto::GOSTR3411_2012_256(hash1, sizeof(hash1), hash2);
+        hasher.Hash(nNonce, hash3);
+        BOOST_CHECK(memcmp(hash2, hash3, sizeof(hash2)) == 0);
+        BOOST_CHECK(memcmp(hash2, &vHashes[i * CGOST3411HeaderHasher::OUTPUT_SIZE], sizeof(hash2)) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hashwriter_gost3411)
+{
+    std::vector<unsigned char> vData(300);
+    for (size_t i = 0; i < vData.size(); i++)
+        vData[i] = (unsigned char)(i * 7 + 1);
+
+    // Written in pieces, past the inline buffer of the GOST context
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    CGostHashWriter gss(SER_GETHASH, PROTOCOL_VERSION);
+    for (size_t i = 0; i < vData.size(); i += 100) {
+        ss.write((const char*)&vData[i], 100);
+        gss.write((const char*)&vData[i], 100);
+    }
+    BOOST_CHECK(ss.GetHash() == Hash(vData.begin(), vData.end()));
+    BOOST_CHECK(gss.GetHash() == HashGOST(vData.begin(), vData.end()));
+
+    // SerializeGost3411Hash() includes the compact size prefix of the vector
+    CDataStream stream(SER_GETHASH, PROTOCOL_VERSION);
+    stream << vData;
+    BOOST_CHECK(SerializeGost3411Hash(vData) == HashGOST(stream.begin(), stream.end()));
+    BOOST_CHECK(SerializeHash(vData) == Hash(stream.begin(), stream.end()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
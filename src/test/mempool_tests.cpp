@@ -0,0 +1,275 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txmempool.h"
+
+#include "clientversion.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "sign.h"
+#include "streams.h"
+#include "util.h"
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! A standard, signed spend of output n of hashPrev to scriptPubKey, which pays nFee
+CTransaction MakeSignedSpend(const CKeyStore& keystore, const CScript& scriptPubKey, const uint256& hashPrev, uint32_t n,
+                             CAmount nValueIn, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    tx.vout[0].nValue = nValueIn - nFee;
+    BOOST_CHECK(SignSignature(keystore, scriptPubKey, tx, 0));
+    return CTransaction(tx);
+}
+
+CTransaction MakeSpend(const uint256& hashPrev, uint32_t n, unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[i].nValue = 10 * COIN;
+    }
+    return CTransaction(tx);
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+BOOST_AUTO_TEST_CASE(mempool_ancestor_state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    std::list<CTransaction> removed;
+
+    CTransaction txParent = MakeSpend(uint256(1), 0, 2);
+    CTransaction txChild = MakeSpend(txParent.GetHash(), 0, 1);
+    CTransaction txGrandChild = MakeSpend(txChild.GetHash(), 0, 1);
+    CTransaction txOther = MakeSpend(uint256(2), 0, 1);
+    CTxMemPoolEntry entryParent(txParent, 1000, 0, 0.0, 1);
+    CTxMemPoolEntry entryChild(txChild, 20000, 0, 0.0, 1);
+    CTxMemPoolEntry entryGrandChild(txGrandChild, 3000, 0, 0.0, 1);
+
+    pool.addUnchecked(txParent.GetHash(), entryParent);
+    pool.addUnchecked(txChild.GetHash(), entryChild);
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itChild = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(itChild->second.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(itChild->second.GetSizeWithAncestors(), entryParent.GetTxSize() + entryChild.GetTxSize());
+    BOOST_CHECK_EQUAL(itChild->second.GetModFeesWithAncestors(), 21000);
+    BOOST_CHECK(pool.GetMemPoolChildren(itParent).count(itChild));
+    BOOST_CHECK(pool.GetMemPoolParents(itChild).count(itParent));
+
+    // The child pays for its parent, so their package comes before the parent alone
+    BOOST_CHECK(*pool.setByAncestorFeeRate.begin() == itChild);
+
+    // A fee delta on the parent counts for every package it is in
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 5000);
+    BOOST_CHECK_EQUAL(itParent->second.GetModifiedFee(), 6000);
+    BOOST_CHECK_EQUAL(itChild->second.GetModFeesWithAncestors(), 26000);
+
+    pool.addUnchecked(txGrandChild.GetHash(), entryGrandChild);
+    CTxMemPool::txiter itGrandChild = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(itGrandChild->second.GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(itGrandChild->second.GetModFeesWithAncestors(), 29000);
+
+    // Confirming the parent takes it out of the packages of its descendants
+    pool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1U);
+    BOOST_CHECK_EQUAL(itChild->second.GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(itChild->second.GetModFeesWithAncestors(), 20000);
+    BOOST_CHECK_EQUAL(itGrandChild->second.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(itGrandChild->second.GetModFeesWithAncestors(), 23000);
+    BOOST_CHECK(pool.GetMemPoolParents(itChild).empty());
+
+    // A reorg puts the parent back under its children
+    pool.addUnchecked(txParent.GetHash(), entryParent);
+    itParent = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itParent->second.GetModifiedFee(), 6000);
+    BOOST_CHECK_EQUAL(itChild->second.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(itGrandChild->second.GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(itGrandChild->second.GetModFeesWithAncestors(), 29000);
+
+    pool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 0, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(pool.setByAncestorFeeRate.size(), 4U);
+    BOOST_CHECK_EQUAL(pool.setByPriority.size(), 4U);
+
+    // Removing the parent recursively takes its descendants along, and leaves the rest alone
+    removed.clear();
+    pool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 3U);
+    BOOST_CHECK_EQUAL(pool.mapTx.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.setByAncestorFeeRate.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.setByPriority.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), pool.mapTx.begin()->second.GetTxSize());
+}
+
+BOOST_AUTO_TEST_CASE(mempool_descendant_state_and_trim)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    CTransaction txParent = MakeSpend(uint256(1), 0, 1);
+    CTransaction txChild = MakeSpend(txParent.GetHash(), 0, 1);
+    CTransaction txRich = MakeSpend(uint256(2), 0, 1);
+    CTransaction txPoor = MakeSpend(uint256(3), 0, 1);
+    CTxMemPoolEntry entryParent(txParent, 1000, 0, 0.0, 1);
+    CTxMemPoolEntry entryChild(txChild, 20000, 0, 0.0, 1);
+    CTxMemPoolEntry entryPoor(txPoor, 100, 0, 0.0, 1);
+
+    pool.addUnchecked(txParent.GetHash(), entryParent);
+    pool.addUnchecked(txChild.GetHash(), entryChild);
+    pool.addUnchecked(txRich.GetHash(), CTxMemPoolEntry(txRich, 5000, 0, 0.0, 1));
+    pool.addUnchecked(txPoor.GetHash(), entryPoor);
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itParent->second.GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(itParent->second.GetSizeWithDescendants(), entryParent.GetTxSize() + entryChild.GetTxSize());
+    BOOST_CHECK_EQUAL(itParent->second.GetModFeesWithDescendants(), 21000);
+    BOOST_CHECK_EQUAL(pool.setByDescendantScore.size(), 4U);
+    BOOST_CHECK((*pool.setByDescendantScore.begin())->first == txPoor.GetHash());
+
+    // Nothing to do while the pool fits, and nothing asked for past the relay fee
+    pool.TrimToSize(pool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(pool.mapTx.size(), 4U);
+    BOOST_CHECK(pool.GetMinFee(pool.DynamicMemoryUsage()) == CFeeRate(0));
+
+    // The worst paying goes first, and whatever takes its place has to pay more
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.size(), 3U);
+    BOOST_CHECK(!pool.exists(txPoor.GetHash()));
+    BOOST_CHECK(pool.GetMinFee(pool.DynamicMemoryUsage()) == CFeeRate(100, entryPoor.GetTxSize()));
+
+    // The child pays for its parent, so it outbids a richer transaction on its own
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.size(), 2U);
+    BOOST_CHECK(!pool.exists(txRich.GetHash()));
+
+    // A fee delta on the child counts for the package of its parent
+    pool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 0.0, 1000);
+    BOOST_CHECK_EQUAL(itParent->second.GetModFeesWithDescendants(), 22000);
+
+    // A package is evicted as a whole
+    pool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(pool.mapTx.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.setByDescendantScore.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_dump_load)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    // Two outputs to spend, of a transaction only the coins view knows
+    const uint256 hashFunding = GetRandHash();
+    {
+        LOCK(cs_main);
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(hashFunding);
+        coins->fCoinBase = false;
+        coins->nVersion = 1;
+        coins->nHeight = 0;
+        coins->vout.resize(2);
+        for (unsigned int i = 0; i < coins->vout.size(); i++) {
+            coins->vout[i].nValue = 10 * COIN;
+            coins->vout[i].scriptPubKey = scriptPubKey;
+        }
+    }
+
+    CTransaction txParent = MakeSignedSpend(keystore, scriptPubKey, hashFunding, 0, 10 * COIN, CENT);
+    CTransaction txChild = MakeSignedSpend(keystore, scriptPubKey, txParent.GetHash(), 0, txParent.vout[0].nValue, CENT);
+    CTransaction txOther = MakeSignedSpend(keystore, scriptPubKey, hashFunding, 1, 10 * COIN, 2 * CENT);
+    // A delta for a transaction that has not arrived yet
+    const uint256 hashAbsent = GetRandHash();
+
+    mempool.clear();
+    std::map<uint256, int64_t> mapTimes;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPoolWithTime(mempool, state, txParent, false, NULL, 1000000));
+        BOOST_CHECK(AcceptToMemoryPoolWithTime(mempool, state, txChild, false, NULL, 1000100));
+        BOOST_CHECK(AcceptToMemoryPoolWithTime(mempool, state, txOther, false, NULL, 1000200));
+        mempool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 5.0, 1000);
+        mempool.PrioritiseTransaction(hashAbsent, hashAbsent.ToString(), 0.0, -500);
+
+    }
+    {
+        LOCK(mempool.cs);
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+            mapTimes[it->first] = it->second.GetTime();
+    }
+    BOOST_CHECK_EQUAL(mapTimes.size(), 3U);
+
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    mempool.ClearPrioritisation(txChild.GetHash());
+    mempool.ClearPrioritisation(hashAbsent);
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // The child comes after its parent in the dump, or it could not be accepted again
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    {
+        LOCK(mempool.cs);
+        for (std::map<uint256, int64_t>::const_iterator it = mapTimes.begin(); it != mapTimes.end(); ++it) {
+            CTxMemPool::txiter entry = mempool.mapTx.find(it->first);
+            BOOST_CHECK(entry != mempool.mapTx.end());
+            if (entry != mempool.mapTx.end())
+                BOOST_CHECK_EQUAL(entry->second.GetTime(), it->second);
+        }
+        BOOST_CHECK_EQUAL(mempool.mapTx.find(txChild.GetHash())->second.GetModifiedFee(), CENT + 1000);
+    }
+
+    double dPriorityDelta = 0.0;
+    CAmount nFeeDelta = 0;
+    mempool.ApplyDeltas(txChild.GetHash(), dPriorityDelta, nFeeDelta);
+    BOOST_CHECK_EQUAL(dPriorityDelta, 5.0);
+    BOOST_CHECK_EQUAL(nFeeDelta, 1000);
+    dPriorityDelta = 0.0;
+    nFeeDelta = 0;
+    mempool.ApplyDeltas(hashAbsent, dPriorityDelta, nFeeDelta);
+    BOOST_CHECK_EQUAL(dPriorityDelta, 0.0);
+    BOOST_CHECK_EQUAL(nFeeDelta, -500);
+    dPriorityDelta = 0.0;
+    nFeeDelta = 0;
+    mempool.ApplyDeltas(txParent.GetHash(), dPriorityDelta, nFeeDelta);
+    BOOST_CHECK_EQUAL(nFeeDelta, 0);
+
+    mempool.clear();
+    mempool.ClearPrioritisation(txChild.GetHash());
+    mempool.ClearPrioritisation(hashAbsent);
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(hashFunding)->Clear();
+    }
+
+    // A dump this version does not know fails to load, no dump at all is nothing to load
+    {
+        CAutoFile fileout(fopen((GetDataDir() / "mempool.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        fileout << (uint64_t)2;
+    }
+    BOOST_CHECK(!LoadMempool());
+    boost::filesystem::remove(GetDataDir() / "mempool.dat");
+    BOOST_CHECK(LoadMempool());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,10 @@
 
 #include "netbase.h"
 
+#include "streams.h"
+#include "uint256.h"
+#include "version.h"
+
 #include <string>
 
 #include <boost/test/unit_test.hpp>
@@ -183,4 +187,46 @@ BOOST_AUTO_TEST_CASE(subnet_test)
     BOOST_CHECK(!CSubNet("fuzzy").IsValid());
 }
 
+BOOST_AUTO_TEST_CASE(i2p_destination_store)
+{
+    //! Two made up native destinations, only their last bytes differ
+    string strDest1, strDest2;
+    for (int i = 0; i < I2P_DESTINATION_STORE - 8; i++)
+        strDest1 += "abcdefghijklmnopqrstuvwxyz0123456789-~"[i % 38];
+    strDest2 = strDest1 + "BBBBAAAA";
+    strDest1 += "AAAAAAAA";
+
+    CNetAddr addr1, addr2, addr3;
+    BOOST_CHECK(addr1.SetI2pDestination(strDest1));
+    BOOST_CHECK(addr2.SetSpecial(strDest1));
+    BOOST_CHECK(addr3.SetI2pDestination(strDest2));
+    BOOST_CHECK(addr1.IsI2P() && addr1.IsNativeI2P());
+    BOOST_CHECK(addr1 == addr2);
+    BOOST_CHECK(addr1 != addr3);
+    BOOST_CHECK(addr1 < addr3 && !(addr3 < addr1));
+    BOOST_CHECK(addr1.GetI2pDestination() == strDest1);
+    BOOST_CHECK(addr3.GetI2pDestination() == strDest2);
+    BOOST_CHECK(addr1.ToB32String() == B32AddressFromDestination(strDest1));
+    BOOST_CHECK(addr1.GetHash() == addr2.GetHash());
+
+    //! The serialized form still carries the whole destination, or zeros for other networks
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CService(addr1, 0) << CService("1.2.3.4", 9377);
+    BOOST_CHECK_EQUAL(ss.size(), 2 * (16 + I2P_DESTINATION_STORE + 2));
+    BOOST_CHECK(string(&ss[16], &ss[16 + I2P_DESTINATION_STORE]) == strDest1);
+    BOOST_CHECK(string(&ss[2 * 16 + I2P_DESTINATION_STORE + 2], &ss[2 * (16 + I2P_DESTINATION_STORE) + 2]) == string(I2P_DESTINATION_STORE, '\0'));
+    CService service1, service2;
+    ss >> service1 >> service2;
+    BOOST_CHECK(service1 == CService(addr1, 0));
+    BOOST_CHECK(service2 == CService("1.2.3.4", 9377));
+    BOOST_CHECK(service2.GetI2pDestination().empty());
+
+    //! Copies outlive the address they were made from
+    CNetAddr* paddr = new CNetAddr(addr3);
+    CNetAddr addr4(*paddr);
+    delete paddr;
+    addr3.SetRaw(NET_IPV4, (const uint8_t*)"\x01\x02\x03\x04");
+    BOOST_CHECK(addr4.GetI2pDestination() == strDest2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
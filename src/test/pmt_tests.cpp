@@ -105,4 +105,44 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_branch)
+{
+    static const unsigned int nTxCounts[] = {1, 2, 3, 6, 17, 100, 513};
+
+    for (int n = 0; n < 7; n++) {
+        unsigned int nTx = nTxCounts[n];
+        CBlock block;
+        for (unsigned int j=0; j<nTx; j++) {
+            CMutableTransaction tx;
+            tx.nLockTime = j;
+            block.vtx.push_back(tx);
+        }
+        bool fMutated = true;
+        uint256 merkleRoot = block.BuildMerkleTree(&fMutated);
+        BOOST_CHECK(!fMutated);
+        std::vector<uint256> vTxid(nTx, 0);
+        for (unsigned int j=0; j<nTx; j++)
+            vTxid[j] = block.vtx[j].GetHash();
+        BOOST_CHECK(ComputeMerkleRoot(vTxid) == merkleRoot);
+
+        // every transaction's branch leads to the root, as does the flattened tree, which holds the same branches
+        std::vector<uint256> vTree = ComputeMerkleTree(vTxid);
+        for (unsigned int j=0; j<nTx; j++) {
+            std::vector<uint256> vBranch = block.GetMerkleBranch(j);
+            BOOST_CHECK(CBlock::CheckMerkleBranch(vTxid[j], vBranch, j) == merkleRoot);
+            BOOST_CHECK(GetMerkleBranchFromTree(vTree, nTx, j) == vBranch);
+        }
+        BOOST_CHECK(vTree.back() == merkleRoot);
+        BOOST_CHECK(GetMerkleBranchFromTree(vTree, nTx, nTx).empty());
+
+        // repeating the last two transactions of a level with an odd one out keeps the root (CVE-2012-2459)
+        if (nTx == 6) {
+            block.vtx.push_back(block.vtx[4]);
+            block.vtx.push_back(block.vtx[5]);
+            BOOST_CHECK(block.BuildMerkleTree(&fMutated) == merkleRoot);
+            BOOST_CHECK(fMutated);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pow.h"
+
+#include "chain.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// Block times that jitter back and forth around the target spacing, with now and then a clock far behind
+void BuildBranch(std::vector<CBlockIndex>& vIndex, CBlockIndex* pprev, int64_t nTime)
+{
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vIndex[i].pprev = i ? &vIndex[i - 1] : pprev;
+        vIndex[i].nHeight = vIndex[i].pprev ? vIndex[i].pprev->nHeight + 1 : 0;
+        nTime += (int64_t)(insecure_rand() % 721) - 180;
+        if (insecure_rand() % 400 == 0)
+            nTime -= 60 * 60 * 12;
+        vIndex[i].nTime = nTime;
+        vIndex[i].BuildSkip();
+    }
+}
+
+// The oldest block the integrator samples found by walking the block index, as ChargeIntegrator() did before there
+// was a window to keep
+const CBlockIndex* FindOldestByWalk(const CBlockIndex* pIndex, int64_t nOldestBlockTime)
+{
+    assert(pIndex->pprev);
+    do {
+        pIndex = pIndex->pprev;
+    } while (pIndex->pprev && nOldestBlockTime < pIndex->pprev->GetBlockTime());
+    return pIndex;
+}
+
+void CheckWindow(CRetargetWindow& window, const CBlockIndex* pIndex, int64_t nIntegrationTime)
+{
+    int64_t nOldestBlockTime = pIndex->GetBlockTime() - nIntegrationTime;
+    BOOST_CHECK(window.FindOldest(pIndex, nOldestBlockTime) == FindOldestByWalk(pIndex, nOldestBlockTime));
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(pow_tests)
+
+BOOST_AUTO_TEST_CASE(retarget_window_matches_walk)
+{
+    std::vector<CBlockIndex> vMain(3000);
+    BuildBranch(vMain, NULL, 1400000000);
+    std::vector<CBlockIndex> vBranch(300);
+    BuildBranch(vBranch, &vMain[2500], vMain[2500].GetBlockTime());
+
+    const int64_t nIntegrationTimes[] = { 60 * 60 * 3, 60 * 60 * 24 * 2 };
+    for (unsigned int n = 0; n < sizeof(nIntegrationTimes) / sizeof(nIntegrationTimes[0]); n++) {
+        CRetargetWindow window;
+        // The tip advancing one block at a time, asked about more than once per height like the miner does
+        for (unsigned int i = 1; i < vMain.size(); i++) {
+            CheckWindow(window, &vMain[i], nIntegrationTimes[n]);
+            CheckWindow(window, &vMain[i], nIntegrationTimes[n]);
+        }
+        // Reorgs of every depth onto the branch and back, and jumps anywhere on either chain
+        for (unsigned int i = 0; i < 2000; i++) {
+            const CBlockIndex* pIndex;
+            if (insecure_rand() % 2)
+                pIndex = &vBranch[insecure_rand() % vBranch.size()];
+            else if (insecure_rand() % 2)
+                pIndex = &vMain[2300 + insecure_rand() % 700];
+            else
+                pIndex = &vMain[1 + insecure_rand() % (vMain.size() - 1)];
+            CheckWindow(window, pIndex, nIntegrationTimes[n]);
+            if (pIndex->nHeight + 1 < (int)vMain.size() && pIndex == &vMain[pIndex->nHeight])
+                CheckWindow(window, &vMain[pIndex->nHeight + 1], nIntegrationTimes[n]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(retarget_window_reorg_after_stall)
+{
+    // Blocks at the target spacing, then one after a stall of more than twice the integration time, which trims
+    // all the records below it
+    std::vector<CBlockIndex> vMain(203);
+    int64_t nTime = 1400000000;
+    for (unsigned int i = 0; i < vMain.size(); i++) {
+        vMain[i].pprev = i ? &vMain[i - 1] : NULL;
+        vMain[i].nHeight = i;
+        nTime += (i == 200) ? 60 * 60 * 73 : 180;
+        vMain[i].nTime = nTime;
+        vMain[i].BuildSkip();
+    }
+    // A short reorg forking below the stalled block
+    std::vector<CBlockIndex> vBranch(3);
+    nTime = vMain[198].GetBlockTime();
+    for (unsigned int i = 0; i < vBranch.size(); i++) {
+        vBranch[i].pprev = i ? &vBranch[i - 1] : &vMain[198];
+        vBranch[i].nHeight = vBranch[i].pprev->nHeight + 1;
+        nTime += 180;
+        vBranch[i].nTime = nTime;
+        vBranch[i].BuildSkip();
+    }
+
+    // The integration time PID_INTEGRATORTIME2 sets
+    const int64_t nIntegrationTime = 129600;
+    CRetargetWindow window;
+    for (unsigned int i = 1; i < vMain.size(); i++)
+        CheckWindow(window, &vMain[i], nIntegrationTime);
+    for (unsigned int i = 0; i < vBranch.size(); i++)
+        CheckWindow(window, &vBranch[i], nIntegrationTime);
+    for (unsigned int i = 199; i < vMain.size(); i++)
+        CheckWindow(window, &vMain[i], nIntegrationTime);
+    CheckWindow(window, &vBranch[2], nIntegrationTime);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
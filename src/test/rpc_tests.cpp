@@ -8,7 +8,10 @@
 
 #include "base58.h"
 
+#include <sstream>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
 using namespace std;
@@ -152,4 +155,108 @@ BOOST_AUTO_TEST_CASE(rpc_parse_monetary_values)
     BOOST_CHECK(AmountFromValue(ValueFromString("2099999.99999999")) == 209999999999999LL);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    Object obj;
+    obj.push_back(Pair("text", "quote \" backslash \\ newline \n"));
+    obj.push_back(Pair("amount", ValueFromAmount(123456789)));
+    obj.push_back(Pair("real", 0.1));
+    obj.push_back(Pair("count", (int64_t)-42));
+    obj.push_back(Pair("flag", true));
+    obj.push_back(Pair("none", Value::null));
+    obj.push_back(Pair("empty", Array()));
+    Array arr;
+    arr.push_back("a");
+    arr.push_back(Object());
+    arr.push_back(obj);
+    obj.push_back(Pair("list", arr));
+
+    // Written member by member, element by element, the document matches what write_string() makes of the tree
+    std::ostringstream ss;
+    CJSONStreamWriter writer(ss);
+    writer.BeginArray();
+    writer.BeginObject();
+    writer.WriteMembers(obj);
+    writer.Key("nested");
+    writer.BeginArray();
+    BOOST_FOREACH(const Value& value, arr)
+        writer.Write(value);
+    writer.EndArray();
+    writer.EndObject();
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Write(obj);
+    writer.EndArray();
+
+    Object objNested = obj;
+    objNested.push_back(Pair("nested", arr));
+    Array expected;
+    expected.push_back(objNested);
+    expected.push_back(Array());
+    expected.push_back(obj);
+    BOOST_CHECK_EQUAL(ss.str(), write_string(Value(expected), false));
+}
+
+//! Write strBody through a CHTTPReplyStreamBuf and read the reply back as anoncoin-cli does
+static string StreamReply(const string& strBody, bool fAllowChunked, size_t nChunkSize, map<string, string>& mapHeaders)
+{
+    std::stringstream ss;
+    CHTTPReplyStreamBuf buf(ss, HTTP_OK, true, fAllowChunked, "application/json", nChunkSize);
+    std::ostream out(&buf);
+    // In uneven pieces, so some of them span chunks
+    for (size_t nPos = 0; nPos < strBody.size(); nPos += 7)
+        out << strBody.substr(nPos, 7);
+    BOOST_CHECK(buf.Finish());
+
+    int nReplyProto = 0;
+    BOOST_CHECK_EQUAL(ReadHTTPStatus(ss, nReplyProto), HTTP_OK);
+    string strReply;
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(ss, mapHeaders, strReply, nReplyProto, 1024 * 1024), HTTP_OK);
+    return strReply;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_http_chunked_reply)
+{
+    string strBody;
+    for (int i = 0; i < 1000; i++)
+        strBody += strprintf("%d,", i);
+
+    // A reply that fits in the buffer goes out as a plain one
+    map<string, string> mapHeaders;
+    BOOST_CHECK_EQUAL(StreamReply(strBody, true, strBody.size() + 1, mapHeaders), strBody);
+    BOOST_CHECK_EQUAL(mapHeaders["content-length"], strprintf("%u", strBody.size()));
+    BOOST_CHECK(mapHeaders.count("transfer-encoding") == 0);
+
+    // A larger one in chunks, read back whole
+    BOOST_CHECK_EQUAL(StreamReply(strBody, true, 100, mapHeaders), strBody);
+    BOOST_CHECK_EQUAL(mapHeaders["transfer-encoding"], "chunked");
+    BOOST_CHECK(mapHeaders.count("content-length") == 0);
+
+    // Never to a client that did not ask for chunks
+    BOOST_CHECK_EQUAL(StreamReply(strBody, false, 100, mapHeaders), strBody);
+    BOOST_CHECK_EQUAL(mapHeaders["content-length"], strprintf("%u", strBody.size()));
+
+    // Which takes "TE: chunked" over HTTP/1.1
+    map<string, string> mapRequestHeaders;
+    BOOST_CHECK(!HTTPAcceptsChunked(1, mapRequestHeaders));
+    mapRequestHeaders["te"] = "chunked";
+    BOOST_CHECK(HTTPAcceptsChunked(1, mapRequestHeaders));
+    BOOST_CHECK(!HTTPAcceptsChunked(0, mapRequestHeaders));
+    mapRequestHeaders["te"] = "trailers, Chunked;q=1";
+    BOOST_CHECK(HTTPAcceptsChunked(1, mapRequestHeaders));
+    mapRequestHeaders["te"] = "trailers, deflate";
+    BOOST_CHECK(!HTTPAcceptsChunked(1, mapRequestHeaders));
+
+    // A chunked body longer than the reader accepts is refused
+    std::stringstream ss;
+    CHTTPReplyStreamBuf buf(ss, HTTP_OK, true, true, "application/json", 100);
+    std::ostream out(&buf);
+    out << strBody;
+    BOOST_CHECK(buf.Finish());
+    int nProto = 0;
+    ReadHTTPStatus(ss, nProto);
+    string strReply;
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(ss, mapHeaders, strReply, nProto, strBody.size() - 1), HTTP_INTERNAL_SERVER_ERROR);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
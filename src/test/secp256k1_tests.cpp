@@ -0,0 +1,250 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/anoncoin-config.h"
+#endif
+
+#include "key.h"
+
+#include <boost/test/unit_test.hpp>
+
+#ifdef USE_SECP256K1
+
+#include "data/script_invalid.json.h"
+#include "data/script_valid.json.h"
+#include "data/tx_valid.json.h"
+
+#include "core_io.h"
+#include "main.h"
+#include "random.h"
+#include "script.h"
+#include "sigcache.h"
+#include "util.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include "json/json_spirit_reader_template.h"
+#include "json/json_spirit_utils.h"
+#include "json/json_spirit_writer_template.h"
+
+using namespace std;
+using namespace json_spirit;
+
+extern Array read_json(const std::string& jsondata);
+
+namespace {
+
+/** Checks every signature with both libsecp256k1 and OpenSSL, and records any disagreement */
+class CDifferentialSignatureChecker : public TransactionSignatureChecker
+{
+public:
+    mutable unsigned int nChecked;
+    mutable unsigned int nValid;
+    mutable unsigned int nMismatched;
+
+    CDifferentialSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(txToIn, nInIn), nChecked(0), nValid(0), nMismatched(0) {}
+
+protected:
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+    {
+        bool fSecp256k1 = pubkey.Verify(sighash, vchSig);
+        bool fOpenSSL = pubkey.VerifyOpenSSL(sighash, vchSig);
+        nChecked++;
+        if (fSecp256k1)
+            nValid++;
+        if (fSecp256k1 != fOpenSSL) {
+            nMismatched++;
+            BOOST_ERROR("libsecp256k1 " << fSecp256k1 << " OpenSSL " << fOpenSSL << " for signature " << HexStr(vchSig) << " pubkey " << HexStr(pubkey.begin(), pubkey.end()));
+        }
+        return fSecp256k1;
+    }
+};
+
+// The spending transaction script_tests builds for each of its scripts
+CTransaction BuildScriptTestSpend(const CScript& scriptSig, const CScript& scriptPubKey)
+{
+    CMutableTransaction txCredit;
+    txCredit.nVersion = 1;
+    txCredit.nLockTime = 0;
+    txCredit.vin.resize(1);
+    txCredit.vout.resize(1);
+    txCredit.vin[0].prevout.SetNull();
+    txCredit.vin[0].scriptSig = CScript() << CScriptNum(0) << CScriptNum(0);
+    txCredit.vin[0].nSequence = std::numeric_limits<unsigned int>::max();
+    txCredit.vout[0].scriptPubKey = scriptPubKey;
+    txCredit.vout[0].nValue = 0;
+
+    CMutableTransaction txSpend;
+    txSpend.nVersion = 1;
+    txSpend.nLockTime = 0;
+    txSpend.vin.resize(1);
+    txSpend.vout.resize(1);
+    txSpend.vin[0].prevout.hash = txCredit.GetHash();
+    txSpend.vin[0].prevout.n = 0;
+    txSpend.vin[0].scriptSig = scriptSig;
+    txSpend.vin[0].nSequence = std::numeric_limits<unsigned int>::max();
+    txSpend.vout[0].scriptPubKey = CScript();
+    txSpend.vout[0].nValue = 0;
+    return CTransaction(txSpend);
+}
+
+// Runs each [ scriptSig, scriptPubKey ] of a script test file through the differential checker, returns the signatures checked
+unsigned int CheckScriptFile(const Array& tests, unsigned int& nValid)
+{
+    unsigned int nChecked = 0;
+    BOOST_FOREACH(const Value& tv, tests)
+    {
+        Array test = tv.get_array();
+        if (test.size() < 2)
+            continue;
+        CScript scriptSig = ParseScript(test[0].get_str());
+        CScript scriptPubKey = ParseScript(test[1].get_str());
+        CTransaction tx = BuildScriptTestSpend(scriptSig, scriptPubKey);
+        CDifferentialSignatureChecker checker(&tx, 0);
+        // No STRICTENC, so the signatures it would turn away still reach the backends
+        VerifyScript(scriptSig, scriptPubKey, SCRIPT_VERIFY_P2SH, checker);
+        nChecked += checker.nChecked;
+        nValid += checker.nValid;
+    }
+    return nChecked;
+}
+
+// Replaces S of a DER signature with n - S, where n is the order of the curve
+std::vector<unsigned char> NegateDERSignatureS(const std::vector<unsigned char>& vchSig)
+{
+    static const unsigned char order[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE,
+        0xBA, 0xAE, 0xDC, 0xE6, 0xAF, 0x48, 0xA0, 0x3B, 0xBF, 0xD2, 0x5E, 0x8C, 0xD0, 0x36, 0x41, 0x41
+    };
+    // 0x30 len 0x02 rlen R 0x02 slen S [hashtype]
+    unsigned int nLenR = vchSig[3];
+    std::vector<unsigned char> vchR(vchSig.begin() + 4, vchSig.begin() + 4 + nLenR);
+    unsigned int nLenS = vchSig[5 + nLenR];
+    std::vector<unsigned char> vchS(vchSig.begin() + 6 + nLenR, vchSig.begin() + 6 + nLenR + nLenS);
+
+    unsigned char s[32] = {0};
+    while (!vchS.empty() && vchS[0] == 0)
+        vchS.erase(vchS.begin());
+    memcpy(s + 32 - vchS.size(), &vchS[0], vchS.size());
+    unsigned char neg[32];
+    int nBorrow = 0;
+    for (int i = 31; i >= 0; i--) {
+        int nDiff = order[i] - s[i] - nBorrow;
+        nBorrow = nDiff < 0;
+        neg[i] = nDiff & 0xff;
+    }
+    std::vector<unsigned char> vchNegS(neg, neg + 32);
+    while (vchNegS.size() > 1 && vchNegS[0] == 0 && !(vchNegS[1] & 0x80))
+        vchNegS.erase(vchNegS.begin());
+    if (vchNegS[0] & 0x80)
+        vchNegS.insert(vchNegS.begin(), 0);
+
+    std::vector<unsigned char> vchRet;
+    vchRet.push_back(0x30);
+    vchRet.push_back(4 + vchR.size() + vchNegS.size());
+    vchRet.push_back(0x02);
+    vchRet.push_back(vchR.size());
+    vchRet.insert(vchRet.end(), vchR.begin(), vchR.end());
+    vchRet.push_back(0x02);
+    vchRet.push_back(vchNegS.size());
+    vchRet.insert(vchRet.end(), vchNegS.begin(), vchNegS.end());
+    vchRet.insert(vchRet.end(), vchSig.begin() + 6 + nLenR + nLenS, vchSig.end());
+    return vchRet;
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(secp256k1_tests)
+
+BOOST_AUTO_TEST_CASE(secp256k1_script_differential)
+{
+    unsigned int nValid = 0;
+    unsigned int nChecked = CheckScriptFile(read_json(std::string(json_tests::script_valid, json_tests::script_valid + sizeof(json_tests::script_valid))), nValid);
+    nChecked += CheckScriptFile(read_json(std::string(json_tests::script_invalid, json_tests::script_invalid + sizeof(json_tests::script_invalid))), nValid);
+    BOOST_TEST_MESSAGE("script tests: " << nChecked << " signatures compared, " << nValid << " valid");
+    BOOST_CHECK(nChecked > 0);
+    BOOST_CHECK(nValid > 0);
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_tx_differential)
+{
+    Array tests = read_json(std::string(json_tests::tx_valid, json_tests::tx_valid + sizeof(json_tests::tx_valid)));
+
+    unsigned int nChecked = 0;
+    BOOST_FOREACH(Value& tv, tests)
+    {
+        Array test = tv.get_array();
+        if (test[0].type() != array_type || test.size() != 3)
+            continue;
+
+        map<COutPoint, CScript> mapprevOutScriptPubKeys;
+        BOOST_FOREACH(Value& input, test[0].get_array())
+        {
+            Array vinput = input.get_array();
+            mapprevOutScriptPubKeys[COutPoint(uint256(vinput[0].get_str()), vinput[1].get_int())] = ParseScript(vinput[2].get_str());
+        }
+
+        CDataStream stream(ParseHex(test[1].get_str()), SER_NETWORK, PROTOCOL_VERSION);
+        CTransaction tx;
+        stream >> tx;
+
+        unsigned int verify_flags = test[2].get_bool() ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+        {
+            CDifferentialSignatureChecker checker(&tx, i);
+            BOOST_CHECK_MESSAGE(VerifyScript(tx.vin[i].scriptSig, mapprevOutScriptPubKeys[tx.vin[i].prevout], verify_flags, checker),
+                                write_string(tv, false));
+            nChecked += checker.nChecked;
+        }
+    }
+    BOOST_CHECK(nChecked > 0);
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_recover_differential)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i & 1);
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.SignCompact(hash, vchSig));
+
+        CPubKey pubkey1, pubkey2;
+        BOOST_CHECK(pubkey1.RecoverCompact(hash, vchSig));
+        BOOST_CHECK(pubkey2.RecoverCompactOpenSSL(hash, vchSig));
+        BOOST_CHECK(pubkey1 == key.GetPubKey());
+        BOOST_CHECK(pubkey1 == pubkey2);
+        BOOST_CHECK(key.GetPubKey().VerifyCompact(hash, vchSig));
+
+        // Every header byte, most of which name no recovery id or the wrong one
+        for (int nHeader = 0; nHeader < 256; nHeader++)
+        {
+            vchSig[0] = nHeader;
+            CPubKey pubkeyRec1, pubkeyRec2;
+            bool fRec1 = pubkeyRec1.RecoverCompact(hash, vchSig);
+            bool fRec2 = pubkeyRec2.RecoverCompactOpenSSL(hash, vchSig);
+            BOOST_CHECK_EQUAL(fRec1, fRec2);
+            if (fRec1 && fRec2)
+                BOOST_CHECK(pubkeyRec1 == pubkeyRec2);
+        }
+
+        // CKey::Sign() makes low S signatures, the high S twin of one is just as valid to both
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        BOOST_CHECK(key.GetPubKey().Verify(hash, vchSig));
+        BOOST_CHECK(key.GetPubKey().VerifyOpenSSL(hash, vchSig));
+        std::vector<unsigned char> vchHighS = NegateDERSignatureS(vchSig);
+        BOOST_CHECK(vchHighS != vchSig);
+        BOOST_CHECK(key.GetPubKey().Verify(hash, vchHighS));
+        BOOST_CHECK(key.GetPubKey().VerifyOpenSSL(hash, vchHighS));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // USE_SECP256K1
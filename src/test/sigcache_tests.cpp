@@ -0,0 +1,88 @@
+// Copyright (c) 2013-2017 The Anoncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sigcache.h"
+
+#include "key.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! A compressed public key made of the byte n, the cache never checks it is on the curve
+CPubKey MakePubKey(unsigned char n)
+{
+    std::vector<unsigned char> vch(33, n);
+    vch[0] = 0x02;
+    return CPubKey(vch);
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(sigcache_insert_lookup)
+{
+    CSignatureCache cache;
+    const uint256 hash = GetRandHash();
+    const std::vector<unsigned char> vchSig(72, 1);
+    const CPubKey pubkey = MakePubKey(1);
+
+    // Without a table nothing is kept
+    BOOST_CHECK_EQUAL(cache.Setup(0), 0U);
+    cache.Set(hash, vchSig, pubkey);
+    BOOST_CHECK(!cache.Get(hash, vchSig, pubkey));
+
+    size_t nEntries = cache.Setup(1 << 16);
+    BOOST_CHECK(nEntries > 0);
+    BOOST_CHECK(nEntries * CSignatureCache::BytesPerEntry() <= (1 << 16));
+
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 16; i++) {
+        vHashes.push_back(GetRandHash());
+        cache.Set(vHashes.back(), vchSig, pubkey);
+    }
+    for (int i = 0; i < 16; i++)
+        BOOST_CHECK(cache.Get(vHashes[i], vchSig, pubkey));
+
+    // Any part of the entry that differs is a miss
+    BOOST_CHECK(!cache.Get(GetRandHash(), vchSig, pubkey));
+    BOOST_CHECK(!cache.Get(vHashes[0], std::vector<unsigned char>(72, 2), pubkey));
+    BOOST_CHECK(!cache.Get(vHashes[0], vchSig, MakePubKey(2)));
+    BOOST_CHECK(!cache.Get(vHashes[0], std::vector<unsigned char>(), pubkey));
+
+    // A new table starts out empty
+    cache.Setup(1 << 16);
+    BOOST_CHECK(!cache.Get(vHashes[0], vchSig, pubkey));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_eviction)
+{
+    CSignatureCache cache;
+    const std::vector<unsigned char> vchSig(72, 1);
+    const CPubKey pubkey = MakePubKey(1);
+
+    size_t nEntries = cache.Setup(32 * CSignatureCache::BytesPerEntry());
+    BOOST_CHECK_EQUAL(nEntries, 32U);
+
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < 10 * nEntries; i++) {
+        vHashes.push_back(GetRandHash());
+        cache.Set(vHashes.back(), vchSig, pubkey);
+        // The entry just set is always kept, evicting an older one if it has to
+        BOOST_CHECK(cache.Get(vHashes.back(), vchSig, pubkey));
+    }
+
+    size_t nHits = 0;
+    for (size_t i = 0; i < vHashes.size(); i++)
+        if (cache.Get(vHashes[i], vchSig, pubkey))
+            nHits++;
+    BOOST_CHECK(nHits > 0);
+    BOOST_CHECK(nHits <= nEntries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
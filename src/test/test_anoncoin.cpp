@@ -11,7 +11,9 @@
 #define BOOST_TEST_MODULE Anoncoin Test Suite
 #define BOOST_TEST_LOG_LEVEL message
 
+#include "crypto/sha256.h"
 #include "main.h"
+#include "sigcache.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -39,6 +41,7 @@ struct TestingSetup {
     TestingSetup() {
         // ECC_Start();
         SetupEnvironment();
+        SHA256AutoDetect();
 
         //! Windows builds rely on openssl for random number generation, wallet_tests here have been found to fail,
         //! possibly because the random seed generator was not initialize? Testing for why the failures...ToDo This did not fix the problem.
@@ -65,6 +68,7 @@ struct TestingSetup {
         pwalletMain->LoadWallet(fFirstRun);
         RegisterValidationInterface(pwalletMain);
 #endif
+        InitSignatureCache();
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
@@ -8,10 +8,13 @@
 
 #include "amount.h"
 #include "checkpoints.h"
+#include "compressor.h"
+#include "crypto/common.h"
 #include "pow.h"
 #include "uint256.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include <boost/scoped_ptr.hpp>
 
@@ -25,6 +28,100 @@ const int64_t nMinDbCache = 4;
 
 using namespace std;
 
+//! Layouts of the coin database, recorded under 'L'.  Databases written before the record existed have one record
+//! per transaction.
+static const uint32_t COINS_LAYOUT_PER_TX = 0;
+static const uint32_t COINS_LAYOUT_UPGRADING = 1;
+static const uint32_t COINS_LAYOUT_PER_OUTPUT = 2;
+
+//! Past the per transaction layout the best block is kept under 'T'.  'B', the only key older releases read it from,
+//! names no block at all, so they stop at the first block they try to connect instead of using the database without
+//! its coins.
+static const uint256 COINS_TIP_FOR_OLDER_RELEASES = ~uint256(0);
+
+//! Bytes of records read between the batches UpgradeToPerOutput() writes
+static const size_t COINS_UPGRADE_BATCH_SIZE = 16 << 20;
+
+/**
+ * Key of an unspent output in the per output layout.  The index is big endian, so the outputs of a transaction sort
+ * in order behind each other and one seek to the txid finds them all.
+ */
+struct COutputKey
+{
+    uint256 txid;
+    uint32_t n;
+
+    COutputKey() : n(0) {}
+    COutputKey(const uint256& txidIn, uint32_t nIn) : txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        char chType = 'o';
+        READWRITE(chType);
+        READWRITE(txid);
+        unsigned char nBigEndian[4];
+        WriteBE32(nBigEndian, n);
+        READWRITE(FLATDATA(nBigEndian));
+        if (ser_action.ForRead())
+            n = ReadBE32(nBigEndian);
+    }
+};
+
+//! Size of a serialized COutputKey
+static const size_t OUTPUT_KEY_SIZE = 1 + 32 + 4;
+
+/** Value of an unspent output in the per output layout, with what CCoins keeps of its transaction */
+struct COutputValue
+{
+    int nTxVersion;
+    int nHeight;
+    bool fCoinBase;
+    CTxOut txout;
+
+    COutputValue() : nTxVersion(0), nHeight(0), fCoinBase(false) {}
+    COutputValue(const CCoins& coins, unsigned int n) : nTxVersion(coins.nVersion), nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), txout(coins.vout[n]) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(nTxVersion));
+        unsigned int nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nCode));
+        if (ser_action.ForRead()) {
+            nHeight = nCode / 2;
+            fCoinBase = nCode & 1;
+        }
+        CTxOutCompressor txoutCompressor(txout);
+        READWRITE(txoutCompressor);
+    }
+};
+
+//! Move the cursor to the first output of txid in the per output layout
+static void SeekOutputs(leveldb::Iterator* pcursor, const uint256& txid)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey.reserve(OUTPUT_KEY_SIZE);
+    ssKey << COutputKey(txid, 0);
+    pcursor->Seek(leveldb::Slice(&ssKey[0], ssKey.size()));
+}
+
+//! Read the index of the output at the cursor, if it is one of txid in the per output layout
+static bool GetOutputIndex(leveldb::Iterator* pcursor, const uint256& txid, uint32_t& n)
+{
+    if (!pcursor->Valid()) {
+        HandleError(pcursor->status());
+        return false;
+    }
+    leveldb::Slice slKey = pcursor->key();
+    if (slKey.size() != OUTPUT_KEY_SIZE || slKey[0] != 'o' || memcmp(slKey.data() + 1, txid.begin(), 32) != 0)
+        return false;
+    n = ReadBE32((const unsigned char*)slKey.data() + 33);
+    return true;
+}
+
 void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins) {
     if (coins.IsPruned()) {
         //LogPrintf( "CCoinsViewDB::BatchWriteCoins() erased hash %s it has been Pruned.\n", hash.ToString() );
@@ -34,22 +131,58 @@ void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCo
         batch.Write(make_pair('c', hash), coins);
 }
 
-void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash)
+void static BatchWriteHashBestChain(CLevelDBBatch &batch, uint32_t nLayout, const uint256 &hash)
 {
     // LogPrintf( "CCoinsViewDB::BatchWriteHashBestChain() hash %s\n", hash.ToString() );
-    batch.Write('B', hash);
+    batch.Write(nLayout == COINS_LAYOUT_PER_TX ? 'B' : 'T', hash);
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), nLayout(COINS_LAYOUT_PER_TX) {
+    db.Read('L', nLayout);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::GetOutputs(const uint256 &txid, CCoins &coins) const {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewLookupIterator());
+    SeekOutputs(pcursor.get(), txid);
+    coins.Clear();
+    bool fFound = false;
+    uint32_t n;
+    while (GetOutputIndex(pcursor.get(), txid, n)) {
+        leveldb::Slice slValue = pcursor->value();
+        COutputValue output;
+        try {
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> output;
+        } catch (const std::exception&) {
+            return false;
+        }
+        coins.nVersion = output.nTxVersion;
+        coins.nHeight = output.nHeight;
+        coins.fCoinBase = output.fCoinBase;
+        if (coins.vout.size() <= n)
+            coins.vout.resize(n + 1);
+        coins.vout[n] = output.txout;
+        fFound = true;
+        pcursor->Next();
+    }
+    return fFound;
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
+    if (nLayout == COINS_LAYOUT_PER_OUTPUT)
+        return GetOutputs(txid, coins);
     bool fResult = db.Read(make_pair('c', txid), coins);
     //LogPrintf( "CCoinsViewDB::GetCoins() for %s found on disk=%d\n", txid.ToString(), fResult );
     return fResult;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
+    if (nLayout == COINS_LAYOUT_PER_OUTPUT) {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewLookupIterator());
+        SeekOutputs(pcursor.get(), txid);
+        uint32_t n;
+        return GetOutputIndex(pcursor.get(), txid, n);
+    }
     bool fResult = db.Exists(make_pair('c', txid));
     //LogPrintf( "CCoinsViewDB::HaveCoins() for %s found on disk=%d\n", txid.ToString(), fResult );
     return fResult;
@@ -57,20 +190,54 @@ bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
 
 uint256 CCoinsViewDB::GetBestBlock() const {
     uint256 hashBestChain;
-    bool fResult = db.Read('B', hashBestChain);
+    bool fResult = db.Read(nLayout == COINS_LAYOUT_PER_TX ? 'B' : 'T', hashBestChain);
     //LogPrintf( "CCoinsViewDB::GetBestBlock() read=%d found %s\n", fResult, hashBestChain.ToString() );
     if (!fResult)
         return uint256(0);
     return hashBestChain;
 }
 
+/**
+ * Queue the changes to the outputs of a transaction in the per output layout.  Outputs the database already has as
+ * they are in the cache are left alone, so spending one output of a transaction only erases its own record.
+ */
+void CCoinsViewDB::BatchWriteOutputs(CLevelDBBatch &batch, leveldb::Iterator* pcursor, const uint256 &txid, const CCoinsCacheEntry &entry) {
+    const CCoins &coins = entry.coins;
+    std::vector<bool> vStored(coins.vout.size(), false);
+    if (!(entry.flags & CCoinsCacheEntry::FRESH)) {
+        SeekOutputs(pcursor, txid);
+        uint32_t n;
+        while (GetOutputIndex(pcursor, txid, n)) {
+            if (n >= coins.vout.size() || coins.vout[n].IsNull()) {
+                batch.Erase(COutputKey(txid, n));
+            } else {
+                CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                ssValue << COutputValue(coins, n);
+                vStored[n] = pcursor->value() == leveldb::Slice(&ssValue[0], ssValue.size());
+            }
+            pcursor->Next();
+        }
+    }
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull() && !vStored[i])
+            batch.Write(COutputKey(txid, i), COutputValue(coins, i));
+    }
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CLevelDBBatch batch;
+    // The outputs already stored are looked up as the database was before this batch
+    boost::scoped_ptr<leveldb::Iterator> pcursor;
+    if (nLayout == COINS_LAYOUT_PER_OUTPUT)
+        pcursor.reset(db.NewIterator());
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            if (pcursor)
+                BatchWriteOutputs(batch, pcursor.get(), it->first, it->second);
+            else
+                BatchWriteCoins(batch, it->first, it->second.coins);
             changed++;
         }
         count++;
@@ -78,7 +245,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         mapCoins.erase(itOld);
     }
     if (hashBlock != uint256(0))
-        BatchWriteHashBestChain(batch, hashBlock);
+        BatchWriteHashBestChain(batch, nLayout, hashBlock);
     //else
         //LogPrintf( "CCoinsViewDB::BatchWrite() WARNING - No hashBlock set to write BestChain hash.\n" );
 
@@ -87,12 +254,95 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
+bool CCoinsViewDB::IsPerOutput() const {
+    return nLayout == COINS_LAYOUT_PER_OUTPUT;
+}
+
+bool CCoinsViewDB::IsUpgrading() const {
+    return nLayout == COINS_LAYOUT_UPGRADING;
+}
+
+bool CCoinsViewDB::UpgradeToPerOutput() {
+    if (nLayout == COINS_LAYOUT_PER_OUTPUT)
+        return true;
+    LogPrintf("Upgrading the coin database to one record per unspent output...\n");
+    int64_t nStart = GetTimeMillis();
+    if (nLayout == COINS_LAYOUT_PER_TX) {
+        // The best block moves to 'T' as the upgrade starts, older releases can not use a half upgraded database either
+        CLevelDBBatch batch;
+        uint256 hashBestChain = GetBestBlock();
+        if (hashBestChain != uint256(0))
+            batch.Write('T', hashBestChain);
+        batch.Write('B', COINS_TIP_FOR_OLDER_RELEASES);
+        batch.Write('L', COINS_LAYOUT_UPGRADING);
+        if (!db.WriteBatch(batch, true))
+            return false;
+        nLayout = COINS_LAYOUT_UPGRADING;
+    }
+
+    // The iterator keeps reading the records as they were when it was made, while the batches erase them
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(leveldb::Slice("c", 1));
+    CLevelDBBatch batch;
+    size_t nBatchBytes = 0;
+    uint64_t nTransactions = 0;
+    uint64_t nOutputs = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != 'c')
+            break;
+        leveldb::Slice slValue = pcursor->value();
+        try {
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            // A transaction moves in one batch, so an interrupted upgrade never leaves it half in each layout
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull()) {
+                    batch.Write(COutputKey(txid, i), COutputValue(coins, i));
+                    nOutputs++;
+                }
+            }
+            batch.Erase(make_pair('c', txid));
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        nTransactions++;
+        nBatchBytes += slKey.size() + slValue.size();
+        if (nBatchBytes >= COINS_UPGRADE_BATCH_SIZE) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            nBatchBytes = 0;
+            LogPrintf("Upgraded %u transactions with %u unspent outputs so far\n", nTransactions, nOutputs);
+        }
+    }
+    HandleError(pcursor->status());
+    batch.Write('L', COINS_LAYOUT_PER_OUTPUT);
+    if (!db.WriteBatch(batch, true))
+        return false;
+    nLayout = COINS_LAYOUT_PER_OUTPUT;
+    LogPrintf("Upgraded the coin database, %u transactions with %u unspent outputs in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
+//! Marks a block index entry which is followed by the sha256d hash of its block.  Older versions stop reading after
+//! the CDiskBlockIndex fields, so they load these entries as before.
+static const unsigned char BLOCKINDEX_SHA256D_MARKER = 1;
+
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
 {
     // LogPrintf( "Writing blockindex hash: %s\n", blockindex.GetBlockHash().ToString());
+    if (blockindex.fakeBIhash != 0)
+        return Write(make_pair('b', blockindex.GetBlockHash()), make_pair(blockindex, make_pair(BLOCKINDEX_SHA256D_MARKER, blockindex.fakeBIhash)));
     return Write(make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
@@ -135,6 +385,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     int64_t nTotalAmount = 0;
+    uint256 txidLast;
+    bool fInTransaction = false;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -165,12 +417,39 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
                 }
                 stats.nSerializedSize += 32 + slValue.size();
                 ss << VARINT(0);
+            } else if (chType == 'o') {
+                CDataStream ssOutputKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                COutputKey key;
+                ssOutputKey >> key;
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                COutputValue output;
+                ssValue >> output;
+                // Hash the outputs of each transaction as the per transaction layout does, so both give the same hash
+                if (!fInTransaction || key.txid != txidLast) {
+                    if (fInTransaction)
+                        ss << VARINT(0);
+                    ss << key.txid;
+                    ss << VARINT(output.nTxVersion);
+                    ss << (output.fCoinBase ? 'c' : 'n');
+                    ss << VARINT(output.nHeight);
+                    stats.nTransactions++;
+                    txidLast = key.txid;
+                    fInTransaction = true;
+                }
+                stats.nTransactionOutputs++;
+                ss << VARINT(key.n+1);
+                ss << output.txout;
+                nTotalAmount += output.txout.nValue;
+                stats.nSerializedSize += slKey.size() + slValue.size();
             }
             pcursor->Next();
         } catch (std::exception &e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (fInTransaction)
+        ss << VARINT(0);
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
@@ -224,6 +503,14 @@ bool CBlockTreeDB::LoadBlockIndexGuts( vector<BlockTreeEntry>& vSortedByHeight )
                 CDiskBlockIndex diskindex;
                 ssValue >> diskindex;
                 aBlockDetails.nHeight = diskindex.nHeight;
+                //! Entries written by this version carry the sha256d hash of the block too, saving us from calculating it
+                aBlockDetails.sha256dHash.SetNull();
+                if (!ssValue.empty()) {
+                    unsigned char nMarker;
+                    ssValue >> nMarker;
+                    if (nMarker == BLOCKINDEX_SHA256D_MARKER)
+                        ssValue >> aBlockDetails.sha256dHash;
+                }
 
                 //! NOTE: On constructing block index objects.  Computing many hash values here can lead to many minutes of waiting for
                 //! the user.  This has been re-written several times in order to be as fast as possible for loading.  We don't
@@ -25,11 +25,19 @@ extern const int64_t nMaxDbCache;
 //! min. -dbcache in (MiB)
 extern const int64_t nMinDbCache;
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+/**
+ * CCoinsView backed by the LevelDB coin database (chainstate/).  The database holds either one record per transaction
+ * with all its unspent outputs, or one record per unspent output.  In the second layout spending an output deletes
+ * a small record, rather than rewriting those of the other outputs of its transaction.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+    uint32_t nLayout;
+
+    bool GetOutputs(const uint256 &txid, CCoins &coins) const;
+    void BatchWriteOutputs(CLevelDBBatch &batch, leveldb::Iterator* pcursor, const uint256 &txid, const CCoinsCacheEntry &entry);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -38,6 +46,17 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+
+    //! Whether the database holds one record per unspent output
+    bool IsPerOutput() const;
+    //! Whether an upgrade to the per output layout was interrupted, the database can not be used until it is resumed
+    bool IsUpgrading() const;
+    /**
+     * Rewrite the database to one record per unspent output.  Each batch converts whole transactions, so the upgrade
+     * resumes where it stopped if it is interrupted.  There is no way back, short of a -reindex, and releases from
+     * before the upgrade existed refuse the database until they reindex it.
+     */
+    bool UpgradeToPerOutput();
 };
 
 //! We now return and sort the following structure of details during a LoadBlockIndexGuts() call.
@@ -50,6 +69,7 @@ struct BlockTreeEntry
     int nHeight;
     CBlockIndex* pBlockIndex;
     uint256 uintRealHash;
+    uintFakeHash sha256dHash;                   //! As stored with the index entry, zero if it was written without one
     bool operator <(const BlockTreeEntry& s2) const { return nHeight < s2.nHeight; }
 };
 
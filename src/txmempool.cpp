@@ -20,8 +20,13 @@ using namespace std;
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+//! Bytes malloc and a red-black tree node add to each element of a std::map or std::set
+static const size_t MEMPOOL_NODE_OVERHEAD = 48;
+
 CTxMemPoolEntry::CTxMemPoolEntry():
-    nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+    nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nModFee(0),
+    nCountWithAncestors(0), nSizeWithAncestors(0), nModFeesWithAncestors(0),
+    nCountWithDescendants(0), nSizeWithDescendants(0), nModFeesWithDescendants(0), nUsageSize(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
@@ -34,6 +39,22 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nModFee = nFee;
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nModFeesWithDescendants = nFee;
+
+    // The transaction's own allocations, and the nodes the pool keeps for it in its maps and indexes
+    nUsageSize = tx.vin.capacity() * sizeof(CTxIn) + tx.vout.capacity() * sizeof(CTxOut);
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        nUsageSize += txin.scriptSig.capacity() + MEMPOOL_NODE_OVERHEAD + sizeof(COutPoint) + sizeof(CInPoint);
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        nUsageSize += txout.scriptPubKey.capacity();
+    nUsageSize += sizeof(uint256) + sizeof(CTxMemPoolEntry) + MEMPOOL_NODE_OVERHEAD * 5 + sizeof(void*) * 4;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -50,6 +71,25 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+void CTxMemPoolEntry::UpdateFeeDelta(CAmount nFeeDelta)
+{
+    nModFee = nFee + nFeeDelta;
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee)
+{
+    nCountWithAncestors += nModifyCount;
+    nSizeWithAncestors += nModifySize;
+    nModFeesWithAncestors += nModifyFee;
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee)
+{
+    nCountWithDescendants += nModifyCount;
+    nSizeWithDescendants += nModifySize;
+    nModFeesWithDescendants += nModifyFee;
+}
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -377,7 +417,13 @@ public:
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
     nTransactionsUpdated(0),
-    minRelayFee(_minRelayFee)
+    minRelayFee(_minRelayFee),
+    totalTxSize(0),
+    nPriorityHeight(0),
+    cachedInnerUsage(0),
+    rollingMinimumFeeRate(0),
+    lastRollingFeeUpdate(GetTime()),
+    blockSinceLastRollingFeeBump(false)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -423,6 +469,106 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolParents(txiter it) const
+{
+    std::map<txiter, TxLinks, CompareIteratorByHash>::const_iterator lit = mapLinks.find(it);
+    assert(lit != mapLinks.end());
+    return lit->second.parents;
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolChildren(txiter it) const
+{
+    std::map<txiter, TxLinks, CompareIteratorByHash>::const_iterator lit = mapLinks.find(it);
+    assert(lit != mapLinks.end());
+    return lit->second.children;
+}
+
+void CTxMemPool::CalculateAncestors(txiter it, setEntries& setAncestors) const
+{
+    std::vector<txiter> vToVisit(1, it);
+    while (!vToVisit.empty()) {
+        txiter next = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH(const txiter& parent, GetMemPoolParents(next)) {
+            if (setAncestors.insert(parent).second)
+                vToVisit.push_back(parent);
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(txiter it, setEntries& setDescendants) const
+{
+    if (!setDescendants.insert(it).second)
+        return;
+    std::vector<txiter> vToVisit(1, it);
+    while (!vToVisit.empty()) {
+        txiter next = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH(const txiter& child, GetMemPoolChildren(next)) {
+            if (setDescendants.insert(child).second)
+                vToVisit.push_back(child);
+        }
+    }
+}
+
+double CTxMemPool::GetModifiedPriority(txiter it, unsigned int nHeight) const
+{
+    // Entries can be younger than the height asked for after a reorg, and GetPriority() is unsigned in it
+    double dPriority = it->second.GetPriority(std::max(nHeight, it->second.GetHeight()));
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(it->first);
+    if (pos != mapDeltas.end())
+        dPriority += pos->second.first;
+    return dPriority;
+}
+
+void CTxMemPool::UpdateAncestorState(txiter it, int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee)
+{
+    setByAncestorFeeRate.erase(it);
+    it->second.UpdateAncestorState(nModifyCount, nModifySize, nModifyFee);
+    setByAncestorFeeRate.insert(it);
+}
+
+//! Recomputes the package totals of an entry from its ancestors, for when these changed other than one by one
+void CTxMemPool::UpdateAncestorsOf(txiter it)
+{
+    setEntries setAncestors;
+    CalculateAncestors(it, setAncestors);
+    uint64_t nCount = 1;
+    uint64_t nSize = it->second.GetTxSize();
+    CAmount nFees = it->second.GetModifiedFee();
+    BOOST_FOREACH(const txiter& ancestor, setAncestors) {
+        nCount++;
+        nSize += ancestor->second.GetTxSize();
+        nFees += ancestor->second.GetModifiedFee();
+    }
+    const CTxMemPoolEntry& entry = it->second;
+    UpdateAncestorState(it, (int64_t)nCount - (int64_t)entry.GetCountWithAncestors(), (int64_t)nSize - (int64_t)entry.GetSizeWithAncestors(), nFees - entry.GetModFeesWithAncestors());
+}
+
+void CTxMemPool::UpdateDescendantState(txiter it, int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee)
+{
+    setByDescendantScore.erase(it);
+    it->second.UpdateDescendantState(nModifyCount, nModifySize, nModifyFee);
+    setByDescendantScore.insert(it);
+}
+
+//! Recomputes the descendant package totals of an entry, the counterpart of UpdateAncestorsOf()
+void CTxMemPool::UpdateDescendantsOf(txiter it)
+{
+    setEntries setDescendants;
+    CalculateDescendants(it, setDescendants);
+    uint64_t nCount = 0;
+    uint64_t nSize = 0;
+    CAmount nFees = 0;
+    BOOST_FOREACH(const txiter& descendant, setDescendants) {
+        nCount++;
+        nSize += descendant->second.GetTxSize();
+        nFees += descendant->second.GetModifiedFee();
+    }
+    const CTxMemPoolEntry& entry = it->second;
+    UpdateDescendantState(it, (int64_t)nCount - (int64_t)entry.GetCountWithDescendants(), (int64_t)nSize - (int64_t)entry.GetSizeWithDescendants(), nFees - entry.GetModFeesWithDescendants());
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry)
 {
     // Add to memory pool without checking anything.
@@ -430,25 +576,154 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
+        txiter it = mapTx.insert(std::make_pair(hash, entry)).first;
+        const CTransaction& tx = it->second.GetTx();
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
+        cachedInnerUsage += entry.DynamicMemoryUsage();
+
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+        if (pos != mapDeltas.end())
+            it->second.UpdateFeeDelta(pos->second.second);
+
+        TxLinks& links = mapLinks[it];
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            txiter parent = mapTx.find(txin.prevout.hash);
+            if (parent != mapTx.end() && links.parents.insert(parent).second)
+                mapLinks[parent].children.insert(it);
+        }
+        // Children are already here when a reorg puts the transactions of a disconnected block back
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.find(COutPoint(hash, i));
+            if (itNext == mapNextTx.end())
+                continue;
+            txiter child = mapTx.find(itNext->second.ptx->GetHash());
+            if (child != mapTx.end() && links.children.insert(child).second)
+                mapLinks[child].parents.insert(it);
+        }
+
+        setByAncestorFeeRate.insert(it);
+        setByDescendantScore.insert(it);
+        UpdateAncestorsOf(it);
+        setEntries setAncestors;
+        CalculateAncestors(it, setAncestors);
+        if (links.children.empty()) {
+            // The usual case, a new leaf that joins the descendant package of each of its ancestors
+            if (it->second.GetModifiedFee() != it->second.GetFee())
+                UpdateDescendantState(it, 0, 0, it->second.GetModifiedFee() - it->second.GetFee());
+            BOOST_FOREACH(const txiter& ancestor, setAncestors)
+                UpdateDescendantState(ancestor, 1, it->second.GetTxSize(), it->second.GetModifiedFee());
+        } else {
+            // Descendants the ancestors may already have reached along other paths are only found by a recount
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            setDescendants.erase(it);
+            BOOST_FOREACH(const txiter& descendant, setDescendants)
+                UpdateAncestorsOf(descendant);
+            UpdateDescendantsOf(it);
+            BOOST_FOREACH(const txiter& ancestor, setAncestors)
+                UpdateDescendantsOf(ancestor);
+        }
+        setByPriority.insert(std::make_pair(GetModifiedPriority(it, nPriorityHeight), it));
     }
     return true;
 }
 
+/**
+ * Takes a set of entries out of the pool, and out of the package totals of their ancestors and
+ * descendants that stay.  Whether a descendant stays or not, its ancestors here are gone afterwards.
+ */
+void CTxMemPool::RemoveStaged(const setEntries& stage)
+{
+    // Nothing stays behind when a transaction goes with all its descendants, or nothing before it when
+    // it goes with its ancestors, so look before walking each one's
+    setEntries setReached;
+    setEntries setAncestorsReached;
+    BOOST_FOREACH(const txiter& it, stage) {
+        CalculateDescendants(it, setReached);
+        CalculateAncestors(it, setAncestorsReached);
+    }
+    std::vector<txiter> vStaying;
+    BOOST_FOREACH(const txiter& it, setReached) {
+        if (!stage.count(it))
+            vStaying.push_back(it);
+    }
+    std::vector<txiter> vStayingAncestors;
+    BOOST_FOREACH(const txiter& it, setAncestorsReached) {
+        if (!stage.count(it))
+            vStayingAncestors.push_back(it);
+    }
+
+    // Taking one out of the middle of a chain cuts the descendants off from its ancestors as well,
+    // which only a recount notices.  Blocks take parents before children and eviction takes whole
+    // descendant packages, so it is rare.
+    bool fCutsChain = !vStaying.empty() && !vStayingAncestors.empty();
+    if (!vStaying.empty() && !fCutsChain) {
+        BOOST_FOREACH(const txiter& it, stage) {
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            BOOST_FOREACH(const txiter& descendant, setDescendants) {
+                if (!stage.count(descendant))
+                    UpdateAncestorState(descendant, -1, -(int64_t)it->second.GetTxSize(), -it->second.GetModifiedFee());
+            }
+        }
+    }
+    if (!vStayingAncestors.empty() && !fCutsChain) {
+        BOOST_FOREACH(const txiter& it, stage) {
+            setEntries setAncestors;
+            CalculateAncestors(it, setAncestors);
+            BOOST_FOREACH(const txiter& ancestor, setAncestors) {
+                if (!stage.count(ancestor))
+                    UpdateDescendantState(ancestor, -1, -(int64_t)it->second.GetTxSize(), -it->second.GetModifiedFee());
+            }
+        }
+    }
+
+    BOOST_FOREACH(const txiter& it, stage) {
+        const TxLinks& links = mapLinks[it];
+        BOOST_FOREACH(const txiter& parent, links.parents)
+            mapLinks[parent].children.erase(it);
+        BOOST_FOREACH(const txiter& child, links.children)
+            mapLinks[child].parents.erase(it);
+    }
+    BOOST_FOREACH(const txiter& it, stage) {
+        const CTransaction& tx = it->second.GetTx();
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            mapNextTx.erase(txin.prevout);
+
+        setByPriority.erase(std::make_pair(GetModifiedPriority(it, nPriorityHeight), it));
+        setByAncestorFeeRate.erase(it);
+        setByDescendantScore.erase(it);
+        mapLinks.erase(it);
+        totalTxSize -= it->second.GetTxSize();
+        cachedInnerUsage -= it->second.DynamicMemoryUsage();
+        mapTx.erase(it);
+        nTransactionsUpdated++;
+    }
+
+    if (fCutsChain) {
+        BOOST_FOREACH(const txiter& it, vStaying)
+            UpdateAncestorsOf(it);
+        BOOST_FOREACH(const txiter& it, vStayingAncestors)
+            UpdateDescendantsOf(it);
+    }
+}
 
 void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
-        std::deque<uint256> txToRemove;
-        txToRemove.push_back(origTx.GetHash());
-        if (fRecursive && !mapTx.count(origTx.GetHash())) {
+        setEntries setRemove;
+        txiter origit = mapTx.find(origTx.GetHash());
+        if (origit != mapTx.end()) {
+            if (fRecursive)
+                CalculateDescendants(origit, setRemove);
+            else
+                setRemove.insert(origit);
+        } else if (fRecursive) {
             // If recursively removing but origTx isn't in the mempool
             // be sure to remove any children that are in the pool. This can
             // happen during chain re-orgs if origTx isn't re-accepted into
@@ -457,32 +732,14 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
                 std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
-                txToRemove.push_back(it->second.ptx->GetHash());
-            }
-        }
-        while (!txToRemove.empty())
-        {
-            uint256 hash = txToRemove.front();
-            txToRemove.pop_front();
-            if (!mapTx.count(hash))
-                continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
-            if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
-                    txToRemove.push_back(it->second.ptx->GetHash());
-                }
+                txiter nextit = mapTx.find(it->second.ptx->GetHash());
+                assert(nextit != mapTx.end());
+                CalculateDescendants(nextit, setRemove);
             }
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-                mapNextTx.erase(txin.prevout);
-
-            removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
         }
+        BOOST_FOREACH(const txiter& it, setRemove)
+            removed.push_back(it->second.GetTx());
+        RemoveStaged(setRemove);
     }
 }
 
@@ -550,15 +807,32 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+
+    // The block made room, so the fee rate after an eviction may start to decay
+    blockSinceLastRollingFeeBump = true;
+
+    // Priorities all grow with the height, each at its own pace, so the order is redone once per block
+    nPriorityHeight = nBlockHeight + 1;
+    setByPriority.clear();
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it)
+        setByPriority.insert(std::make_pair(GetModifiedPriority(it, nPriorityHeight), it));
 }
 
 
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    setByPriority.clear();
+    setByAncestorFeeRate.clear();
+    setByDescendantScore.clear();
+    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
+    cachedInnerUsage = 0;
+    rollingMinimumFeeRate = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
     ++nTransactionsUpdated;
 }
 
@@ -632,6 +906,121 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
+
+    // The links, package totals and indexes CreateNewBlock() relies on
+    assert(mapLinks.size() == mapTx.size());
+    assert(setByAncestorFeeRate.size() == mapTx.size());
+    assert(setByPriority.size() == mapTx.size());
+    assert(setByDescendantScore.size() == mapTx.size());
+    uint64_t checkUsage = 0;
+    for (std::map<txiter, TxLinks, CompareIteratorByHash>::const_iterator lit = mapLinks.begin(); lit != mapLinks.end(); lit++) {
+        txiter it = lit->first;
+        const CTransaction& tx = it->second.GetTx();
+        std::set<uint256> setParentHashes;
+        BOOST_FOREACH(const CTxIn &txin, tx.vin) {
+            if (mapTx.count(txin.prevout.hash))
+                setParentHashes.insert(txin.prevout.hash);
+        }
+        assert(setParentHashes.size() == lit->second.parents.size());
+        BOOST_FOREACH(const txiter& parent, lit->second.parents) {
+            assert(setParentHashes.count(parent->first));
+            assert(GetMemPoolChildren(parent).count(it));
+        }
+        BOOST_FOREACH(const txiter& child, lit->second.children)
+            assert(GetMemPoolParents(child).count(it));
+        setEntries setAncestors;
+        CalculateAncestors(it, setAncestors);
+        uint64_t nCount = 1;
+        uint64_t nSize = it->second.GetTxSize();
+        CAmount nFees = it->second.GetModifiedFee();
+        BOOST_FOREACH(const txiter& ancestor, setAncestors) {
+            nSize += ancestor->second.GetTxSize();
+            nFees += ancestor->second.GetModifiedFee();
+            nCount++;
+        }
+        assert(it->second.GetCountWithAncestors() == nCount);
+        assert(it->second.GetSizeWithAncestors() == nSize);
+        assert(it->second.GetModFeesWithAncestors() == nFees);
+        assert(setByAncestorFeeRate.count(it));
+
+        setEntries setDescendants;
+        CalculateDescendants(it, setDescendants);
+        nCount = 0;
+        nSize = 0;
+        nFees = 0;
+        BOOST_FOREACH(const txiter& descendant, setDescendants) {
+            nSize += descendant->second.GetTxSize();
+            nFees += descendant->second.GetModifiedFee();
+            nCount++;
+        }
+        assert(it->second.GetCountWithDescendants() == nCount);
+        assert(it->second.GetSizeWithDescendants() == nSize);
+        assert(it->second.GetModFeesWithDescendants() == nFees);
+        assert(setByDescendantScore.count(it));
+        checkUsage += it->second.DynamicMemoryUsage();
+    }
+    assert(cachedInnerUsage == checkUsage);
+}
+
+size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return cachedInnerUsage + mapDeltas.size() * (MEMPOOL_NODE_OVERHEAD + sizeof(uint256) + sizeof(std::pair<double, CAmount>));
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t nSizeLimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate((int64_t)rollingMinimumFeeRate);
+
+    int64_t nTime = GetTime();
+    if (nTime > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < nSizeLimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < nSizeLimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (nTime - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = nTime;
+
+        if (rollingMinimumFeeRate < minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate((int64_t)rollingMinimumFeeRate), minRelayFee);
+}
+
+void CTxMemPool::TrimToSize(size_t nSizeLimit)
+{
+    LOCK(cs);
+
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!setByDescendantScore.empty() && DynamicMemoryUsage() > nSizeLimit) {
+        txiter it = *setByDescendantScore.begin();
+
+        // A transaction must beat what was evicted by the relay fee to take its place, or a flood of
+        // slightly better ones would churn the pool for the price of one
+        CFeeRate removed(it->second.GetModFeesWithDescendants(), it->second.GetSizeWithDescendants());
+        removed = CFeeRate(removed.GetFeePerK() + minRelayFee.GetFeePerK());
+        if (removed.GetFeePerK() > rollingMinimumFeeRate) {
+            rollingMinimumFeeRate = removed.GetFeePerK();
+            blockSinceLastRollingFeeBump = false;
+        }
+        lastRollingFeeUpdate = GetTime();
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        setEntries stage;
+        CalculateDescendants(it, stage);
+        nTxnRemoved += stage.size();
+        RemoveStaged(stage);
+    }
+
+    if (nTxnRemoved > 0)
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -703,9 +1092,30 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
 {
     {
         LOCK(cs);
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end())
+            setByPriority.erase(std::make_pair(GetModifiedPriority(it, nPriorityHeight), it));
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        if (it != mapTx.end()) {
+            // The entry is part of the package of each of its descendants and each of its ancestors
+            CAmount nModFeeBefore = it->second.GetModifiedFee();
+            setByDescendantScore.erase(it);
+            it->second.UpdateFeeDelta(deltas.second);
+            setByDescendantScore.insert(it);
+            CAmount nChange = it->second.GetModifiedFee() - nModFeeBefore;
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            BOOST_FOREACH(const txiter& descendant, setDescendants)
+                UpdateAncestorState(descendant, 0, 0, nChange);
+            setEntries setAncestors;
+            CalculateAncestors(it, setAncestors);
+            setAncestors.insert(it);
+            BOOST_FOREACH(const txiter& ancestor, setAncestors)
+                UpdateDescendantState(ancestor, 0, 0, nChange);
+            setByPriority.insert(std::make_pair(GetModifiedPriority(it, nPriorityHeight), it));
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
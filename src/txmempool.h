@@ -6,7 +6,9 @@
 #ifndef ANONCOIN_TXMEMPOOL_H
 #define ANONCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -46,6 +48,19 @@ private:
     int64_t nTime; //! Local time when entering the mempool
     double dPriority; //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nModFee; //! Fee including the delta given by PrioritiseTransaction()
+
+    //! The entry and all its in-mempool ancestors, as a package
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+
+    //! The entry and all its in-mempool descendants, the package eviction takes out together
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+
+    size_t nUsageSize; //! Estimated memory the entry takes in the pool
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
@@ -59,6 +74,21 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetModifiedFee() const { return nModFee; }
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+    size_t DynamicMemoryUsage() const { return nUsageSize; }
+
+    //! Sets the PrioritiseTransaction() fee delta, the ancestor state is up to the mempool
+    void UpdateFeeDelta(CAmount nFeeDelta);
+    //! Adjusts the package totals when an ancestor enters or leaves the mempool
+    void UpdateAncestorState(int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee);
+    //! Adjusts the package totals when a descendant enters or leaves the mempool
+    void UpdateDescendantState(int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee);
 };
 
 class CMinerPolicyEstimator;
@@ -88,6 +118,73 @@ public:
  */
 class CTxMemPool
 {
+public:
+    typedef std::map<uint256, CTxMemPoolEntry>::iterator txiter;
+
+    struct CompareIteratorByHash
+    {
+        bool operator()(const txiter& a, const txiter& b) const { return a->first < b->first; }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
+    /** Orders entries by the fee rate of the package they form with their in-mempool ancestors, highest first */
+    struct CompareByAncestorFeeRate
+    {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            double f1 = (double)a->second.GetModFeesWithAncestors() * b->second.GetSizeWithAncestors();
+            double f2 = (double)b->second.GetModFeesWithAncestors() * a->second.GetSizeWithAncestors();
+            if (f1 == f2)
+                return a->first < b->first;
+            return f1 > f2;
+        }
+    };
+
+    /**
+     * Orders entries lowest first by the greater of their own fee rate and that of the package they form
+     * with their descendants, so the first one is what eviction loses least fees on per byte freed
+     */
+    struct CompareByDescendantScore
+    {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            double f1 = GetScore(a->second);
+            double f2 = GetScore(b->second);
+            if (f1 == f2)
+                return a->first < b->first;
+            return f1 < f2;
+        }
+
+        static double GetScore(const CTxMemPoolEntry& entry)
+        {
+            double dOwn = (double)entry.GetModifiedFee() / entry.GetTxSize();
+            double dPackage = (double)entry.GetModFeesWithDescendants() / entry.GetSizeWithDescendants();
+            return std::max(dOwn, dPackage);
+        }
+    };
+
+    /** Orders entries parents first, as a transaction has fewer in-mempool ancestors than any of its children */
+    struct CompareByAncestorCount
+    {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            if (a->second.GetCountWithAncestors() == b->second.GetCountWithAncestors())
+                return a->first < b->first;
+            return a->second.GetCountWithAncestors() < b->second.GetCountWithAncestors();
+        }
+    };
+
+    /** Orders (priority, entry) pairs highest priority first */
+    struct CompareByPriority
+    {
+        bool operator()(const std::pair<double, txiter>& a, const std::pair<double, txiter>& b) const
+        {
+            if (a.first == b.first)
+                return a.second->first < b.second->first;
+            return a.first > b.first;
+        }
+    };
+
 private:
     bool fSanityCheck; //! Normally false, true if -checkmempool or -regtest
     unsigned int nTransactionsUpdated;
@@ -96,12 +193,52 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    //! The in-mempool parents and children of every entry
+    struct TxLinks
+    {
+        setEntries parents;
+        setEntries children;
+    };
+    std::map<txiter, TxLinks, CompareIteratorByHash> mapLinks;
+
+    //! The height setByPriority is ordered at, the one after the last block connected
+    unsigned int nPriorityHeight;
+
+    uint64_t cachedInnerUsage; //! sum of the estimated memory usage of all entries
+
+    /**
+     * The fee rate a transaction needs to get in after the pool was full, raised by every eviction
+     * past the rate of what it evicted and decaying once blocks make room again
+     */
+    mutable double rollingMinimumFeeRate;
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+
+    void UpdateAncestorState(txiter it, int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee);
+    void UpdateAncestorsOf(txiter it);
+    void UpdateDescendantState(txiter it, int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee);
+    void UpdateDescendantsOf(txiter it);
+    void RemoveStaged(const setEntries& stage);
+
 public:
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+    /**
+     * The orders CreateNewBlock() takes transactions in, kept up to date as entries come and go so it
+     * never has to look at the whole pool.  Entries of setByAncestorFeeRate must not change their
+     * ancestor state while in it, which is why that only happens through UpdateAncestorState().
+     */
+    std::set<txiter, CompareByAncestorFeeRate> setByAncestorFeeRate;
+    std::set<std::pair<double, txiter>, CompareByPriority> setByPriority;
+    //! The order TrimToSize() evicts in, entries change their descendant state only through UpdateDescendantState()
+    std::set<txiter, CompareByDescendantScore> setByDescendantScore;
+
+    /** Half-life in seconds of the fee rate a full pool asks for, once a block has been connected */
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -126,6 +263,28 @@ public:
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
+    const setEntries& GetMemPoolParents(txiter it) const;
+    const setEntries& GetMemPoolChildren(txiter it) const;
+    //! Adds the in-mempool ancestors of an entry to setAncestors, not the entry itself
+    void CalculateAncestors(txiter it, setEntries& setAncestors) const;
+    //! Adds an entry and all its in-mempool descendants to setDescendants
+    void CalculateDescendants(txiter it, setEntries& setDescendants) const;
+    //! Priority of an entry at nHeight, including the delta given by PrioritiseTransaction()
+    double GetModifiedPriority(txiter it, unsigned int nHeight) const;
+
+    /**
+     * Evicts the packages of the lowest descendant score until the pool uses no more than nSizeLimit
+     * bytes of memory, and raises the fee rate GetMinFee() asks for past the best of them
+     */
+    void TrimToSize(size_t nSizeLimit);
+    /**
+     * The fee rate a transaction needs to enter a pool limited to nSizeLimit bytes, zero unless it
+     * filled up recently.  It halves every ROLLING_FEE_HALFLIFE, faster while the pool is small.
+     */
+    CFeeRate GetMinFee(size_t nSizeLimit) const;
+    //! Estimated memory the pool uses, what -maxmempool limits
+    size_t DynamicMemoryUsage() const;
+
     /** Affect CreateNewBlock prioritisation of transactions */
     void PrioritiseTransaction(const uint256 hash, const std::string strHash, double dPriorityDelta, const CAmount& nFeeDelta);
     void ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta);
@@ -2142,6 +2142,17 @@ bool CWallet::GetDestData(const CTxDestination &dest, const string &key, string
  * CMerkleTx method definitions...
  */
 
+namespace {
+
+//! The merkle tree of the block SetMerkleBranch() was last given, so the wallet transactions of a block share one
+//! tree rather than each hashing it again.  The transaction count tells a block from a copy mutated as in
+//! CVE-2012-2459, which has the same hash.  Guarded by cs_main.
+uintFakeHash hashMerkleTreeBlock;
+size_t nMerkleTreeLeaves = 0;
+std::vector<uint256> vMerkleTreeCache;
+
+} // anon namespace
+
 int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
 {
     AssertLockHeld(cs_main);
@@ -2161,7 +2172,8 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
 
     if (pblock) {
         // Update the tx's hashBlock
-        SetTxBlockHash( pblock->CalcSha256dHash() );
+        uintFakeHash hashBlock = pblock->CalcSha256dHash();
+        SetTxBlockHash( hashBlock );
 
         // Locate the transaction
         for (nIndex = 0; nIndex < (int)pblock->vtx.size(); nIndex++)
@@ -2176,7 +2188,16 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
         }
 
         // Fill in merkle branch
-        vMerkleBranch = pblock->GetMerkleBranch(nIndex);
+        if (hashBlock != hashMerkleTreeBlock || pblock->vtx.size() != nMerkleTreeLeaves) {
+            std::vector<uint256> vLeaves;
+            vLeaves.reserve(pblock->vtx.size());
+            BOOST_FOREACH(const CTransaction& tx, pblock->vtx)
+                vLeaves.push_back(tx.GetHash());
+            vMerkleTreeCache = ComputeMerkleTree(vLeaves);
+            hashMerkleTreeBlock = hashBlock;
+            nMerkleTreeLeaves = pblock->vtx.size();
+        }
+        vMerkleBranch = GetMerkleBranchFromTree(vMerkleTreeCache, pblock->vtx.size(), nIndex);
     }
 
     // Is the tx in a block that's in the main chain